@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Bump allocator for AST nodes and interned strings. Objects placed here are
+// never destroyed individually: everything is released at once when the
+// arena goes away, so only trivially-owning types (views, spans, raw
+// pointers) may live in it.
+class Arena {
+    static constexpr size_t blockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte* cursor = nullptr;
+    size_t remaining = 0;
+    size_t used = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        if (padding + size > remaining) {
+            size_t capacity = size + align > blockSize ? size + align : blockSize;
+            blocks.push_back(std::make_unique<std::byte[]>(capacity));
+            cursor = blocks.back().get();
+            remaining = capacity;
+            padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        }
+        void* result = cursor + padding;
+        cursor += padding + size;
+        remaining -= padding + size;
+        used += padding + size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    std::span<T> copyArray(const std::vector<T>& items) {
+        if (items.empty()) return {};
+        T* data = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), data);
+        return {data, items.size()};
+    }
+
+    size_t bytesUsed() const { return used; }
+};
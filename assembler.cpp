@@ -0,0 +1,284 @@
+#include "assembler.hpp"
+#include <stdexcept>
+
+namespace x86 {
+
+Label Assembler::newLabel() {
+    labels.push_back(-1);
+    return {static_cast<int>(labels.size() - 1)};
+}
+
+void Assembler::bind(Label label) {
+    labels[label.id] = static_cast<int64_t>(bytes.size());
+}
+
+std::vector<uint8_t> Assembler::finish() {
+    for (const auto& fixup : fixups) {
+        int64_t target = labels[fixup.label];
+        if (target < 0) throw std::logic_error("Native backend: unbound label");
+        int32_t rel = static_cast<int32_t>(target - static_cast<int64_t>(fixup.at + 4));
+        for (int i = 0; i < 4; i++) bytes[fixup.at + i] = static_cast<uint8_t>(rel >> (i * 8));
+    }
+    fixups.clear();
+    return bytes;
+}
+
+void Assembler::u32(uint32_t v) {
+    for (int i = 0; i < 4; i++) byte(static_cast<uint8_t>(v >> (i * 8)));
+}
+
+void Assembler::u64(uint64_t v) {
+    for (int i = 0; i < 8; i++) byte(static_cast<uint8_t>(v >> (i * 8)));
+}
+
+void Assembler::align(size_t alignment) {
+    while (bytes.size() % alignment) byte(0);
+}
+
+void Assembler::rex(bool wide, uint8_t reg, uint8_t index, uint8_t base, bool byteRegs) {
+    uint8_t prefix = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+    if (prefix != 0x40 || byteRegs) byte(prefix);
+}
+
+void Assembler::modrm(uint8_t reg, Reg rm) {
+    byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Always uses a 32-bit displacement; short forms are not worth the bytes
+// saved for code that is written once and run.
+void Assembler::modrm(uint8_t reg, Mem mem) {
+    if (mem.absolute) {
+        byte(static_cast<uint8_t>(0x04 | ((reg & 7) << 3)));
+        byte(0x25);
+    } else {
+        byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (mem.base & 7)));
+        if ((mem.base & 7) == RSP) byte(0x24);
+    }
+    u32(static_cast<uint32_t>(mem.disp));
+}
+
+void Assembler::rel32(Label label) {
+    fixups.push_back({bytes.size(), label.id});
+    u32(0);
+}
+
+void Assembler::mov(Reg dst, Reg src, bool wide) {
+    rex(wide, src, 0, dst);
+    byte(0x89);
+    modrm(src, dst);
+}
+
+void Assembler::mov(Reg dst, int64_t imm) {
+    if (imm >= 0 && imm <= 0xFFFFFFFFLL) {
+        rex(false, 0, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 | (dst & 7)));
+        u32(static_cast<uint32_t>(imm));
+    } else {
+        rex(true, 0, 0, dst);
+        byte(static_cast<uint8_t>(0xB8 | (dst & 7)));
+        u64(static_cast<uint64_t>(imm));
+    }
+}
+
+void Assembler::load(Reg dst, Mem src, bool wide) {
+    rex(wide, dst, src);
+    byte(0x8B);
+    modrm(dst, src);
+}
+
+void Assembler::store(Mem dst, Reg src, bool wide) {
+    rex(wide, src, dst);
+    byte(0x89);
+    modrm(src, dst);
+}
+
+void Assembler::storeByte(Mem dst, Reg src) {
+    rex(false, src, 0, dst.absolute ? 0 : dst.base, src >= RSP);
+    byte(0x88);
+    modrm(src, dst);
+}
+
+void Assembler::storeImm(Mem dst, int32_t imm, bool wide) {
+    rex(wide, 0, dst);
+    byte(0xC7);
+    modrm(0, dst);
+    u32(static_cast<uint32_t>(imm));
+}
+
+void Assembler::storeByteImm(Mem dst, uint8_t imm) {
+    rex(false, 0, dst);
+    byte(0xC6);
+    modrm(0, dst);
+    byte(imm);
+}
+
+void Assembler::loadByte(Reg dst, Mem src) {
+    rex(false, dst, src);
+    byte(0x0F);
+    byte(0xB6);
+    modrm(dst, src);
+}
+
+void Assembler::movzxByte(Reg dst, Reg src) {
+    rex(false, dst, 0, src, src >= RSP);
+    byte(0x0F);
+    byte(0xB6);
+    modrm(dst, src);
+}
+
+void Assembler::movsxd(Reg dst, Reg src) {
+    rex(true, dst, 0, src);
+    byte(0x63);
+    modrm(dst, src);
+}
+
+void Assembler::lea(Reg dst, Mem src) {
+    rex(true, dst, src);
+    byte(0x8D);
+    modrm(dst, src);
+}
+
+void Assembler::lea(Reg dst, Label label) {
+    rex(true, dst, 0, 0);
+    byte(0x8D);
+    byte(static_cast<uint8_t>(0x05 | ((dst & 7) << 3)));
+    rel32(label);
+}
+
+void Assembler::alu(AluOp op, Reg dst, Reg src, bool wide) {
+    rex(wide, src, 0, dst);
+    byte(static_cast<uint8_t>((op << 3) | 0x01));
+    modrm(src, dst);
+}
+
+void Assembler::alu(AluOp op, Reg dst, int32_t imm, bool wide) {
+    rex(wide, 0, 0, dst);
+    if (imm >= -128 && imm <= 127) {
+        byte(0x83);
+        modrm(op, dst);
+        byte(static_cast<uint8_t>(imm));
+    } else {
+        byte(0x81);
+        modrm(op, dst);
+        u32(static_cast<uint32_t>(imm));
+    }
+}
+
+void Assembler::alu(AluOp op, Reg dst, Mem src, bool wide) {
+    rex(wide, dst, src);
+    byte(static_cast<uint8_t>((op << 3) | 0x03));
+    modrm(dst, src);
+}
+
+void Assembler::aluMem(AluOp op, Mem dst, int32_t imm, bool wide) {
+    rex(wide, 0, dst);
+    byte(0x81);
+    modrm(op, dst);
+    u32(static_cast<uint32_t>(imm));
+}
+
+void Assembler::cmpByte(Reg reg, Mem src) {
+    rex(false, reg, 0, src.absolute ? 0 : src.base, reg >= RSP);
+    byte(0x3A);
+    modrm(reg, src);
+}
+
+void Assembler::test(Reg a, Reg b, bool wide) {
+    rex(wide, b, 0, a);
+    byte(0x85);
+    modrm(b, a);
+}
+
+void Assembler::imul(Reg dst, Reg src, bool wide) {
+    rex(wide, dst, 0, src);
+    byte(0x0F);
+    byte(0xAF);
+    modrm(dst, src);
+}
+
+void Assembler::imulImm(Reg dst, Reg src, int8_t imm, bool wide) {
+    rex(wide, dst, 0, src);
+    byte(0x6B);
+    modrm(dst, src);
+    byte(static_cast<uint8_t>(imm));
+}
+
+void Assembler::idiv(Reg divisor, bool wide) {
+    rex(wide, 0, 0, divisor);
+    byte(0xF7);
+    modrm(7, divisor);
+}
+
+void Assembler::div(Reg divisor, bool wide) {
+    rex(wide, 0, 0, divisor);
+    byte(0xF7);
+    modrm(6, divisor);
+}
+
+void Assembler::neg(Reg reg, bool wide) {
+    rex(wide, 0, 0, reg);
+    byte(0xF7);
+    modrm(3, reg);
+}
+
+void Assembler::shl(Reg reg, uint8_t count, bool wide) {
+    rex(wide, 0, 0, reg);
+    byte(0xC1);
+    modrm(4, reg);
+    byte(count);
+}
+
+void Assembler::shr(Reg reg, uint8_t count, bool wide) {
+    rex(wide, 0, 0, reg);
+    byte(0xC1);
+    modrm(5, reg);
+    byte(count);
+}
+
+void Assembler::incMem(Mem dst) {
+    rex(true, 0, dst);
+    byte(0xFF);
+    modrm(0, dst);
+}
+
+void Assembler::setcc(Cond cond, Reg dst) {
+    rex(false, 0, 0, dst, dst >= RSP);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x90 | cond));
+    modrm(0, dst);
+}
+
+void Assembler::cmov(Cond cond, Reg dst, Reg src) {
+    rex(true, dst, 0, src);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x40 | cond));
+    modrm(dst, src);
+}
+
+void Assembler::push(Reg reg) {
+    rex(false, 0, 0, reg);
+    byte(static_cast<uint8_t>(0x50 | (reg & 7)));
+}
+
+void Assembler::pop(Reg reg) {
+    rex(false, 0, 0, reg);
+    byte(static_cast<uint8_t>(0x58 | (reg & 7)));
+}
+
+void Assembler::jmp(Label label) {
+    byte(0xE9);
+    rel32(label);
+}
+
+void Assembler::jcc(Cond cond, Label label) {
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x80 | cond));
+    rel32(label);
+}
+
+void Assembler::call(Label label) {
+    byte(0xE8);
+    rel32(label);
+}
+
+}
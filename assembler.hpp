@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Just enough of the x86-64 instruction set for the native backend. Jumps,
+// calls and RIP-relative loads refer to labels and are patched by finish().
+namespace x86 {
+
+enum Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum Cond : uint8_t {
+    O = 0x0, NO = 0x1, B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, BE = 0x6, A = 0x7,
+    S = 0x8, NS = 0x9, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF
+};
+
+enum AluOp : uint8_t {
+    ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7
+};
+
+// [base + disp], or an absolute 32-bit address when absolute is set.
+struct Mem {
+    Reg base;
+    int32_t disp;
+    bool absolute;
+};
+
+inline Mem at(Reg base, int32_t disp = 0) { return {base, disp, false}; }
+inline Mem absolute(uint32_t address) { return {RAX, static_cast<int32_t>(address), true}; }
+
+struct Label {
+    int id;
+};
+
+class Assembler {
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> labels;
+    struct Fixup {
+        size_t at;
+        int label;
+    };
+    std::vector<Fixup> fixups;
+
+public:
+    Label newLabel();
+    void bind(Label label);
+    size_t size() const { return bytes.size(); }
+    // Resolves every label reference; the code is position independent
+    // apart from absolute data addresses.
+    std::vector<uint8_t> finish();
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+    void u32(uint32_t v);
+    void u64(uint64_t v);
+    void align(size_t alignment);
+
+    void mov(Reg dst, Reg src, bool wide = true);
+    void mov(Reg dst, int64_t imm);
+    void load(Reg dst, Mem src, bool wide = true);
+    void store(Mem dst, Reg src, bool wide = true);
+    void storeByte(Mem dst, Reg src);
+    void storeImm(Mem dst, int32_t imm, bool wide = true);
+    void storeByteImm(Mem dst, uint8_t imm);
+    void loadByte(Reg dst, Mem src);
+    void movzxByte(Reg dst, Reg src);
+    void movsxd(Reg dst, Reg src);
+    void lea(Reg dst, Mem src);
+    void lea(Reg dst, Label label);
+
+    void alu(AluOp op, Reg dst, Reg src, bool wide = true);
+    void alu(AluOp op, Reg dst, int32_t imm, bool wide = true);
+    void alu(AluOp op, Reg dst, Mem src, bool wide = true);
+    void aluMem(AluOp op, Mem dst, int32_t imm, bool wide = true);
+    void cmpByte(Reg reg, Mem src);
+    void test(Reg a, Reg b, bool wide = true);
+    void imul(Reg dst, Reg src, bool wide = true);
+    void imulImm(Reg dst, Reg src, int8_t imm, bool wide = true);
+    void idiv(Reg divisor, bool wide = true);
+    void div(Reg divisor, bool wide = true);
+    void neg(Reg reg, bool wide = true);
+    void shl(Reg reg, uint8_t count, bool wide = true);
+    void shr(Reg reg, uint8_t count, bool wide = true);
+    void incMem(Mem dst);
+    void cdq() { byte(0x99); }
+    void cqo() { byte(0x48); byte(0x99); }
+    void setcc(Cond cond, Reg dst);
+    void cmov(Cond cond, Reg dst, Reg src);
+    void repMovsb() { byte(0xF3); byte(0xA4); }
+
+    void push(Reg reg);
+    void pop(Reg reg);
+    void jmp(Label label);
+    void jcc(Cond cond, Label label);
+    void call(Label label);
+    void ret() { byte(0xC3); }
+    void syscall() { byte(0x0F); byte(0x05); }
+
+private:
+    void rex(bool wide, uint8_t reg, uint8_t index, uint8_t base, bool byteRegs = false);
+    void rex(bool wide, uint8_t reg, Mem mem) { rex(wide, reg, 0, mem.absolute ? 0 : mem.base); }
+    void modrm(uint8_t reg, Reg rm);
+    void modrm(uint8_t reg, Mem mem);
+    void rel32(Label label);
+};
+
+}
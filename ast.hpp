@@ -1,233 +1,357 @@
 #pragma once
+#include "context.hpp"
 #include "lexer.hpp"
+#include <charconv>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
-#include <set>
 
-inline std::set<std::string> variables;
-inline std::set<std::string> stringVars;
+inline bool isNumeric(ValueType type) {
+    return type == ValueType::Bool || type == ValueType::Int || type == ValueType::Long || type == ValueType::Real;
+}
+
+inline bool isIntegral(ValueType type) {
+    return type == ValueType::Int || type == ValueType::Long;
+}
+
+inline bool isComparisonOperator(std::string_view op) {
+    return op == "<" || op == ">" || op == "<=" || op == ">=" || op == "=" || op == "==" || op == "<>" || op == "!=";
+}
+
+// AND and OR, which short-circuit like && and || in every backend.
+inline bool isLogicalOperator(std::string_view op) {
+    return op == "AND" || op == "OR";
+}
+
+inline std::string_view cppOperator(std::string_view op) {
+    if (op == "=") return "==";
+    if (op == "<>") return "!=";
+    if (op == "AND") return "&&";
+    if (op == "OR") return "||";
+    if (op == "NOT") return "!";
+    return op;
+}
+
+inline const char* cppTypeName(ValueType type) {
+    switch (type) {
+        case ValueType::Bool: return "bool";
+        case ValueType::Long: return "long long";
+        case ValueType::Real: return "double";
+        case ValueType::String: return "string";
+        default: return "int";
+    }
+}
+
+// A number literal as C++. Without the suffix a 64-bit literal is a long,
+// which print cannot tell from an int or a long long, and C++ reads
+// -9223372036854775808 as a minus applied to a literal too large for long
+// long, so that one is written as a difference.
+inline std::string cppNumberLiteral(std::string_view value, ValueType type) {
+    if (type != ValueType::Long) return std::string(value);
+    if (value == "-9223372036854775808") return "(-9223372036854775807LL - 1)";
+    return std::string(value) + "LL";
+}
 
 struct ExprNode {
+    SourcePosition position;
     virtual ~ExprNode() = default;
     virtual std::string toString() const = 0;
-    virtual void generateCode(std::ostream& out) const = 0;
+    virtual ValueType inferType(const CompilationContext& context) const = 0;
+    virtual void generateCode(std::ostream& out, CompilationContext& context) const = 0;
+};
+
+// The type of a node built from others, remembered until the variable
+// types change. Without it typing each level of a deeply nested formula
+// retypes everything below it, which takes quadratic time.
+struct TypeCache {
+    mutable ValueType type = ValueType::Unknown;
+    mutable uint64_t version = 0;
+
+    template <typename Compute>
+    ValueType get(const CompilationContext& context, Compute compute) const {
+        if (version != context.variables.version()) {
+            type = compute();
+            version = context.variables.version();
+        }
+        return type;
+    }
 };
 
 struct ASTNode {
+    SourcePosition position;
     virtual ~ASTNode() = default;
-    virtual void generateCode(std::ostream& out) const = 0;
+    virtual void generateCode(std::ostream& out, CompilationContext& context) const = 0;
 };
 
+// Nodes, their strings and their child lists all live in the
+// CompilationContext arena and are released together with it.
+using NodeList = std::span<ASTNode*>;
+
+// In a --profile build, marks the point where a statement starts or a loop
+// comes back to its test: the line gets a hit, and the time until the next
+// probe.
+inline void emitLineProbe(SourcePosition position, std::ostream& out, const CompilationContext& context) {
+    if (context.profile && position.line) out << "\tpseudo::profile.at(" << position.line << ");\n";
+}
+
+inline void generateBlock(NodeList block, std::ostream& out, CompilationContext& context) {
+    for (auto stmt : block) {
+        emitLineProbe(stmt->position, out, context);
+        stmt->generateCode(out, context);
+    }
+}
+
 struct VariableExpr : ExprNode {
-    std::string name;
-    VariableExpr(const std::string& n) : name(n) {}
-    std::string toString() const override { return name; }
-    void generateCode(std::ostream& out) const override { out << name; }
+    std::string_view name;
+    uint32_t symbol;
+    VariableExpr(std::string_view n, uint32_t sym) : name(n), symbol(sym) {}
+    std::string toString() const override { return std::string(name); }
+    ValueType inferType(const CompilationContext& context) const override {
+        return context.variables.typeOf(symbol);
+    }
+    void generateCode(std::ostream& out, CompilationContext&) const override { out << name; }
 };
 
 struct LiteralExpr : ExprNode {
-    std::string value;
+    std::string_view value;
     TokenType type;
-    LiteralExpr(const std::string& val, TokenType t) : value(val), type(t) {}
+    LiteralExpr(std::string_view val, TokenType t) : value(val), type(t) {}
     std::string toString() const override {
-        if (type == STRING) return "\"" + value + "\"";
-        return value;
+        if (type == STRING) return "\"" + std::string(value) + "\"";
+        return std::string(value);
+    }
+    ValueType literalType() const {
+        if (type == STRING) return ValueType::String;
+        if (type == TRUE || type == FALSE) return ValueType::Bool;
+        if (value.find('.') != std::string::npos) return ValueType::Real;
+        long long number = 0;
+        std::from_chars(value.data(), value.data() + value.size(), number);
+        return number >= INT32_MIN && number <= INT32_MAX ? ValueType::Int : ValueType::Long;
     }
-    void generateCode(std::ostream& out) const override {
+    ValueType inferType(const CompilationContext&) const override { return literalType(); }
+    void generateCode(std::ostream& out, CompilationContext&) const override {
         if (type == STRING) out << "\"" << value << "\"";
-        else out << value;
+        else if (type == TRUE) out << "true";
+        else if (type == FALSE) out << "false";
+        else out << cppNumberLiteral(value, literalType());
     }
 };
 
-struct ProgramNode : ASTNode {
-    std::vector<ASTNode*> statements;
-    std::map<std::string, std::string> varTypes;
-
-    ~ProgramNode() {
-        for (auto stmt : statements) delete stmt;
+// The runtime function behind an overflow-checked operator.
+inline const char* checkedOperation(std::string_view op) {
+    if (op == "+") return "pseudo::checkedAdd";
+    if (op == "-") return "pseudo::checkedSub";
+    if (op == "*") return "pseudo::checkedMul";
+    if (op == "/") return "pseudo::checkedDiv";
+    return "pseudo::checkedMod";
+}
+
+// The text that converts a STRING to a number of the wanted type.
+inline const char* parseFunction(ValueType want) {
+    if (want == ValueType::Real) return "stod(";
+    return want == ValueType::Long ? "stoll(" : "stoi(";
+}
+
+// Emits expr converted to the wanted type; conversions only appear where
+// the inferred types genuinely disagree. A 64-bit value stored into 32 bits
+// is checked unless its range fits there.
+inline void generateAs(const ExprNode* expr, ValueType want, std::ostream& out, CompilationContext& context) {
+    ValueType have = expr->inferType(context);
+    if (want == ValueType::String && isNumeric(have)) {
+        context.includes.insert("string");
+        out << "to_string(";
+        expr->generateCode(out, context);
+        out << ")";
+    } else if (isNumeric(want) && have == ValueType::String) {
+        context.includes.insert("string");
+        out << parseFunction(want);
+        expr->generateCode(out, context);
+        out << ")";
+    } else if (want == ValueType::Int && have == ValueType::Long && !context.integerOps.count(expr)) {
+        out << "static_cast<int>(";
+        expr->generateCode(out, context);
+        out << ")";
+    } else if (want == ValueType::Int && have == ValueType::Long) {
+        context.usesIo = true;
+        out << "pseudo::checkedNarrow(";
+        expr->generateCode(out, context);
+        out << ", " << expr->position.line << ")";
+    } else {
+        expr->generateCode(out, context);
     }
+}
 
-    void generateCode(std::ostream& out) const override {
-        for (auto stmt : statements)
-            stmt->generateCode(out);
+struct TypeHint {
+    uint32_t symbol;
+    ValueType type;
+};
+
+struct ProgramNode : ASTNode {
+    NodeList statements;
+    // Every PROCEDURE and FUNCTION, in the order they are defined.
+    std::span<SubroutineNode*> subroutines;
+    // Types fixed by the optimizer before it removed code, so that dropping
+    // an assignment cannot change how the remaining statements are typed.
+    std::span<TypeHint> typeHints;
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        generateBlock(statements, out, context);
     }
 };
 
 struct InputNode : ASTNode {
-    std::string variableName;
-    InputNode(const std::string& var) : variableName(var) {}
-
-    void generateCode(std::ostream& out) const override {
-        if (variables.find(variableName) == variables.end()) {
-            out << "\tstring " << variableName << ";" << std::endl;
-            variables.insert(variableName);
-            stringVars.insert(variableName);
-        }
-        out << "\tcin >> " << variableName << ";" << std::endl;
+    std::string_view variableName;
+    uint32_t symbol;
+    InputNode(std::string_view var, uint32_t sym) : variableName(var), symbol(sym) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        context.usesIo = true;
+        out << "\tpseudo::read(" << variableName << ");" << "\n";
     }
 };
 
 struct OutputNode : ASTNode {
-    std::string value;
+    std::string_view value;
     TokenType type;
-    OutputNode(const std::string& val, TokenType t) : value(val), type(t) {}
+    OutputNode(std::string_view val, TokenType t) : value(val), type(t) {}
 
-    void generateCode(std::ostream& out) const override {
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        context.usesIo = true;
         if (type == STRING) {
-            out << "\tcout << " << "\"" << value << "\"" << " << endl;" << std::endl;
+            out << "\tpseudo::print(\"" << value << "\");" << "\n";
         } else {
-            out << "\tcout << " << value << " << endl;" << std::endl;
+            out << "\tpseudo::print(" << value << ");" << "\n";
         }
     }
 };
 
 struct BinaryExpr : ExprNode {
-    std::string op;
+    std::string_view op;
     ExprNode* left;
     ExprNode* right;
-    BinaryExpr(const std::string& oper, ExprNode* l, ExprNode* r) : op(oper), left(l), right(r) {}
+    TypeCache operandsType;
+    BinaryExpr(std::string_view oper, ExprNode* l, ExprNode* r) : op(oper), left(l), right(r) {}
 
-    ~BinaryExpr() {
-        delete left;
-        delete right;
+    std::string toString() const override {
+        return "(" + left->toString() + " " + std::string(op) + " " + right->toString() + ")";
+    }
+    ValueType inferType(const CompilationContext& context) const override {
+        if (isComparisonOperator(op) || isLogicalOperator(op)) return ValueType::Bool;
+        ValueType type = operandsType.get(context, [&] {
+            ValueType l = left->inferType(context);
+            ValueType r = right->inferType(context);
+            if (op == "+" && (l == ValueType::String || r == ValueType::String)) return ValueType::String;
+            if (l == ValueType::Real || r == ValueType::Real) return ValueType::Real;
+            return l == ValueType::Long || r == ValueType::Long ? ValueType::Long : ValueType::Int;
+        });
+        return type == ValueType::Int && context.integerOps.count(this) ? ValueType::Long : type;
     }
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        ValueType operandType = inferType(context);
+        ValueType l = left->inferType(context);
+        ValueType r = right->inferType(context);
+        if (isComparisonOperator(op)) {
+            if (l == ValueType::String && r == ValueType::String) operandType = ValueType::String;
+            else if (l == ValueType::Real || r == ValueType::Real) operandType = ValueType::Real;
+            else if (l == ValueType::Long || r == ValueType::Long) operandType = ValueType::Long;
+            else operandType = ValueType::Int;
+        }
+        if (isLogicalOperator(op)) operandType = ValueType::Bool;
+        auto width = context.integerOps.find(this);
+        if (width != context.integerOps.end() && width->second == IntegerOp::Checked) {
+            context.usesIo = true;
+            out << checkedOperation(op) << "(";
+            generateAs(left, operandType, out, context);
+            out << ", ";
+            generateAs(right, operandType, out, context);
+            out << ", " << position.line << ")";
+            return;
+        }
+        // Two adjacent string literals would otherwise add two pointers, and
+        // two 32-bit operands would overflow before becoming 64-bit.
+        bool wrapLeft = operandType == ValueType::String && dynamic_cast<const LiteralExpr*>(left)
+                        && dynamic_cast<const LiteralExpr*>(right);
+        bool widenLeft = width != context.integerOps.end() && l != ValueType::Long && r != ValueType::Long;
+        out << "(";
+        if (wrapLeft) out << "string(";
+        if (widenLeft) out << "static_cast<long long>(";
+        generateAs(left, operandType, out, context);
+        if (wrapLeft || widenLeft) out << ")";
+        out << " " << cppOperator(op) << " ";
+        generateAs(right, operandType, out, context);
+        out << ")";
+    }
+};
+
+// Unary minus (op "-") or NOT.
+struct UnaryExpr : ExprNode {
+    std::string_view op;
+    ExprNode* operand;
+    TypeCache operandType;
+    UnaryExpr(std::string_view oper, ExprNode* e) : op(oper), operand(e) {}
 
     std::string toString() const override {
-        return "(" + left->toString() + " " + op + " " + right->toString() + ")";
-    }
-    void generateCode(std::ostream& out) const override {
-        bool isComparison = (op == "<" || op == ">" || op == "<=" || op == ">=" || op == "==" || op == "!=");
-        auto leftVar = dynamic_cast<VariableExpr*>(left);
-        auto rightVar = dynamic_cast<VariableExpr*>(right);
-        bool leftIsString = leftVar && stringVars.find(leftVar->name) != stringVars.end();
-        bool rightIsString = rightVar && stringVars.find(rightVar->name) != stringVars.end();
-
-        if (isComparison) {
-            out << "(";
-            if (leftIsString) {
-                out << "stoi(";
-                left->generateCode(out);
-                out << ")";
-            } else {
-                left->generateCode(out);
-            }
-            out << " " << op << " ";
-            if (rightIsString) {
-                out << "stoi(";
-                right->generateCode(out);
-                out << ")";
-            } else {
-                right->generateCode(out);
-            }
-            out << ")";
+        return "(" + std::string(op) + (op == "NOT" ? " " : "") + operand->toString() + ")";
+    }
+    ValueType inferType(const CompilationContext& context) const override {
+        if (op == "NOT") return ValueType::Bool;
+        ValueType type = operandType.get(context, [&] { return operand->inferType(context); });
+        if (type == ValueType::Real) return ValueType::Real;
+        return type == ValueType::Long || context.integerOps.count(this) ? ValueType::Long : ValueType::Int;
+    }
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        auto width = context.integerOps.find(this);
+        if (width != context.integerOps.end() && width->second == IntegerOp::Checked) {
+            context.usesIo = true;
+            out << "pseudo::checkedNeg(";
+            generateAs(operand, ValueType::Long, out, context);
+            out << ", " << position.line << ")";
             return;
-        } else if (op == "%" && (leftIsString || rightIsString)) {
-            out << "(";
-            if (leftIsString) {
-                out << "stoi(";
-                left->generateCode(out);
-                out << ")";
-            } else {
-                left->generateCode(out);
-            }
-            out << " % ";
-            if (rightIsString) {
-                out << "stoi(";
-                right->generateCode(out);
-                out << ")";
-            } else {
-                right->generateCode(out);
-            }
-            out << ")";
-        } else if (op == "+" && (leftIsString || rightIsString)) {
-            if (leftIsString && !rightIsString) {
-                left->generateCode(out);
-                out << " + to_string(";
-                right->generateCode(out);
-                out << ")";
-            } else if (!leftIsString && rightIsString) {
-                out << "to_string(";
-                left->generateCode(out);
-                out << ") + ";
-                right->generateCode(out);
-            } else {
-                left->generateCode(out);
-                out << " + ";
-                right->generateCode(out);
-            }
-        } else {
-            out << "(";
-            left->generateCode(out);
-            out << " " << op << " ";
-            right->generateCode(out);
-            out << ")";
         }
+        // The space keeps - -1 from reading as a decrement.
+        bool widen = width != context.integerOps.end() && operand->inferType(context) != ValueType::Long;
+        out << "(" << cppOperator(op) << " ";
+        if (widen) out << "static_cast<long long>(";
+        generateAs(operand, op == "NOT" ? ValueType::Bool : inferType(context), out, context);
+        if (widen) out << ")";
+        out << ")";
     }
 };
 
 struct AssignNode : ASTNode {
-    std::string variableName;
+    std::string_view variableName;
+    uint32_t symbol;
     ExprNode* expr;
-    std::string type;
-    AssignNode(const std::string& var, ExprNode* e, const std::string& t) : variableName(var), expr(e), type(t) {}
+    AssignNode(std::string_view var, uint32_t sym, ExprNode* e) : variableName(var), symbol(sym), expr(e) {}
 
-    ~AssignNode() { delete expr; }
-
-    void generateCode(std::ostream& out) const override {
-        if (variables.find(variableName) == variables.end()) {
-            out << "\t" << type << " " << variableName << " = ";
-            if (type == "STRING" || type == "string") {
-                stringVars.insert(variableName);
-            }
-            variables.insert(variableName);
-        } else {
-            out << "\t" << variableName << " = ";
-        }
-
-        bool isStringVar = (type == "STRING" || type == "string") || stringVars.find(variableName) != stringVars.end();
-        auto binExpr = dynamic_cast<BinaryExpr*>(expr);
-        auto leftVar = binExpr ? dynamic_cast<VariableExpr*>(binExpr->left) : nullptr;
-        auto rightLit = binExpr ? dynamic_cast<LiteralExpr*>(binExpr->right) : nullptr;
-
-        if (isStringVar && binExpr && leftVar && leftVar->name == variableName && rightLit && rightLit->type == NUMBER) {
-            out << "to_string(stoi(" << variableName << ") " << binExpr->op << " ";
-            binExpr->right->generateCode(out);
-            out << ")";
-        } else if (isStringVar && binExpr && binExpr->op != "+") {
-            out << "to_string(";
-            expr->generateCode(out);
-            out << ")";
-        } else {
-            expr->generateCode(out);
-        }
-        out << ";" << std::endl;
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        out << "\t" << variableName << " = ";
+        generateAs(expr, context.variables.typeOf(symbol), out, context);
+        out << ";" << "\n";
     }
 };
 
 struct IfNode : public ASTNode {
     ExprNode* condition;
-    std::vector<ASTNode*> thenBranch;
-    std::vector<ASTNode*> elseBranch;
-    IfNode(ExprNode* cond, const std::vector<ASTNode*>& thenB, const std::vector<ASTNode*>& elseB)
-            : condition(cond), thenBranch(std::move(thenB)), elseBranch(std::move(elseB)) {}
-
-    ~IfNode() {
-        delete condition;
-        for (auto stmt : thenBranch) delete stmt;
-        for (auto stmt : elseBranch) delete stmt;
-    }
+    NodeList thenBranch;
+    NodeList elseBranch;
+    IfNode(ExprNode* cond, NodeList thenB, NodeList elseB)
+            : condition(cond), thenBranch(thenB), elseBranch(elseB) {}
 
-    void generateCode(std::ostream& out) const override {
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
         out << "\tif (";
-        condition->generateCode(out);
+        condition->generateCode(out, context);
         out << ") {\n";
-        for (auto stmt : thenBranch) stmt->generateCode(out);
+        generateBlock(thenBranch, out, context);
         out << "\t}";
         if (!elseBranch.empty()) {
             out << " else {\n";
-            for (auto stmt : elseBranch) stmt->generateCode(out);
+            generateBlock(elseBranch, out, context);
             out << "\t}";
         }
         out << "\n";
@@ -236,97 +360,312 @@ struct IfNode : public ASTNode {
 
 struct WhileNode : ASTNode {
     ExprNode* condition;
-    std::vector<ASTNode*> body;
-    WhileNode(ExprNode* cond, const std::vector<ASTNode*>& b) : condition(cond), body(b) {}
+    NodeList body;
+    WhileNode(ExprNode* cond, NodeList b) : condition(cond), body(b) {}
 
-    ~WhileNode() {
-        delete condition;
-        for (auto stmt : body) delete stmt;
-    }
-
-    void generateCode(std::ostream& out) const override {
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
         out << "\twhile (";
-        condition->generateCode(out);
-        out << ") {" << std::endl;
-        for (auto stmt : body) stmt->generateCode(out);
-        out << "\t}" << std::endl;
+        condition->generateCode(out, context);
+        out << ") {" << "\n";
+        generateBlock(body, out, context);
+        emitLineProbe(position, out, context);
+        out << "\t}" << "\n";
     }
 };
 
+// The sign of a FOR step that is a number literal; 0 when the step is
+// only known at run time.
+inline int literalStepSign(TokenType type, std::string_view text) {
+    if (type != NUMBER) return 0;
+    return !text.empty() && text[0] == '-' ? -1 : 1;
+}
+
+// FOR in both AST layouts. The end and the step are evaluated once, before
+// the iterator is assigned, into constants of a block around a plain
+// counted loop. A literal end or step is used as it is; a step whose sign
+// is unknown picks the comparison on each test. The constants have the
+// iterator's C++ type.
+inline void emitCountedFor(std::ostream& out, std::string_view iterator, std::string_view type, const std::string& start,
+                           const std::string& end, bool endIsLiteral, const std::string& step, int stepSign,
+                           const std::function<void()>& body) {
+    std::string limit = endIsLiteral ? end : "pseudo_end_" + std::string(iterator);
+    std::string increment = stepSign ? step : "pseudo_step_" + std::string(iterator);
+    bool hoisted = !endIsLiteral || !stepSign;
+    if (hoisted) out << "\t{\n";
+    if (!endIsLiteral) out << "\tconst " << type << " " << limit << " = " << end << ";\n";
+    if (!stepSign) out << "\tconst " << type << " " << increment << " = " << step << ";\n";
+    out << "\tfor (" << iterator << " = " << start << "; ";
+    if (stepSign > 0) out << iterator << " <= " << limit;
+    else if (stepSign < 0) out << iterator << " >= " << limit;
+    else out << "(" << increment << " < 0 ? " << iterator << " >= " << limit << " : " << iterator << " <= " << limit << ")";
+    out << "; " << iterator << " += " << increment << ") {\n";
+    body();
+    out << "\t}\n";
+    if (hoisted) out << "\t}\n";
+}
+
 struct ForNode : ASTNode {
-    std::string iterator;
-    std::string startExpr;
-    std::string endExpr;
-    std::string stepExpr;
-    std::vector<ASTNode*> body;
-    ForNode(const std::string& it, const std::string& start, const std::string& end, const std::string& step, const std::vector<ASTNode*>& b)
-            : iterator(it), startExpr(start), endExpr(end), stepExpr(step), body(b) {}
-
-    ~ForNode() {
-        for (auto stmt : body) delete stmt;
-    }
-
-    void generateCode(std::ostream& out) const override {
-        out << "\tfor (int " << iterator << " = " << startExpr
-            << "; " << iterator << " <= ";
-        if (stringVars.find(endExpr) != stringVars.end()) {
-            out << "stoi(" << endExpr << ")";
-        } else {
-            out << endExpr;
-        }
-        out << "; " << iterator << " += " << stepExpr << ") {" << std::endl;
-        for (auto stmt : body) stmt->generateCode(out);
-        out << "\t}" << std::endl;
+    std::string_view iterator;
+    uint32_t symbol;
+    ExprNode* startExpr;
+    ExprNode* endExpr;
+    ExprNode* stepExpr;
+    NodeList body;
+    ForNode(std::string_view it, uint32_t sym, ExprNode* start, ExprNode* end, ExprNode* step, NodeList b)
+            : iterator(it), symbol(sym), startExpr(start), endExpr(end), stepExpr(step), body(b) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        ValueType type = context.variables.typeOf(symbol);
+        auto generated = [&](const ExprNode* expr) {
+            std::ostringstream text;
+            generateAs(expr, type, text, context);
+            return text.str();
+        };
+        auto end = dynamic_cast<const LiteralExpr*>(endExpr);
+        auto step = dynamic_cast<const LiteralExpr*>(stepExpr);
+        emitCountedFor(out, iterator, cppTypeName(type), generated(startExpr), generated(endExpr), end && end->type == NUMBER,
+                       generated(stepExpr), step ? literalStepSign(step->type, step->value) : 0, [&] {
+            generateBlock(body, out, context);
+            emitLineProbe(position, out, context);
+        });
     }
 };
 
 struct RepeatUntilNode : ASTNode {
     ExprNode* condition;
-    std::vector<ASTNode*> body;
-    RepeatUntilNode(ExprNode* cond, const std::vector<ASTNode*>& b) : condition(cond), body(b) {}
-
-    ~RepeatUntilNode() {
-        delete condition;
-        for (auto stmt : body) delete stmt;
+    NodeList body;
+    RepeatUntilNode(ExprNode* cond, NodeList b) : condition(cond), body(b) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        out << "\tdo {" << "\n";
+        generateBlock(body, out, context);
+        emitLineProbe(position, out, context);
+        out << "\t} while (!";
+        condition->generateCode(out, context);
+        out << ");" << "\n";
     }
+};
 
-    void generateCode(std::ostream& out) const override {
-        out << "\tdo {" << std::endl;
-        for (auto stmt : body) stmt->generateCode(out);
-        out << "} while (!(" << condition->toString() << "));" << std::endl;
+// The hidden variables that hold an array's bounds once its DECLARE has run.
+inline std::string arrayBoundName(std::string_view array, size_t dimension, bool upper) {
+    return "pseudo_" + std::string(array) + (upper ? "_upper" : "_lower") + std::to_string(dimension);
+}
+
+// An array element in row-major order, given its indices as C++ text.
+// Checked indices go through pseudo::index, which ends the program when one
+// is out of range; unchecked ones are plain arithmetic the C++ compiler can
+// vectorize.
+inline void emitElement(std::ostream& out, std::string_view array, const std::vector<std::string>& indices,
+                        bool checked) {
+    std::string offset;
+    for (size_t d = 0; d < indices.size(); d++) {
+        std::string lower = arrayBoundName(array, d, false), upper = arrayBoundName(array, d, true);
+        std::string index = checked ? "pseudo::index(" + indices[d] + ", " + lower + ", " + upper + ", \"" +
+                                      std::string(array) + "\")"
+                                    : indices[d] + " - " + lower;
+        offset = d == 0 ? index : "(" + offset + ") * (" + upper + " - " + lower + " + 1) + " + index;
     }
-};
+    out << array << "[" << offset << "]";
+}
+
+// DECLARE in both AST layouts: fixes the bounds, given as C++ text in
+// lower, upper order per dimension, and allocates fresh elements.
+inline void emitArrayDeclaration(std::ostream& out, std::string_view array, const std::vector<std::string>& bounds) {
+    size_t rank = bounds.size() / 2;
+    for (size_t d = 0; d < rank; d++) {
+        out << "\t" << arrayBoundName(array, d, false) << " = " << bounds[2 * d] << ";\n";
+        out << "\t" << arrayBoundName(array, d, true) << " = " << bounds[2 * d + 1] << ";\n";
+    }
+    out << "\t" << array << ".allocate(";
+    for (size_t d = 0; d < rank; d++) {
+        out << (d ? " * " : "") << "pseudo::extent(" << arrayBoundName(array, d, false) << ", "
+            << arrayBoundName(array, d, true) << ", \"" << array << "\")";
+    }
+    out << ");\n";
+}
 
 struct IndexExpr : ExprNode {
     ExprNode* base;
-    ExprNode* index;
-    IndexExpr(ExprNode* b, ExprNode* i) : base(b), index(i) {}
-    ~IndexExpr() { delete base; delete index; }
+    std::span<ExprNode*> indices;
+    // Cleared by elideBoundsChecks where every index is known to be in range.
+    bool checked = true;
+    IndexExpr(ExprNode* b, std::span<ExprNode*> i) : base(b), indices(i) {}
+
+    // The array base names, or null when this picks a character of a string.
+    const ArrayInfo* array(const CompilationContext& context) const {
+        auto var = dynamic_cast<const VariableExpr*>(base);
+        if (!var) return nullptr;
+        auto it = context.arrays.find(var->symbol);
+        return it == context.arrays.end() ? nullptr : &it->second;
+    }
+
     std::string toString() const override {
-        return base->toString() + "[" + index->toString() + "]";
+        std::string text = base->toString() + "[";
+        for (size_t i = 0; i < indices.size(); i++) text += (i ? ", " : "") + indices[i]->toString();
+        return text + "]";
     }
-    void generateCode(std::ostream& out) const override {
-        base->generateCode(out);
-        out << "[";
-        auto varExpr = dynamic_cast<VariableExpr*>(index);
-        if (varExpr && stringVars.find(varExpr->name) != stringVars.end()) {
-            out << "stoi(";
-            index->generateCode(out);
-            out << ")";
-        } else {
-            index->generateCode(out);
+    ValueType inferType(const CompilationContext& context) const override {
+        if (const ArrayInfo* info = array(context)) return info->element;
+        return base->inferType(context) == ValueType::String ? ValueType::String : ValueType::Unknown;
+    }
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        if (array(context)) {
+            std::vector<std::string> text;
+            for (auto index : indices) {
+                std::ostringstream generated;
+                generateAs(index, ValueType::Int, generated, context);
+                text.push_back(generated.str());
+            }
+            emitElement(out, static_cast<const VariableExpr*>(base)->name, text, checked);
+            return;
         }
+        bool isString = base->inferType(context) == ValueType::String;
+        if (isString) out << "string(1, ";
+        base->generateCode(out, context);
+        out << "[";
+        generateAs(indices[0], ValueType::Int, out, context);
         out << "]";
+        if (isString) out << ")";
+    }
+};
+
+// One dimension of a DECLAREd array: its lowest and highest index.
+struct ArrayBound {
+    ExprNode* lower;
+    ExprNode* upper;
+};
+
+struct DeclareNode : ASTNode {
+    std::string_view name;
+    uint32_t symbol;
+    ValueType elementType;
+    std::span<ArrayBound> bounds;
+    DeclareNode(std::string_view n, uint32_t sym, ValueType element, std::span<ArrayBound> b)
+            : name(n), symbol(sym), elementType(element), bounds(b) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        // pseudo::Array lives in the same runtime as the I/O routines.
+        context.usesIo = true;
+        std::vector<std::string> text;
+        for (const auto& bound : bounds) {
+            for (auto expr : {bound.lower, bound.upper}) {
+                std::ostringstream generated;
+                generateAs(expr, ValueType::Int, generated, context);
+                text.push_back(generated.str());
+            }
+        }
+        emitArrayDeclaration(out, name, text);
+    }
+};
+
+struct ElementAssignNode : ASTNode {
+    IndexExpr* target;
+    ExprNode* expr;
+    ElementAssignNode(IndexExpr* t, ExprNode* e) : target(t), expr(e) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        out << "\t";
+        target->generateCode(out, context);
+        out << " = ";
+        generateAs(expr, target->inferType(context), out, context);
+        out << ";\n";
     }
 };
 
 struct OutputExprNode : ASTNode {
     ExprNode* expr;
     OutputExprNode(ExprNode* e) : expr(e) {}
-    ~OutputExprNode() { delete expr; }
-    void generateCode(std::ostream& out) const override {
-        out << "\tcout << ";
-        expr->generateCode(out);
-        out << " << endl;" << std::endl;
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        context.usesIo = true;
+        out << "\tpseudo::print(";
+        expr->generateCode(out, context);
+        out << ");" << "\n";
+    }
+};
+
+// A parameter of a PROCEDURE or FUNCTION, passed by value.
+struct Parameter {
+    std::string_view name;
+    uint32_t symbol;
+    ValueType type;
+};
+
+// A PROCEDURE, or a FUNCTION when it has a result type. Not a statement:
+// each becomes a C++ function of its own, defined ahead of main().
+struct SubroutineNode {
+    std::string_view name;
+    uint32_t symbol;
+    std::span<Parameter> parameters;
+    ValueType result = ValueType::Unknown;
+    NodeList body;
+    // As ProgramNode::typeHints, for the variables of the body.
+    std::span<TypeHint> typeHints;
+
+    bool isFunction() const { return result != ValueType::Unknown; }
+    const char* kind() const { return isFunction() ? "FUNCTION" : "PROCEDURE"; }
+};
+
+// The C++ name of a subroutine, which cannot collide with a variable.
+inline std::string subroutineName(std::string_view name) {
+    return "pseudo_fn_" + std::string(name);
+}
+
+struct CallExpr : ExprNode {
+    std::string_view name;
+    uint32_t symbol;
+    std::span<ExprNode*> arguments;
+    CallExpr(std::string_view n, uint32_t sym, std::span<ExprNode*> args) : name(n), symbol(sym), arguments(args) {}
+
+    // Null until inferTypes has seen the definition.
+    const SubroutineNode* callee(const CompilationContext& context) const {
+        auto it = context.subroutines.find(symbol);
+        return it == context.subroutines.end() ? nullptr : it->second.node;
+    }
+
+    std::string toString() const override {
+        std::string text = std::string(name) + "(";
+        for (size_t i = 0; i < arguments.size(); i++) text += (i ? ", " : "") + arguments[i]->toString();
+        return text + ")";
+    }
+    ValueType inferType(const CompilationContext& context) const override {
+        const SubroutineNode* target = callee(context);
+        return target ? target->result : ValueType::Unknown;
     }
-};
\ No newline at end of file
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        const SubroutineNode* target = callee(context);
+        out << subroutineName(name) << "(";
+        for (size_t i = 0; i < arguments.size(); i++) {
+            if (i) out << ", ";
+            generateAs(arguments[i], target->parameters[i].type, out, context);
+        }
+        out << ")";
+    }
+};
+
+struct CallNode : ASTNode {
+    CallExpr* call;
+    CallNode(CallExpr* c) : call(c) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        out << "\t";
+        call->generateCode(out, context);
+        out << ";\n";
+    }
+};
+
+// RETURN, with a value converted to type inside a FUNCTION and without one
+// inside a PROCEDURE.
+struct ReturnNode : ASTNode {
+    ExprNode* value;
+    ValueType type;
+    ReturnNode(ExprNode* v, ValueType t) : value(v), type(t) {}
+
+    void generateCode(std::ostream& out, CompilationContext& context) const override {
+        out << "\treturn";
+        if (value) {
+            out << " ";
+            generateAs(value, type, out, context);
+        }
+        out << ";\n";
+    }
+};
@@ -0,0 +1,189 @@
+#include "batch.hpp"
+#include "parallel.hpp"
+#include "source.hpp"
+#include "toolchain.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Unity members are selected by name on the command line, so names are
+// limited to characters that need no quoting and made unique.
+std::string memberName(const fs::path& input, std::set<std::string>& taken) {
+    std::string name = input.stem().string();
+    for (char& c : name)
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') c = '_';
+    if (name.empty()) name = "program";
+    std::string unique = name;
+    for (int i = 2; !taken.insert(unique).second; i++) unique = name + "_" + std::to_string(i);
+    return unique;
+}
+
+class BatchCompiler {
+    const BatchOptions& options;
+    std::mutex cacheMutex;
+
+public:
+    explicit BatchCompiler(const BatchOptions& options) : options(options) {}
+
+    BatchReport run(const std::vector<std::string>& inputs) {
+        auto start = Clock::now();
+        BatchReport report;
+        report.items.resize(inputs.size());
+        std::set<std::string> names;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            BatchItem& item = report.items[i];
+            item.input = inputs[i];
+            item.name = memberName(inputs[i], names);
+            item.cppPath = fs::path(inputs[i]).replace_extension(".cpp");
+            item.exePath = fs::path(inputs[i]).replace_extension(".exe");
+        }
+
+        if (options.unityOutput.empty()) {
+            parallelFor(inputs.size(), options.jobs, [&](size_t i) { buildSeparately(report.items[i]); });
+        } else {
+            std::vector<GeneratedProgram> programs(inputs.size());
+            parallelFor(inputs.size(), options.jobs, [&](size_t i) { generate(report.items[i], &programs[i]); });
+            buildUnity(report, programs);
+        }
+        report.wallMs = elapsedMs(start);
+        return report;
+    }
+
+private:
+    // Generates the standalone translation unit into cpp; returns the source
+    // text for the cache key, or an empty string on failure.
+    std::string generate(BatchItem& item, GeneratedProgram* program, std::string* cpp = nullptr) {
+        auto start = Clock::now();
+        std::string code;
+        try {
+            SourceFile source(item.input);
+            code = source.text();
+            CompileResult result = compile(source.text(), options.compile);
+            if (!result.ok) {
+                item.error = result.error;
+                code.clear();
+            } else {
+                if (options.emitCpp) {
+                    std::ofstream out(item.cppPath, std::ios::binary);
+                    out << result.cpp;
+                    if (!out) throw std::runtime_error("Could not write " + item.cppPath.string());
+                }
+                if (program) *program = std::move(result.program);
+                if (cpp) *cpp = std::move(result.cpp);
+                item.ok = true;
+            }
+        } catch (const std::exception& e) {
+            item.error = e.what();
+            item.ok = false;
+            code.clear();
+        }
+        item.frontendMs = elapsedMs(start);
+        return code;
+    }
+
+    void buildSeparately(BatchItem& item) {
+        std::string key;
+        if (options.cache) {
+            try {
+                SourceFile source(item.input);
+                key = CompileCache::makeKey(source.text(), options.compilerVersion, options.flags + options.cacheFlags);
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                if (options.cache->lookup(key, item.exePath)) {
+                    item.ok = item.cached = true;
+                    return;
+                }
+            } catch (const std::exception&) {
+                key.clear();
+            }
+        }
+
+        std::string cpp;
+        if (generate(item, nullptr, &cpp).empty()) return;
+
+        auto start = Clock::now();
+        int result = compileSource(options.compiler, options.flags, cpp, item.exePath.string());
+        item.buildMs = elapsedMs(start);
+        if (result != 0) {
+            item.ok = false;
+            item.error = "C++ code compilation failed";
+            return;
+        }
+        if (options.cache && !key.empty()) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            options.cache->store(key, item.exePath);
+        }
+    }
+
+    void buildUnity(BatchReport& report, const std::vector<GeneratedProgram>& programs) {
+        std::vector<UnityMember> members;
+        for (size_t i = 0; i < report.items.size(); i++)
+            if (report.items[i].ok) members.push_back({report.items[i].name, &programs[i]});
+        if (members.empty()) return;
+
+        fs::path cppPath = options.unityOutput + ".cpp";
+        fs::path exePath = options.unityOutput + ".exe";
+        std::ostringstream unit;
+        emitUnityTranslationUnit(members, unit, options.compile.codegen);
+        if (options.emitCpp) std::ofstream(cppPath, std::ios::binary) << unit.str();
+        auto start = Clock::now();
+        report.unityOk = compileSource(options.compiler, options.flags, unit.str(), exePath.string()) == 0;
+        report.unityBuildMs = elapsedMs(start);
+        for (auto& item : report.items) {
+            if (!item.ok) continue;
+            item.exePath = exePath;
+            if (!report.unityOk) {
+                item.ok = false;
+                item.error = "unity build failed";
+            }
+        }
+    }
+};
+
+}
+
+BatchReport compileBatch(const std::vector<std::string>& inputs, const BatchOptions& options) {
+    return BatchCompiler(options).run(inputs);
+}
+
+void printBatchSummary(const BatchReport& report, const BatchOptions& options, std::ostream& out) {
+    size_t succeeded = 0, cached = 0;
+    double frontendTotal = 0, buildTotal = 0;
+    out << std::fixed << std::setprecision(1);
+    out << std::setw(12) << "frontend ms" << std::setw(12) << "g++ ms" << "  status  file\n";
+    for (const auto& item : report.items) {
+        out << std::setw(12) << item.frontendMs;
+        if (item.cached) out << std::setw(12) << "cached";
+        else if (options.unityOutput.empty()) out << std::setw(12) << item.buildMs;
+        else out << std::setw(12) << "-";
+        out << "  " << (item.ok ? "ok    " : "FAILED") << "  " << item.input;
+        if (item.ok) out << " -> " << item.exePath.string();
+        if (item.ok && !options.unityOutput.empty()) out << " " << item.name;
+        if (!item.ok) out << ": " << item.error;
+        out << "\n";
+        succeeded += item.ok;
+        cached += item.cached;
+        frontendTotal += item.frontendMs;
+        buildTotal += item.buildMs;
+    }
+    if (!options.unityOutput.empty()) {
+        out << "unity build " << options.unityOutput << ".exe: " << (report.unityOk ? "ok" : "FAILED") << " in "
+            << report.unityBuildMs << " ms\n";
+        buildTotal = report.unityBuildMs;
+    }
+    out << report.items.size() << " files, " << succeeded << " ok (" << cached << " cached), "
+        << report.items.size() - succeeded << " failed; " << options.jobs << " jobs, wall " << report.wallMs
+        << " ms, frontend " << frontendTotal << " ms, g++ " << buildTotal << " ms total\n";
+}
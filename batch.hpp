@@ -0,0 +1,50 @@
+#pragma once
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compile_cache.hpp"
+#include "compiler.hpp"
+
+struct BatchOptions {
+    unsigned jobs = 1;
+    std::string compiler = "g++";
+    std::string flags;
+    CompileOptions compile;
+    // Optional; entries are keyed like single-file builds plus cacheFlags.
+    CompileCache* cache = nullptr;
+    std::string compilerVersion;
+    std::string cacheFlags;
+    // When set, all programs are linked into <unityOutput>.exe instead of
+    // one executable per input.
+    std::string unityOutput;
+    // Also write each input's .cpp (and the unity .cpp) to disk; the
+    // compiler reads the code from a pipe either way.
+    bool emitCpp = false;
+};
+
+struct BatchItem {
+    std::string input;
+    std::string name;
+    std::filesystem::path cppPath;
+    std::filesystem::path exePath;
+    bool ok = false;
+    bool cached = false;
+    std::string error;
+    double frontendMs = 0;
+    double buildMs = 0;
+};
+
+struct BatchReport {
+    std::vector<BatchItem> items;
+    double wallMs = 0;
+    bool unityOk = false;
+    double unityBuildMs = 0;
+};
+
+// Generates C++ for every input on a pool of options.jobs threads and runs
+// at most options.jobs compiler processes at a time. Each input gets its own
+// .exe (and .cpp with emitCpp) next to it, so batches never share output
+// paths.
+BatchReport compileBatch(const std::vector<std::string>& inputs, const BatchOptions& options);
+void printBatchSummary(const BatchReport& report, const BatchOptions& options, std::ostream& out);
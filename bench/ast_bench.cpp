@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../codegen.hpp"
+#include "../flat_ast.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::string generateSource(size_t statements) {
+    std::mt19937 rng(11);
+    std::string source = "INPUT name\nINPUT n\ntotal <- 0\n";
+    for (size_t i = 0; i < statements; i++) {
+        std::string v = std::to_string(rng() % 64);
+        switch (rng() % 5) {
+            case 0: source += "x" + v + " <- x" + v + " + " + std::to_string(rng() % 1000) + " * total - 3 % 7\n"; break;
+            case 1: source += "IF x" + v + " >= n THEN\n    OUTPUT \"big \" + name\nELSE\n    total <- total + x" + v + "\nENDIF\n"; break;
+            case 2: source += "WHILE total <> n\n    total <- total - 1\nENDWHILE\n"; break;
+            case 3: source += "FOR i <- 1 TO n\n    OUTPUT name[i] + \"!\"\nNEXT\n"; break;
+            default: source += "REPEAT\n    x" + v + " <- x" + v + " / 2\nUNTIL x" + v + " < 10\n"; break;
+        }
+    }
+    return source;
+}
+
+int main(int argc, char* argv[]) {
+    size_t statements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    try {
+        std::string code = generateSource(statements);
+        CompilationContext context;
+        Lexer lexer(code, context.symbols);
+        Parser parser(lexer, context);
+        ProgramNode* ast = parser.parseProgram();
+        size_t treeBytes = context.arena.bytesUsed();
+
+        auto start = Clock::now();
+        FlatAst flat = flattenProgram(ast, context);
+        double flattenMs = elapsedMs(start);
+        size_t flatBytes = flat.nodes.size() * sizeof(FlatNode) + flat.lists.size() * sizeof(uint32_t)
+                           + flat.literals.size() * sizeof(FlatLiteral);
+
+        std::string treeOutput, flatOutput;
+        double treeMs = 0, flatMs = 0;
+        for (int i = 0; i < iterations; i++) {
+            std::ostringstream treeOut, flatOut;
+            start = Clock::now();
+            generateProgram(ast, context, treeOut);
+            treeMs += elapsedMs(start);
+
+            start = Clock::now();
+            generateFlatProgram(flat, context, flatOut);
+            flatMs += elapsedMs(start);
+
+            treeOutput = treeOut.str();
+            flatOutput = flatOut.str();
+        }
+
+        if (treeOutput != flatOutput) {
+            std::cerr << "Error: flat AST codegen differs from tree codegen" << std::endl;
+            return 1;
+        }
+
+        double mb = treeOutput.size() / (1024.0 * 1024.0);
+        std::cout << statements << " statements, " << flat.nodes.size() << " nodes, " << mb << " MB of C++\n";
+        std::cout << "tree layout:  " << treeBytes / 1024 << " KiB arena, codegen " << treeMs / iterations
+                  << " ms (" << mb * iterations / (treeMs / 1000) << " MB/s)\n";
+        std::cout << "flat layout:  " << flatBytes / 1024 << " KiB arrays, codegen " << flatMs / iterations
+                  << " ms (" << mb * iterations / (flatMs / 1000) << " MB/s), flatten " << flattenMs << " ms\n";
+        std::cout << "speedup:      " << treeMs / flatMs << "x\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
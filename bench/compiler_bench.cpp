@@ -0,0 +1,326 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <sys/resource.h>
+#include "../codegen.hpp"
+#include "../compiler.hpp"
+#include "../flat_ast.hpp"
+#include "../lexer.hpp"
+#include "../native.hpp"
+#include "../parser.hpp"
+#include "../toolchain.hpp"
+
+// Measures every compiler phase on a seeded synthetic program, then the
+// end-to-end build and run time of the executables both backends produce.
+// Same seed and sizes give the same program, so runs are comparable
+// across commits.
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<uint64_t> allocationBytes{0};
+
+// Every replaced new takes its memory from malloc and every replaced
+// delete gives it back with free, so each form pairs with its own.
+static void* countedAllocation(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return countedAllocation(size); }
+void* operator new[](std::size_t size) { return countedAllocation(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static long peakRssKb(int who = RUSAGE_SELF) {
+    rusage usage{};
+    getrusage(who, &usage);
+    return usage.ru_maxrss;
+}
+
+struct WorkloadOptions {
+    uint32_t seed = 1;
+    size_t blocks = 2000;
+    size_t variables = 32;
+    size_t nesting = 6;
+    size_t chain = 12;
+    size_t loopIterations = 1000;
+};
+
+// Blocks are chosen at random among long expression chains, IF nests of
+// the configured depth and FOR/WHILE/REPEAT loops. Values are reduced
+// modulo 1000 after every chain so nothing overflows; the loop bound is
+// read from input so the run time can be scaled without regenerating.
+class WorkloadGenerator {
+    const WorkloadOptions& options;
+    std::mt19937 rng;
+    std::string out;
+    size_t loopDepth = 0;
+
+public:
+    explicit WorkloadGenerator(const WorkloadOptions& options) : options(options), rng(options.seed) {}
+
+    std::string generate() {
+        out = "INPUT limit\nname <- \"bench\"\n";
+        for (size_t i = 0; i < options.variables; i++) out += var(i) + " <- " + std::to_string(i * 7 % 1000) + "\n";
+        for (size_t i = 0; i < options.blocks; i++) block(0);
+        for (size_t i = 0; i < options.variables; i++) out += "OUTPUT " + var(i) + "\n";
+        out += "OUTPUT name + \" done\"\n";
+        return out;
+    }
+
+private:
+    std::string var(size_t i) const { return "v" + std::to_string(i); }
+    std::string anyVar() { return var(rng() % options.variables); }
+    std::string indent(size_t depth) const { return std::string(depth * 4, ' '); }
+
+    void chainAssignment(size_t depth) {
+        std::string target = anyVar();
+        std::string line = indent(depth) + target + " <- " + anyVar();
+        for (size_t i = 1; i < options.chain; i++) {
+            switch (rng() % 4) {
+                case 0: line += " + " + anyVar() + " * " + anyVar(); break;
+                case 1: line += " - " + anyVar() + " / 7"; break;
+                case 2: line += " + " + std::to_string(rng() % 100); break;
+                default: line += " - " + anyVar() + " % 13"; break;
+            }
+        }
+        out += line + "\n" + indent(depth) + target + " <- " + target + " % 1000\n";
+    }
+
+    void ifNest(size_t depth, size_t remaining) {
+        out += indent(depth) + "IF " + anyVar() + " < " + anyVar() + " THEN\n";
+        if (remaining > 1) ifNest(depth + 1, remaining - 1);
+        else chainAssignment(depth + 1);
+        out += indent(depth) + "ELSE\n";
+        chainAssignment(depth + 1);
+        out += indent(depth) + "ENDIF\n";
+    }
+
+    void loop(size_t depth) {
+        std::string counter = "i" + std::to_string(loopDepth);
+        loopDepth++;
+        switch (rng() % 3) {
+            case 0:
+                out += indent(depth) + "FOR " + counter + " <- 1 TO limit\n";
+                chainAssignment(depth + 1);
+                block(depth + 1);
+                out += indent(depth) + "NEXT\n";
+                break;
+            case 1:
+                out += indent(depth) + counter + " <- 0\n" + indent(depth) + "WHILE " + counter + " < limit\n";
+                chainAssignment(depth + 1);
+                out += indent(depth + 1) + counter + " <- " + counter + " + 1\n" + indent(depth) + "ENDWHILE\n";
+                break;
+            default:
+                out += indent(depth) + counter + " <- 0\n" + indent(depth) + "REPEAT\n";
+                chainAssignment(depth + 1);
+                out += indent(depth + 1) + counter + " <- " + counter + " + 1\n";
+                out += indent(depth) + "UNTIL " + counter + " >= limit\n";
+                break;
+        }
+        loopDepth--;
+    }
+
+    // Loops are never nested, so the run time stays linear in the loop bound.
+    void block(size_t depth) {
+        switch (rng() % 5) {
+            case 0: case 1: chainAssignment(depth); break;
+            case 2: ifNest(depth, options.nesting); break;
+            case 3:
+                if (loopDepth == 0 && rng() % 4 == 0) loop(depth);
+                else chainAssignment(depth);
+                break;
+            default:
+                out += indent(depth) + "name <- name + \"-\"\n" + indent(depth) + "OUTPUT name[0] + " + anyVar() + "\n";
+                break;
+        }
+    }
+};
+
+struct PhaseResult {
+    double bestMs = 1e300;
+    double totalMs = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+// Runs body iterations times from a clean state and keeps the best time and
+// the allocations of one run.
+template <typename Body>
+static PhaseResult measure(int iterations, Body body) {
+    PhaseResult result;
+    for (int i = 0; i < iterations; i++) {
+        uint64_t count = allocationCount, bytes = allocationBytes;
+        auto start = Clock::now();
+        body();
+        double ms = elapsedMs(start);
+        result.bestMs = std::min(result.bestMs, ms);
+        result.totalMs += ms;
+        result.allocations = allocationCount - count;
+        result.allocatedBytes = allocationBytes - bytes;
+    }
+    return result;
+}
+
+static void report(const char* phase, const PhaseResult& result, double megabytes, const char* unit, int iterations) {
+    std::cout << std::left << std::setw(22) << phase << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << result.bestMs << " ms best" << std::setw(10) << result.totalMs / iterations
+              << " ms avg" << std::setw(10) << megabytes / (result.bestMs / 1000) << " MB/s " << unit
+              << std::setw(10) << result.allocations << " allocs" << std::setw(10)
+              << result.allocatedBytes / 1024 << " KiB" << std::setw(10) << peakRssKb() / 1024 << " MiB peak RSS\n";
+}
+
+static double runExecutable(const fs::path& exe, const fs::path& input, const fs::path& output) {
+    std::string command = "\"" + exe.string() + "\" < \"" + input.string() + "\" > \"" + output.string() + "\"";
+    auto start = Clock::now();
+    if (system(command.c_str()) != 0) std::cerr << "Warning: " << exe.string() << " failed" << std::endl;
+    return elapsedMs(start);
+}
+
+static std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+int main(int argc, char* argv[]) {
+    WorkloadOptions workload;
+    int iterations = 5;
+    bool build = true;
+    std::string emitPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&] { return i + 1 < argc ? std::strtoull(argv[++i], nullptr, 10) : 0; };
+        if (arg == "--seed") workload.seed = static_cast<uint32_t>(value());
+        else if (arg == "--blocks") workload.blocks = value();
+        else if (arg == "--variables") workload.variables = std::max<size_t>(1, value());
+        else if (arg == "--nesting") workload.nesting = std::max<size_t>(1, value());
+        else if (arg == "--chain") workload.chain = std::max<size_t>(1, value());
+        else if (arg == "--loop") workload.loopIterations = value();
+        else if (arg == "--iterations") iterations = std::max(1, static_cast<int>(value()));
+        else if (arg == "--no-build") build = false;
+        else if (arg == "--emit" && i + 1 < argc) emitPath = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--seed n] [--blocks n] [--variables n] [--nesting n] [--chain n]"
+                      << " [--loop n] [--iterations n] [--no-build] [--emit <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        std::string code = WorkloadGenerator(workload).generate();
+        if (!emitPath.empty()) std::ofstream(emitPath, std::ios::binary) << code;
+        double sourceMb = code.size() / (1024.0 * 1024.0);
+
+        size_t tokens = 0;
+        PhaseResult tokenize = measure(iterations, [&] {
+            CompilationContext context;
+            Lexer lexer(code, context.symbols);
+            tokens = 0;
+            while (lexer.next().type != END) tokens++;
+        });
+
+        // The parser pulls tokens on demand, so this includes lexing.
+        size_t arenaBytes = 0;
+        PhaseResult parse = measure(iterations, [&] {
+            CompilationContext context;
+            Lexer lexer(code, context.symbols);
+            Parser parser(lexer, context);
+            parser.parseProgram();
+            arenaBytes = context.arena.bytesUsed();
+        });
+
+        CompilationContext context;
+        Lexer lexer(code, context.symbols);
+        Parser parser(lexer, context);
+        ProgramNode* program = parser.parseProgram();
+        size_t nodes = flattenProgram(program, context).nodes.size();
+
+        std::string cpp;
+        PhaseResult codegen = measure(iterations, [&] {
+            std::ostringstream out;
+            generateProgram(program, context, out);
+            cpp = out.str();
+        });
+
+        size_t machineCode = 0;
+        PhaseResult native = measure(iterations, [&] { machineCode = generateNative(program, context).code.size(); });
+
+        OptimizationStats stats;
+        PhaseResult optimize = measure(1, [&] {
+            CompilationContext fresh;
+            Lexer freshLexer(code, fresh.symbols);
+            Parser freshParser(freshLexer, fresh);
+            stats = optimizeProgram(freshParser.parseProgram(), fresh);
+        });
+
+        std::cout << "workload: seed " << workload.seed << ", " << workload.blocks << " blocks, "
+                  << workload.variables << " variables, nesting " << workload.nesting << ", chain "
+                  << workload.chain << ", loop " << workload.loopIterations << "\n";
+        std::cout << std::fixed << std::setprecision(2) << sourceMb << " MB source, " << tokens << " tokens, "
+                  << nodes << " nodes, " << arenaBytes / 1024 << " KiB arena, " << cpp.size() / 1024
+                  << " KiB C++, " << machineCode / 1024 << " KiB machine code\n";
+        report("tokenize", tokenize, sourceMb, "in ", iterations);
+        report("parse (incl. lexing)", parse, sourceMb, "in ", iterations);
+        report("codegen C++", codegen, cpp.size() / (1024.0 * 1024.0), "out", iterations);
+        report("codegen native", native, machineCode / (1024.0 * 1024.0), "out", iterations);
+        report("parse + optimize", optimize, sourceMb, "in ", 1);
+        std::cout << "optimizer: " << stats.folded << " folded, " << stats.propagated << " propagated, "
+                  << stats.removed << " removed\n";
+
+        if (!build) return 0;
+
+        fs::path work = fs::temp_directory_path() / "pseudocode_compiler_bench";
+        fs::create_directories(work);
+        fs::path input = work / "input.txt";
+        std::ofstream(input) << workload.loopIterations << "\n";
+
+        auto start = Clock::now();
+        CompileResult compiled = compile(code);
+        if (!compiled.ok) throw std::runtime_error(compiled.error);
+        std::ofstream(work / "program.cpp", std::ios::binary) << compiled.cpp;
+        double frontendMs = elapsedMs(start);
+        start = Clock::now();
+        if (invokeCompiler("g++", profileFlags(OptimizationProfile::Default), (work / "program.cpp").string(),
+                           (work / "program.exe").string()) != 0)
+            throw std::runtime_error("C++ code compilation failed");
+        double gxxMs = elapsedMs(start);
+
+        start = Clock::now();
+        CompileResult elf = compileNative(code, work / "program.elf");
+        if (!elf.ok) throw std::runtime_error(elf.error);
+        double elfMs = elapsedMs(start);
+
+        double cppRunMs = runExecutable(work / "program.exe", input, work / "cpp.out");
+        double elfRunMs = runExecutable(work / "program.elf", input, work / "elf.out");
+        bool same = readFile(work / "cpp.out") == readFile(work / "elf.out");
+
+        std::cout << "end to end (C++):      frontend " << frontendMs << " ms + g++ " << gxxMs << " ms, run "
+                  << cppRunMs << " ms\n";
+        std::cout << "end to end (native):   build " << elfMs << " ms, run " << elfRunMs << " ms, output "
+                  << (same ? "identical" : "DIFFERS") << "\n";
+        std::cout << "children peak RSS:     " << peakRssKb(RUSAGE_CHILDREN) / 1024 << " MiB\n";
+        return same ? 0 : 2;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../codegen.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// The same program as emitted before the buffered runtime: synced iostreams
+// and an endl flush per OUTPUT.
+static const char* iostreamBaseline =
+    "#include <iostream>\n"
+    "using namespace std;\n"
+    "int main() {\n"
+    "\tint i = 0;\n\tint n = 0;\n\tint x = 0;\n"
+    "\tcin >> n;\n"
+    "\tfor (i = 1; i <= n; i += 1) {\n"
+    "\tcin >> x;\n"
+    "\tcout << (x * 2) << endl;\n"
+    "\t}\n"
+    "}\n";
+
+static const char* echoProgram =
+    "INPUT n\n"
+    "FOR i <- 1 TO n\n"
+    "    INPUT x\n"
+    "    OUTPUT x * 2\n"
+    "NEXT\n";
+
+static double timeRun(const std::string& exe, const std::string& input) {
+    auto start = Clock::now();
+    std::string command = "./" + exe + " < " + input + " > /dev/null";
+    if (system(command.c_str()) != 0) throw std::runtime_error(exe + " failed");
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    long long count = argc > 1 ? std::atoll(argv[1]) : 1000000;
+
+    try {
+        {
+            std::ofstream input("io_bench_input.txt");
+            std::mt19937 rng(42);
+            input << count << "\n";
+            for (long long i = 0; i < count; i++) input << rng() % 1000000 << "\n";
+        }
+        auto inputBytes = std::filesystem::file_size("io_bench_input.txt");
+
+        {
+            CompilationContext context;
+            Lexer lexer(echoProgram, context.symbols);
+            Parser parser(lexer, context);
+            ProgramNode* ast = parser.parseProgram();
+            std::ofstream out("io_bench_runtime.cpp");
+            generateProgram(ast, context, out);
+        }
+        {
+            std::ofstream out("io_bench_iostream.cpp");
+            out << iostreamBaseline;
+        }
+        if (system("g++ -O2 io_bench_runtime.cpp -o io_bench_runtime.exe") != 0 ||
+            system("g++ -O2 io_bench_iostream.cpp -o io_bench_iostream.exe") != 0) {
+            std::cerr << "Error: C++ code compilation failed" << std::endl;
+            return 2;
+        }
+
+        double baseline = timeRun("io_bench_iostream.exe", "io_bench_input.txt");
+        double runtime = timeRun("io_bench_runtime.exe", "io_bench_input.txt");
+        double mb = inputBytes / (1024.0 * 1024.0);
+        std::cout << count << " lines in, " << count << " lines out (" << mb << " MB input)\n";
+        std::cout << "iostream + endl:  " << baseline << " ms (" << mb / (baseline / 1000) << " MB/s)\n";
+        std::cout << "pseudo runtime:   " << runtime << " ms (" << mb / (runtime / 1000) << " MB/s)\n";
+        std::cout << "speedup:          " << baseline / runtime << "x\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include "../lexer.hpp"
+#include "../context.hpp"
+#include "../source.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static void generateSource(const std::string& path, size_t targetBytes) {
+    std::ofstream out(path);
+    std::mt19937 rng(7);
+    size_t written = 0;
+    std::string line;
+    while (written < targetBytes) {
+        int v = rng() % 1000;
+        switch (rng() % 4) {
+            case 0: line = "counter_" + std::to_string(v) + " <- counter_" + std::to_string(v) + " + " + std::to_string(rng() % 100000) + " * 3\n"; break;
+            case 1: line = "IF value" + std::to_string(v) + " >= 42 THEN\n    OUTPUT \"big value\"\nENDIF\n"; break;
+            case 2: line = "WHILE total <> limit" + std::to_string(v) + "\n    total <- total - 1\nENDWHILE\n"; break;
+            default: line = "FOR i <- 1 TO n\n    OUTPUT items[i] % 10\nNEXT\n"; break;
+        }
+        out << line;
+        written += line.size();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256;
+    std::string path = argc > 2 ? argv[2] : "lexer_bench_input.pseudo";
+
+    try {
+        if (argc <= 2) generateSource(path, megabytes * 1024 * 1024);
+
+        auto start = Clock::now();
+        SourceFile source(path);
+        CompilationContext context;
+        Lexer lexer(source.text(), context.symbols);
+        size_t count = 0;
+        while (lexer.next().type != END) count++;
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        double mb = source.text().size() / (1024.0 * 1024.0);
+        std::cout << mb << " MB, " << count << " tokens, " << context.symbols.size() << " symbols\n";
+        std::cout << "time:         " << seconds * 1000 << " ms\n";
+        std::cout << "throughput:   " << count / seconds / 1e6 << " Mtokens/s, " << mb / seconds << " MB/s\n";
+        std::cout << "source bytes: " << static_cast<double>(source.text().size()) / count << " per token\n";
+        std::cout << "token size:   " << sizeof(Token) << " bytes\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "../compiler.hpp"
+#include "../source.hpp"
+#include "../toolchain.hpp"
+
+// Builds each program with both backends, runs the two executables on the
+// same input (<program>.in when it exists) and compares their output. When
+// <program>.out exists the C++ build must also print exactly that, which
+// is the only check for programs the native backend does not support.
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+static double run(const fs::path& exe, const fs::path& input, const fs::path& output) {
+    std::string command = "\"" + exe.string() + "\" > \"" + output.string() + "\"";
+    command += " < \"" + (fs::exists(input) ? input.string() : std::string("/dev/null")) + "\"";
+    auto start = Clock::now();
+    system(command.c_str());
+    return elapsedMs(start);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <input_file>..." << std::endl;
+        return 1;
+    }
+    fs::path work = fs::temp_directory_path() / "pseudocode_native_check";
+    fs::create_directories(work);
+
+    int mismatches = 0;
+    double cppBuildTotal = 0, nativeBuildTotal = 0;
+    for (int i = 1; i < argc; i++) {
+        fs::path program = argv[i];
+        fs::path input = fs::path(program).replace_extension(".in");
+        fs::path expected = fs::path(program).replace_extension(".out");
+        std::string stem = program.stem().string();
+        fs::path cppExe = work / (stem + ".cpp.exe");
+        fs::path nativeExe = work / (stem + ".elf");
+
+        std::string code;
+        try {
+            code = std::string(SourceFile(program.string()).text());
+        } catch (const std::exception& e) {
+            std::cerr << program.string() << ": " << e.what() << std::endl;
+            mismatches++;
+            continue;
+        }
+
+        auto start = Clock::now();
+        CompileResult cpp = compile(code);
+        if (cpp.ok) {
+            std::ofstream(work / (stem + ".cpp"), std::ios::binary) << cpp.cpp;
+            cpp.ok = invokeCompiler("g++", profileFlags(OptimizationProfile::Default), (work / (stem + ".cpp")).string(),
+                                    cppExe.string()) == 0;
+        }
+        double cppBuild = elapsedMs(start);
+
+        start = Clock::now();
+        CompileResult native = compileNative(code, nativeExe);
+        double nativeBuild = elapsedMs(start);
+
+        bool cppOnly = !native.ok && fs::exists(expected);
+        if (!cpp.ok || (!native.ok && !cppOnly)) {
+            std::cout << "FAILED    " << program.string() << ": "
+                      << (cpp.ok ? native.error : "C++ build failed") << "\n";
+            mismatches++;
+            continue;
+        }
+        double cppRun = run(cppExe, input, work / (stem + ".cpp.out"));
+        std::string cppOutput = readFile(work / (stem + ".cpp.out"));
+        if (cppOnly) {
+            bool same = cppOutput == readFile(expected);
+            mismatches += !same;
+            cppBuildTotal += cppBuild;
+            std::cout << (same ? "ok        " : "MISMATCH  ") << program.string() << ": build g++ " << cppBuild
+                      << " ms; run g++ " << cppRun << " ms; no native build\n";
+            continue;
+        }
+        double nativeRun = run(nativeExe, input, work / (stem + ".elf.out"));
+        bool same = cppOutput == readFile(work / (stem + ".elf.out")) &&
+                    (!fs::exists(expected) || cppOutput == readFile(expected));
+        mismatches += !same;
+        cppBuildTotal += cppBuild;
+        nativeBuildTotal += nativeBuild;
+        std::cout << (same ? "ok        " : "MISMATCH  ") << program.string() << ": build g++ " << cppBuild
+                  << " ms, native " << nativeBuild << " ms; run g++ " << cppRun << " ms, native " << nativeRun << " ms\n";
+    }
+    std::cout << argc - 1 << " programs, " << mismatches << " failed; build total g++ " << cppBuildTotal
+              << " ms, native " << nativeBuildTotal << " ms" << std::endl;
+    return mismatches ? 2 : 0;
+}
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../codegen.hpp"
+#include "../vm.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <input_file> [stdin_file] [iterations]" << std::endl;
+        return 1;
+    }
+    std::string code = readFile(argv[1]);
+    std::string stdinPath = argc > 2 ? argv[2] : "";
+    std::string input = stdinPath.empty() ? "" : readFile(stdinPath);
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    try {
+        double vmTotal = 0;
+        for (int i = 0; i < iterations; i++) {
+            auto start = Clock::now();
+            CompilationContext context;
+            Lexer lexer(code, context.symbols);
+            Parser parser(lexer, context);
+            ProgramNode* ast = parser.parseProgram();
+            Chunk chunk = compileBytecode(ast);
+            std::istringstream in(input);
+            std::ostringstream out;
+            runBytecode(chunk, in, out);
+            vmTotal += elapsedMs(start);
+        }
+
+        int nativeRuns = iterations < 3 ? iterations : 3;
+        double compileTotal = 0, runTotal = 0;
+        for (int i = 0; i < nativeRuns; i++) {
+            auto start = Clock::now();
+            CompilationContext context;
+            Lexer lexer(code, context.symbols);
+            Parser parser(lexer, context);
+            ProgramNode* ast = parser.parseProgram();
+            {
+                std::ofstream out("vm_bench_output.cpp");
+                generateProgram(ast, context, out);
+            }
+            if (system("g++ vm_bench_output.cpp -o vm_bench_output.exe") != 0) {
+                std::cerr << "Error: C++ code compilation failed" << std::endl;
+                return 2;
+            }
+            compileTotal += elapsedMs(start);
+
+            start = Clock::now();
+            std::string run = "./vm_bench_output.exe > /dev/null";
+            if (!stdinPath.empty()) run += " < " + stdinPath;
+            system(run.c_str());
+            runTotal += elapsedMs(start);
+        }
+
+        std::cout << "vm (parse + lower + run): " << vmTotal / iterations << " ms/iter over " << iterations << " iterations\n";
+        if (nativeRuns > 0) {
+            double compileAvg = compileTotal / nativeRuns, runAvg = runTotal / nativeRuns;
+            std::cout << "g++ compile:              " << compileAvg << " ms/iter\n";
+            std::cout << "native run:               " << runAvg << " ms/iter\n";
+            std::cout << "compile-and-run:          " << compileAvg + runAvg << " ms/iter over " << nativeRuns << " iterations\n";
+            std::cout << "speedup:                  " << (compileAvg + runAvg) / (vmTotal / iterations) << "x\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
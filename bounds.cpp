@@ -0,0 +1,278 @@
+#include "bounds.hpp"
+#include <charconv>
+#include <climits>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr size_t nowhere = SIZE_MAX;
+
+// A sum of symbols times coefficients, plus a constant.
+struct Linear {
+    std::map<uint32_t, long long> terms;
+    long long constant = 0;
+
+    Linear& add(const Linear& other, long long scale) {
+        for (auto [symbol, coefficient] : other.terms) {
+            long long& term = terms[symbol];
+            term += coefficient * scale;
+            if (term == 0) terms.erase(symbol);
+        }
+        constant += other.constant * scale;
+        return *this;
+    }
+};
+
+// a <= b whatever the symbols stand for: b - a is a constant at least 0.
+bool provablyAtMost(const Linear& a, const Linear& b) {
+    Linear difference = b;
+    difference.add(a, -1);
+    return difference.terms.empty() && difference.constant >= 0;
+}
+
+bool intValue(const ExprNode* expr, long long& value) {
+    auto lit = dynamic_cast<const LiteralExpr*>(expr);
+    if (!lit || lit->type != NUMBER) return false;
+    auto [end, ec] = std::from_chars(lit->value.data(), lit->value.data() + lit->value.size(), value);
+    return ec == std::errc() && end == lit->value.data() + lit->value.size() && value >= INT_MIN && value <= INT_MAX;
+}
+
+bool writes(NodeList block, uint32_t symbol) {
+    for (auto stmt : block) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            if (input->symbol == symbol) return true;
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            if (assign->symbol == symbol) return true;
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            if (writes(ifNode->thenBranch, symbol) || writes(ifNode->elseBranch, symbol)) return true;
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            if (writes(whileNode->body, symbol)) return true;
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            if (writes(repeat->body, symbol)) return true;
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            if (forNode->symbol == symbol || writes(forNode->body, symbol)) return true;
+        }
+    }
+    return false;
+}
+
+// A value is only known symbolically when it cannot change: a scalar
+// written by a single top-level statement keeps that value from the next
+// top-level statement on, and an array DECLAREd once at top level keeps its
+// bounds.
+class BoundsChecker {
+    struct Writes {
+        size_t count = 0;
+        size_t statement = nowhere;   // top-level index of the last write
+    };
+    struct Shape {
+        size_t declaredAt;
+        std::vector<std::optional<Linear>> lower, upper;
+    };
+    // The values a FOR iterator takes while its body runs.
+    struct Range {
+        uint32_t iterator;
+        Linear low, high;
+    };
+
+    const CompilationContext& context;
+    std::unordered_map<uint32_t, Writes> scalarWrites;
+    std::unordered_map<uint32_t, Writes> declarations;
+    std::unordered_map<uint32_t, Shape> shapes;
+    std::vector<Range> loops;
+    size_t statement = 0;
+    uint64_t cleared = 0;
+
+public:
+    explicit BoundsChecker(const CompilationContext& context) : context(context) {}
+
+    uint64_t run(ProgramNode* program) {
+        NodeList statements = program->statements;
+        for (size_t i = 0; i < statements.size(); i++) countWrites(statements[i], i);
+        for (size_t i = 0; i < statements.size(); i++) {
+            auto declare = dynamic_cast<const DeclareNode*>(statements[i]);
+            if (!declare || declarations[declare->symbol].count != 1) continue;
+            statement = i;
+            Shape& shape = shapes[declare->symbol];
+            shape.declaredAt = i;
+            for (const auto& bound : declare->bounds) {
+                shape.lower.push_back(linear(bound.lower));
+                shape.upper.push_back(linear(bound.upper));
+            }
+        }
+        for (statement = 0; statement < statements.size(); statement++) visit(statements[statement]);
+        return cleared;
+    }
+
+private:
+    static void record(std::unordered_map<uint32_t, Writes>& table, uint32_t symbol, size_t at) {
+        Writes& entry = table[symbol];
+        entry.count++;
+        entry.statement = at;
+    }
+
+    void countWrites(NodeList block) {
+        for (auto stmt : block) countWrites(stmt, nowhere);
+    }
+
+    void countWrites(const ASTNode* stmt, size_t at) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            record(scalarWrites, input->symbol, at);
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            record(scalarWrites, assign->symbol, at);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            record(declarations, declare->symbol, at);
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            countWrites(ifNode->thenBranch);
+            countWrites(ifNode->elseBranch);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            countWrites(whileNode->body);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            countWrites(repeat->body);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            // An iterator changes on every trip, so it never counts as one write.
+            record(scalarWrites, forNode->symbol, nowhere);
+            record(scalarWrites, forNode->symbol, nowhere);
+            countWrites(forNode->body);
+        }
+    }
+
+    bool unchanging(uint32_t symbol) const {
+        auto it = scalarWrites.find(symbol);
+        return it == scalarWrites.end() || (it->second.count == 1 && it->second.statement < statement);
+    }
+
+    const Range* activeLoop(uint32_t symbol) const {
+        for (auto it = loops.rbegin(); it != loops.rend(); ++it)
+            if (it->iterator == symbol) return &*it;
+        return nullptr;
+    }
+
+    // expr in terms of unchanging symbols and active iterators, when it is
+    // built from them with +, -, negation and multiplication by a constant.
+    std::optional<Linear> linear(const ExprNode* expr) const {
+        long long value;
+        if (intValue(expr, value)) return Linear{{}, value};
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            // A STRING's + concatenates, so only integers add up linearly.
+            if (context.arrays.count(var->symbol) || !isIntegral(context.variables.typeOf(var->symbol)))
+                return std::nullopt;
+            if (activeLoop(var->symbol) || unchanging(var->symbol)) return Linear{{{var->symbol, 1}}, 0};
+            return std::nullopt;
+        }
+        if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            std::optional<Linear> operand = unary->op == "-" ? linear(unary->operand) : std::nullopt;
+            if (!operand) return std::nullopt;
+            return Linear().add(*operand, -1);
+        }
+        auto bin = dynamic_cast<const BinaryExpr*>(expr);
+        if (!bin || (bin->op != "+" && bin->op != "-" && bin->op != "*")) return std::nullopt;
+        std::optional<Linear> left = linear(bin->left), right = linear(bin->right);
+        if (!left || !right) return std::nullopt;
+        if (bin->op != "*") return left->add(*right, bin->op == "+" ? 1 : -1);
+        if (right->terms.empty()) return Linear().add(*left, right->constant);
+        if (left->terms.empty()) return Linear().add(*right, left->constant);
+        return std::nullopt;
+    }
+
+    // The least or greatest value over the iterators of the loops being
+    // visited: each iterator term becomes its range's bound on that side.
+    Linear extreme(const Linear& value, bool greatest) const {
+        Linear result{{}, value.constant};
+        for (auto [symbol, coefficient] : value.terms) {
+            const Range* range = activeLoop(symbol);
+            if (!range) result.add(Linear{{{symbol, 1}}, 0}, coefficient);
+            else result.add((coefficient > 0) == greatest ? range->high : range->low, coefficient);
+        }
+        return result;
+    }
+
+    bool inBounds(const IndexExpr* idx) const {
+        auto var = dynamic_cast<const VariableExpr*>(idx->base);
+        auto it = var ? shapes.find(var->symbol) : shapes.end();
+        if (it == shapes.end() || statement <= it->second.declaredAt) return false;
+        const Shape& shape = it->second;
+        if (idx->indices.size() != shape.lower.size()) return false;
+        for (size_t d = 0; d < idx->indices.size(); d++) {
+            std::optional<Linear> index = linear(idx->indices[d]);
+            if (!index || !shape.lower[d] || !shape.upper[d]) return false;
+            if (!provablyAtMost(*shape.lower[d], extreme(*index, false)) ||
+                !provablyAtMost(extreme(*index, true), *shape.upper[d]))
+                return false;
+        }
+        return true;
+    }
+
+    void visit(ExprNode* expr) {
+        if (auto unary = dynamic_cast<UnaryExpr*>(expr)) {
+            visit(unary->operand);
+        } else if (auto call = dynamic_cast<CallExpr*>(expr)) {
+            for (auto argument : call->arguments) visit(argument);
+        } else if (auto bin = dynamic_cast<BinaryExpr*>(expr)) {
+            visit(bin->left);
+            visit(bin->right);
+        } else if (auto idx = dynamic_cast<IndexExpr*>(expr)) {
+            visit(idx->base);
+            for (auto index : idx->indices) visit(index);
+            if (idx->checked && idx->array(context) && inBounds(idx)) {
+                idx->checked = false;
+                cleared++;
+            }
+        }
+    }
+
+    void visit(NodeList block) {
+        for (auto stmt : block) visit(stmt);
+    }
+
+    void visit(ASTNode* stmt) {
+        if (auto output = dynamic_cast<OutputExprNode*>(stmt)) {
+            visit(output->expr);
+        } else if (auto assign = dynamic_cast<AssignNode*>(stmt)) {
+            visit(assign->expr);
+        } else if (auto call = dynamic_cast<CallNode*>(stmt)) {
+            visit(call->call);
+        } else if (auto assign = dynamic_cast<ElementAssignNode*>(stmt)) {
+            visit(assign->target);
+            visit(assign->expr);
+        } else if (auto declare = dynamic_cast<DeclareNode*>(stmt)) {
+            for (const auto& bound : declare->bounds) {
+                visit(bound.lower);
+                visit(bound.upper);
+            }
+        } else if (auto ifNode = dynamic_cast<IfNode*>(stmt)) {
+            visit(ifNode->condition);
+            visit(ifNode->thenBranch);
+            visit(ifNode->elseBranch);
+        } else if (auto whileNode = dynamic_cast<WhileNode*>(stmt)) {
+            visit(whileNode->condition);
+            visit(whileNode->body);
+        } else if (auto repeat = dynamic_cast<RepeatUntilNode*>(stmt)) {
+            visit(repeat->body);
+            visit(repeat->condition);
+        } else if (auto forNode = dynamic_cast<ForNode*>(stmt)) {
+            for (auto bound : {forNode->startExpr, forNode->endExpr, forNode->stepExpr}) visit(bound);
+            // Iterator values run from start to end, in whichever direction
+            // the step goes, unless the body assigns the iterator itself.
+            long long step;
+            std::optional<Linear> start = linear(forNode->startExpr), end = linear(forNode->endExpr);
+            bool known = intValue(forNode->stepExpr, step) && step != 0 && start && end &&
+                         !writes(forNode->body, forNode->symbol);
+            if (known) {
+                loops.push_back(step > 0 ? Range{forNode->symbol, extreme(*start, false), extreme(*end, true)}
+                                         : Range{forNode->symbol, extreme(*end, false), extreme(*start, true)});
+            }
+            visit(forNode->body);
+            if (known) loops.pop_back();
+        }
+    }
+};
+
+}
+
+uint64_t elideBoundsChecks(ProgramNode* program, const CompilationContext& context) {
+    return BoundsChecker(context).run(program);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include "ast.hpp"
+#include "context.hpp"
+
+// Clears IndexExpr::checked on array elements whose every index is provably
+// inside the array's bounds. Indices, bounds and loop limits are compared
+// as sums of constants and symbols, with FOR iterators replaced by the ends
+// of their loop range, so both a[i] and a[n + 1 - i] inside FOR i <- 1 TO n
+// over ARRAY[1:n] qualify as long as n is assigned once, before both.
+// Returns the number of element accesses that lost their check.
+uint64_t elideBoundsChecks(ProgramNode* program, const CompilationContext& context);
@@ -0,0 +1,210 @@
+#include "codegen.hpp"
+#include "ranges.hpp"
+#include "runtime.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <sstream>
+
+void emitPrelude(const std::set<std::string>& includes, bool usesIo, std::ostream& out, const CodegenOptions& options) {
+    if (options.useRuntimeHeader) {
+        out << "#include \"" << runtimeHeaderName << "\"\n\n";
+        if (options.profile) out << profileRuntimeSource() << "\n";
+    } else {
+        for (const auto& header : includes)
+            out << "#include <" << header << ">\n";
+        if (usesIo) out << ioRuntimeSource() << "\n";
+        if (options.profile) out << profileRuntimeSource() << "\n";
+        out << "using namespace std;\n\n";
+    }
+}
+
+namespace {
+
+// The variables of the innermost scope, other than parameters.
+void emitVariables(std::ostream& body, CompilationContext& context, std::span<const Parameter> parameters = {}) {
+    // Sorted by name so the output does not depend on declaration order.
+    std::vector<std::pair<std::string_view, uint32_t>> names;
+    for (uint32_t symbol : context.variables.declarations()) {
+        bool isParameter = std::any_of(parameters.begin(), parameters.end(),
+                                       [&](const Parameter& parameter) { return parameter.symbol == symbol; });
+        if (!isParameter) names.emplace_back(context.symbols.name(symbol), symbol);
+    }
+    std::sort(names.begin(), names.end());
+    for (auto [name, symbol] : names) {
+        ValueType type = context.variables.typeOf(symbol);
+        body << "\t" << cppTypeName(type) << " " << name;
+        if (type == ValueType::String) context.includes.insert("string");
+        else body << " = " << (type == ValueType::Bool ? "false" : "0");
+        body << ";\n";
+    }
+}
+
+const char* defaultValue(ValueType type) {
+    if (type == ValueType::String) return "string()";
+    return type == ValueType::Bool ? "false" : "0";
+}
+
+// The lines of the source as a C++ array indexed by line number, for the
+// profile report to quote. Returns how many there are.
+size_t emitSourceLines(std::string_view source, std::ostream& out) {
+    out << "static const char* const pseudo_source[] = {\n\t\"\"";
+    size_t count = 0;
+    while (!source.empty() || count == 0) {
+        size_t end = std::min(source.find('\n'), source.size());
+        std::string_view line = source.substr(0, end);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        out << ",\n\t\"";
+        for (char c : line) {
+            if (c == '"' || c == '\\') out << '\\' << c;
+            else if (c == '\t') out << "    ";
+            else if (static_cast<unsigned char>(c) < ' ') out << '?';
+            else out << c;
+        }
+        out << "\"";
+        source.remove_prefix(std::min(end + 1, source.size()));
+        count++;
+    }
+    out << "\n};\n\n";
+    return count;
+}
+
+}
+
+void emitDeclarations(std::ostream& body, CompilationContext& context) {
+    emitVariables(body, context);
+    for (const auto& storage : arrayStorage(context)) {
+        context.usesIo = true;
+        body << "\t" << storage.type << " " << storage.name;
+        if (!storage.initial.empty()) body << " = " << storage.initial;
+        body << ";\n";
+    }
+}
+
+void emitPrototype(const SubroutineNode* subroutine, CompilationContext& context, std::ostream& out) {
+    if (subroutine->result == ValueType::String) context.includes.insert("string");
+    out << (subroutine->isFunction() ? cppTypeName(subroutine->result) : "void") << " "
+        << subroutineName(subroutine->name) << "(";
+    for (size_t i = 0; i < subroutine->parameters.size(); i++) {
+        const Parameter& parameter = subroutine->parameters[i];
+        if (parameter.type == ValueType::String) context.includes.insert("string");
+        out << (i ? ", " : "") << cppTypeName(parameter.type) << " " << parameter.name;
+    }
+    out << ")";
+}
+
+// A memoized FUNCTION runs its body in a lambda, so that every RETURN in it
+// passes through the cache on the way out.
+void emitSubroutine(const SubroutineNode* subroutine, CompilationContext& context, const CodegenOptions& options,
+                    std::ostream& out) {
+    const SubroutineInfo& info = context.subroutines.at(subroutine->symbol);
+    bool memoized = options.memoize && subroutine->isFunction() && info.pure && info.recursive;
+    const char* result = cppTypeName(subroutine->result);
+    context.variables.pushScope();
+    for (auto [symbol, type] : info.variables) context.variables.declareLocal(symbol, type);
+
+    emitPrototype(subroutine, context, out);
+    out << " {\n";
+    if (context.profile) out << "\tpseudo::ProfileFrame pseudo_frame;\n";
+    if (memoized) {
+        context.includes.insert("map");
+        context.includes.insert("tuple");
+        out << "\tstatic map<tuple<";
+        for (size_t i = 0; i < subroutine->parameters.size(); i++)
+            out << (i ? ", " : "") << cppTypeName(subroutine->parameters[i].type);
+        out << ">, " << result << "> pseudo_memo;\n\tauto pseudo_key = make_tuple(";
+        for (size_t i = 0; i < subroutine->parameters.size(); i++)
+            out << (i ? ", " : "") << subroutine->parameters[i].name;
+        out << ");\n\tauto pseudo_hit = pseudo_memo.find(pseudo_key);\n"
+            << "\tif (pseudo_hit != pseudo_memo.end()) return pseudo_hit->second;\n"
+            << "\t" << result << " pseudo_result = [&]() -> " << result << " {\n";
+    }
+    emitVariables(out, context, subroutine->parameters);
+    generateBlock(subroutine->body, out, context);
+    // A FUNCTION that ends without RETURN gives its type's default value.
+    if (subroutine->isFunction()) out << "\treturn " << defaultValue(subroutine->result) << ";\n";
+    if (memoized) out << "\t}();\n\tpseudo_memo.emplace(pseudo_key, pseudo_result);\n\treturn pseudo_result;\n";
+    out << "}\n\n";
+    context.variables.popScope();
+}
+
+std::vector<ArrayStorage> arrayStorage(const CompilationContext& context) {
+    std::vector<std::pair<std::string_view, const ArrayInfo*>> arrays;
+    for (const auto& [symbol, info] : context.arrays) arrays.emplace_back(context.symbols.name(symbol), &info);
+    std::sort(arrays.begin(), arrays.end());
+    std::vector<ArrayStorage> storage;
+    for (auto [name, info] : arrays) {
+        storage.push_back({"pseudo::Array<" + std::string(cppTypeName(info->element)) + ">", std::string(name), ""});
+        for (size_t d = 0; d < info->rank; d++) {
+            storage.push_back({"int", arrayBoundName(name, d, false), "1"});
+            storage.push_back({"int", arrayBoundName(name, d, true), "0"});
+        }
+    }
+    return storage;
+}
+
+void emitTranslationUnit(const GeneratedProgram& program, std::ostream& out, const CodegenOptions& options) {
+    emitPrelude(program.includes, program.usesIo, out, options);
+    out << program.functions;
+    out << "int main() {\n";
+    out << program.body;
+    out << "}\n";
+}
+
+void emitUnityTranslationUnit(const std::vector<UnityMember>& members, std::ostream& out,
+                              const CodegenOptions& options) {
+    std::set<std::string> includes = {"cstdio", "cstring"};
+    bool usesIo = false;
+    for (const auto& member : members) {
+        includes.insert(member.program->includes.begin(), member.program->includes.end());
+        usesIo = usesIo || member.program->usesIo;
+    }
+    if (options.useRuntimeHeader) out << "#include <cstdio>\n#include <cstring>\n";
+    emitPrelude(includes, usesIo, out, options);
+
+    for (size_t i = 0; i < members.size(); i++) {
+        out << "namespace program_" << i << " {\n" << members[i].program->functions << "int run() {\n";
+        out << members[i].program->body;
+        out << "\treturn 0;\n}\n}\n\n";
+    }
+
+    out << "int main(int argc, char* argv[]) {\n";
+    for (size_t i = 0; i < members.size(); i++)
+        out << "\tif (argc > 1 && strcmp(argv[1], \"" << members[i].name << "\") == 0) return program_" << i << "::run();\n";
+    out << "\tfprintf(stderr, \"usage: %s <program>\\nprograms:";
+    for (const auto& member : members) out << " " << member.name;
+    out << "\\n\", argv[0]);\n\treturn 1;\n}\n";
+}
+
+GeneratedProgram generateBody(const ProgramNode* program, CompilationContext& context,
+                              const CodegenOptions& options) {
+    context.includes.clear();
+    context.usesIo = false;
+    context.profile = options.profile;
+    inferTypes(program, context);
+    chooseIntegerWidths(program, context);
+
+    // Prototypes first, so subroutines can call each other in any order.
+    std::ostringstream functions;
+    size_t lines = options.profile ? emitSourceLines(options.source, functions) : 0;
+    for (auto subroutine : program->subroutines) {
+        emitPrototype(subroutine, context, functions);
+        functions << ";\n";
+    }
+    if (!program->subroutines.empty()) functions << "\n";
+    for (auto subroutine : program->subroutines) emitSubroutine(subroutine, context, options, functions);
+
+    std::ostringstream body;
+    if (options.profile) {
+        // The profile writes through the same output as the program.
+        context.usesIo = true;
+        body << "\tpseudo::profile.begin(pseudo_source, " << lines << ");\n";
+    }
+    emitDeclarations(body, context);
+    program->generateCode(body, context);
+    return {body.str(), context.includes, context.usesIo, functions.str()};
+}
+
+void generateProgram(const ProgramNode* program, CompilationContext& context, std::ostream& out,
+                     const CodegenOptions& options) {
+    emitTranslationUnit(generateBody(program, context, options), out, options);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast.hpp"
+
+struct CodegenOptions {
+    bool useRuntimeHeader = false;
+    // Cache the results of FUNCTIONs that are recursive and pure, keyed by
+    // their arguments.
+    bool memoize = false;
+    // Count and time every statement and loop test per line of source, and
+    // report them when the program exits. source is quoted in the report.
+    bool profile = false;
+    std::string_view source;
+};
+
+// The statements of main() and what they need from the prelude, and the
+// subroutines defined ahead of it.
+struct GeneratedProgram {
+    std::string body;
+    std::set<std::string> includes;
+    bool usesIo = false;
+    std::string functions;
+};
+
+struct UnityMember {
+    std::string name;
+    const GeneratedProgram* program;
+};
+
+void generateProgram(const ProgramNode* program, CompilationContext& context, std::ostream& out,
+                     const CodegenOptions& options = {});
+GeneratedProgram generateBody(const ProgramNode* program, CompilationContext& context,
+                              const CodegenOptions& options = {});
+
+// Shared by both AST layouts: hoisted declarations for context.variables,
+// and the headers plus main() wrapped around a generated body.
+void emitPrelude(const std::set<std::string>& includes, bool usesIo, std::ostream& out, const CodegenOptions& options);
+void emitDeclarations(std::ostream& body, CompilationContext& context);
+
+// A PROCEDURE or FUNCTION as a C++ function, typed as inferTypes found it:
+// the signature alone, and the whole definition.
+void emitPrototype(const SubroutineNode* subroutine, CompilationContext& context, std::ostream& out);
+void emitSubroutine(const SubroutineNode* subroutine, CompilationContext& context, const CodegenOptions& options,
+                    std::ostream& out);
+
+// The C++ variables behind each array: its elements, and bounds that leave
+// every index out of range until its DECLARE has run. initial is empty for
+// the elements.
+struct ArrayStorage {
+    std::string type;
+    std::string name;
+    std::string initial;
+};
+std::vector<ArrayStorage> arrayStorage(const CompilationContext& context);
+void emitTranslationUnit(const GeneratedProgram& program, std::ostream& out, const CodegenOptions& options);
+
+// One translation unit holding every member as program_<i>::run(), with a
+// main() that runs the member named by its first argument.
+void emitUnityTranslationUnit(const std::vector<UnityMember>& members, std::ostream& out,
+                              const CodegenOptions& options);
@@ -0,0 +1,211 @@
+#include "compile_cache.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Part of every key, so that binaries built from an older code generator
+// are never served. Bump it with any change to the lexer, parser,
+// optimizer, code generators or runtime that can change what the same
+// source compiles to.
+constexpr const char* generatorVersion = "pseudocode-codegen-2";
+
+constexpr std::array<uint32_t, 64> sha256K = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Where a file is written before it is renamed to path. The name is this
+// process's own, and each call's own among the server's workers, so two
+// writers never share a temporary file.
+fs::path tempPath(const fs::path& path) {
+    static std::atomic<uint64_t> count{0};
+    fs::path temp = path;
+    temp += "." + std::to_string(getpid()) + "." + std::to_string(count++) + ".tmp";
+    return temp;
+}
+
+uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+std::string sha256(const std::string& data) {
+    std::array<uint32_t, 8> h = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    std::string msg = data;
+    uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    for (int i = 7; i >= 0; i--) msg.push_back(static_cast<char>(bitLength >> (i * 8)));
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            const auto* p = reinterpret_cast<const unsigned char*>(msg.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = k + s1 + ch + sha256K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            k = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+
+    static const char* hex = "0123456789abcdef";
+    std::string digest;
+    for (uint32_t word : h)
+        for (int i = 28; i >= 0; i -= 4) digest.push_back(hex[(word >> i) & 0xf]);
+    return digest;
+}
+
+}
+
+CompileCache::CompileCache(const fs::path& dir, uintmax_t maxBytes) : dir(dir), maxBytes(maxBytes) {
+    fs::create_directories(dir);
+}
+
+fs::path CompileCache::defaultDirectory() {
+    if (const char* env = std::getenv("PSEUDOCODE_CACHE_DIR")) return env;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) return fs::path(xdg) / "pseudocode";
+    if (const char* home = std::getenv("HOME")) return fs::path(home) / ".cache" / "pseudocode";
+    return fs::temp_directory_path() / "pseudocode-cache";
+}
+
+std::string CompileCache::makeKey(std::string_view source, const std::string& compilerVersion, const std::string& flags) {
+    std::string material = std::string(generatorVersion) + '\0' + compilerVersion + '\0' + flags + '\0';
+    material.append(source);
+    return sha256(material);
+}
+
+fs::path CompileCache::entryPath(const std::string& key) const {
+    return dir / (key + ".bin");
+}
+
+bool CompileCache::lookup(const std::string& key, const fs::path& dest) {
+    fs::path entry = entryPath(key);
+    std::error_code ec;
+    bool hit = false;
+    if (fs::exists(entry, ec)) {
+        fs::copy_file(entry, dest, fs::copy_options::overwrite_existing, ec);
+        if (!ec) {
+            fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+            hit = true;
+        }
+    }
+    updateStats([&](CacheStats& current) { (hit ? current.hits : current.misses)++; });
+    return hit;
+}
+
+void CompileCache::store(const std::string& key, const fs::path& binary) {
+    fs::path entry = entryPath(key);
+    fs::path temp = tempPath(entry);
+    std::error_code ec;
+    fs::copy_file(binary, temp, fs::copy_options::overwrite_existing, ec);
+    if (ec) return;
+    fs::rename(temp, entry, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return;
+    }
+
+    uint64_t evicted = evict();
+    if (evicted > 0) updateStats([&](CacheStats& current) { current.evictions += evicted; });
+}
+
+CacheStats CompileCache::stats() const {
+    CacheStats result;
+    std::ifstream file(dir / "stats");
+    file >> result.hits >> result.misses >> result.evictions;
+    return result;
+}
+
+// Compiles sharing the cache update the counts one at a time under a lock
+// on stats.lock, and the new counts are renamed into place, so no update
+// is lost and stats() never reads a half-written file.
+void CompileCache::updateStats(const std::function<void(CacheStats&)>& update) const {
+    int lock = ::open((dir / "stats.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock < 0) return;
+    if (flock(lock, LOCK_EX) == 0) {
+        CacheStats current = stats();
+        update(current);
+        fs::path temp = tempPath(dir / "stats");
+        {
+            std::ofstream file(temp, std::ios::trunc);
+            file << current.hits << " " << current.misses << " " << current.evictions << "\n";
+        }
+        std::error_code ec;
+        fs::rename(temp, dir / "stats", ec);
+    }
+    close(lock);
+}
+
+uint64_t CompileCache::evict() {
+    struct Entry {
+        fs::path path;
+        uintmax_t size;
+        fs::file_time_type used;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(dir, ec)) {
+        if (item.path().extension() != ".bin") continue;
+        Entry entry{item.path(), item.file_size(ec), item.last_write_time(ec)};
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    if (total <= maxBytes) return 0;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    uint64_t evicted = 0;
+    for (const auto& entry : entries) {
+        if (total <= maxBytes) break;
+        if (fs::remove(entry.path, ec)) {
+            total -= entry.size;
+            evicted++;
+        }
+    }
+    return evicted;
+}
+
+std::string compilerVersion(const std::string& compiler) {
+    std::string version;
+    FILE* pipe = popen((compiler + " --version 2>/dev/null").c_str(), "r");
+    if (!pipe) return compiler;
+    char line[256];
+    if (fgets(line, sizeof(line), pipe)) version = line;
+    pclose(pipe);
+    while (!version.empty() && (version.back() == '\n' || version.back() == '\r')) version.pop_back();
+    return compiler + " " + version;
+}
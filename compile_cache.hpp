@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+class CompileCache {
+    std::filesystem::path dir;
+    uintmax_t maxBytes;
+
+public:
+    CompileCache(const std::filesystem::path& dir, uintmax_t maxBytes);
+
+    static std::filesystem::path defaultDirectory();
+    static std::string makeKey(std::string_view source, const std::string& compilerVersion, const std::string& flags);
+
+    bool lookup(const std::string& key, const std::filesystem::path& dest);
+    void store(const std::string& key, const std::filesystem::path& binary);
+    CacheStats stats() const;
+
+private:
+    std::filesystem::path entryPath(const std::string& key) const;
+    void updateStats(const std::function<void(CacheStats&)>& update) const;
+    uint64_t evict();
+};
+
+std::string compilerVersion(const std::string& compiler);
@@ -0,0 +1,92 @@
+#include "compiler.hpp"
+#include "flat_ast.hpp"
+#include "lexer.hpp"
+#include "native.hpp"
+#include "parser.hpp"
+#include <sstream>
+
+namespace {
+
+// Lexes, parses and optimizes. With a time report the lexer first runs on
+// its own so tokenize can be timed; the parse phase still includes lexing,
+// since the parser pulls tokens as it goes.
+ProgramNode* frontEnd(std::string_view source, CompilationContext& context, const CompileOptions& options,
+                      CompileResult& result) {
+    TimeReport* timing = options.timing;
+    if (timing) {
+        PhaseTiming& phase = timing->begin("tokenize");
+        CompilationContext scratch;
+        Lexer lexer(source, scratch.symbols);
+        while (lexer.next().type != END) phase.count++;
+        phase.countUnit = "tokens";
+        phase.bytes = source.size();
+    }
+
+    PhaseTiming* phase = timing ? &timing->begin("parse") : nullptr;
+    Lexer lexer(source, context.symbols);
+    Parser parser(lexer, context);
+    ProgramNode* program = parser.parseProgram();
+    if (phase) {
+        phase->count = parser.nodeCount();
+        phase->countUnit = "nodes";
+        phase->bytes = context.arena.bytesUsed();
+    }
+
+    if (options.optimize) {
+        phase = timing ? &timing->begin("optimize") : nullptr;
+        result.optimization = optimizeProgram(program, context);
+        if (phase) {
+            const OptimizationStats& stats = result.optimization;
+            phase->count = stats.folded + stats.propagated + stats.removed;
+            phase->countUnit = "rewrites";
+        }
+    }
+    return program;
+}
+
+}
+
+CompileResult compile(std::string_view source, const CompileOptions& options) {
+    CompileResult result;
+    try {
+        CompilationContext context;
+        ProgramNode* program = frontEnd(source, context, options, result);
+
+        PhaseTiming* phase = options.timing ? &options.timing->begin("codegen") : nullptr;
+        CodegenOptions codegen = options.codegen;
+        codegen.source = source;
+        result.program = options.flatAst ? generateFlatBody(flattenProgram(program, context), context)
+                                         : generateBody(program, context, codegen);
+        std::ostringstream out;
+        emitTranslationUnit(result.program, out, options.codegen);
+        result.cpp = out.str();
+        if (phase) phase->bytes = result.cpp.size();
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    if (options.timing) options.timing->end();
+    return result;
+}
+
+CompileResult compileNative(std::string_view source, const std::filesystem::path& path,
+                            const CompileOptions& options) {
+    CompileResult result;
+    try {
+        CompilationContext context;
+        ProgramNode* program = frontEnd(source, context, options, result);
+
+        PhaseTiming* phase = options.timing ? &options.timing->begin("codegen") : nullptr;
+        NativeImage image = generateNative(program, context);
+        if (phase) phase->bytes = image.code.size();
+
+        phase = options.timing ? &options.timing->begin("write elf") : nullptr;
+        writeElfExecutable(image, path);
+        if (phase) phase->bytes = std::filesystem::file_size(path);
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    if (options.timing) options.timing->end();
+    return result;
+}
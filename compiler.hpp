@@ -0,0 +1,33 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "time_report.hpp"
+
+struct CompileOptions {
+    bool optimize = true;
+    bool flatAst = false;
+    CodegenOptions codegen;
+    // Optional; receives the tokenize, parse, optimize and codegen phases.
+    // A report belongs to one compile at a time.
+    TimeReport* timing = nullptr;
+};
+
+struct CompileResult {
+    bool ok = false;
+    std::string cpp;
+    GeneratedProgram program;
+    std::string error;
+    OptimizationStats optimization;
+};
+
+// Translates one program to C++ in a fresh CompilationContext. Keeps no
+// state between calls, so it may be called from several threads at once.
+CompileResult compile(std::string_view source, const CompileOptions& options = {});
+
+// Compiles one program straight to an x86-64 ELF executable at path, with
+// no C++ compiler involved. Only ok, error and optimization are filled in.
+CompileResult compileNative(std::string_view source, const std::filesystem::path& path,
+                            const CompileOptions& options = {});
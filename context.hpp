@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "symbols.hpp"
+#include "variables.hpp"
+
+struct ExprNode;
+struct SubroutineNode;
+
+// How an integer +, -, *, /, % or negation is computed, as chooseIntegerWidths
+// found it: in the width of its operands, in 64 bits because its result
+// may not fit in 32, or through an overflow check because it may not fit
+// in 64 either. Variables and literals are Wide where the value read may
+// not fit in 32 bits, so storing it into 32 bits needs a check. Nodes
+// missing from the table are Narrow.
+enum class IntegerOp : uint8_t { Narrow, Wide, Checked };
+
+// A PROCEDURE or FUNCTION as inferTypes found it. Its body has a scope of
+// its own: variables lists the parameters and then every variable the body
+// assigns, with their types.
+struct SubroutineInfo {
+    const SubroutineNode* node = nullptr;
+    std::vector<std::pair<uint32_t, ValueType>> variables;
+    // Pure: no INPUT or OUTPUT, here or in anything it calls, so its result
+    // depends on its arguments alone. Recursive: it can call itself.
+    bool pure = false;
+    bool recursive = false;
+};
+
+using SubroutineTable = std::unordered_map<uint32_t, SubroutineInfo>;
+
+// Everything one compilation owns. Nothing in the compiler is process-wide,
+// so independent contexts can be used concurrently from different threads.
+struct CompilationContext {
+    Arena arena;
+    SymbolTable symbols{arena};
+    VariableTable variables;
+    ArrayTable arrays;
+    SubroutineTable subroutines;
+    std::unordered_map<const ExprNode*, IntegerOp> integerOps;
+    std::set<std::string> includes;
+    bool usesIo = false;
+    // Set for a --profile build: generated statements report to
+    // pseudo::profile.
+    bool profile = false;
+};
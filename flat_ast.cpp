@@ -0,0 +1,721 @@
+#include "flat_ast.hpp"
+#include "ranges.hpp"
+#include "types.hpp"
+#include <cctype>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+BinaryOp binaryOp(std::string_view op) {
+    if (op == "+") return BinaryOp::Add;
+    if (op == "-") return BinaryOp::Sub;
+    if (op == "*") return BinaryOp::Mul;
+    if (op == "/") return BinaryOp::Div;
+    if (op == "%") return BinaryOp::Mod;
+    if (op == "<") return BinaryOp::Lt;
+    if (op == "<=") return BinaryOp::Le;
+    if (op == ">") return BinaryOp::Gt;
+    if (op == ">=") return BinaryOp::Ge;
+    if (op == "=" || op == "==") return BinaryOp::Eq;
+    if (op == "<>" || op == "!=") return BinaryOp::Ne;
+    if (op == "AND") return BinaryOp::And;
+    if (op == "OR") return BinaryOp::Or;
+    throw std::runtime_error("Unsupported operator: " + std::string(op));
+}
+
+const char* cppOperator(BinaryOp op) {
+    static const char* const spelling[] = {"+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "&&", "||"};
+    return spelling[static_cast<int>(op)];
+}
+
+bool isComparison(BinaryOp op) {
+    return op >= BinaryOp::Lt && op <= BinaryOp::Ne;
+}
+
+bool isLogical(BinaryOp op) {
+    return op == BinaryOp::And || op == BinaryOp::Or;
+}
+
+bool isNumberLiteral(std::string_view text) {
+    return !text.empty() && isdigit(static_cast<unsigned char>(text[0]));
+}
+
+// The only place that still looks at the pointer tree: each node is copied
+// once, children before their parent, so every list is contiguous.
+class Flattener {
+    FlatAst ast;
+    CompilationContext& context;
+    SymbolTable& symbols;
+
+public:
+    explicit Flattener(CompilationContext& context) : context(context), symbols(context.symbols) {
+        ast.symbols = &symbols;
+    }
+
+    FlatAst run(const ProgramNode* program) {
+        // Subroutines the optimizer inlined are gone by now.
+        if (!program->subroutines.empty())
+            throw std::runtime_error("The flat AST does not support PROCEDURE and FUNCTION; compile without --flat-ast");
+        inferTypes(program, context);
+        chooseIntegerWidths(program, context);
+        FlatNode root{NodeKind::Program};
+        auto [first, count] = block(program->statements);
+        root.a = first;
+        root.b = count;
+        ast.root = add(root);
+        for (const auto& hint : program->typeHints) ast.typeHints.emplace_back(hint.symbol, hint.type);
+        // Widened variables are Long before the flat inference starts, as
+        // they are once the tree's has finished.
+        for (uint32_t symbol : context.variables.declarations())
+            if (context.variables.typeOf(symbol) == ValueType::Long) ast.typeHints.emplace_back(symbol, ValueType::Long);
+        return std::move(ast);
+    }
+
+private:
+    uint32_t add(const FlatNode& node) {
+        ast.nodes.push_back(node);
+        return static_cast<uint32_t>(ast.nodes.size() - 1);
+    }
+
+    uint32_t list(const std::vector<uint32_t>& items) {
+        uint32_t first = static_cast<uint32_t>(ast.lists.size());
+        ast.lists.insert(ast.lists.end(), items.begin(), items.end());
+        return first;
+    }
+
+    std::pair<uint32_t, uint32_t> block(NodeList statements) {
+        std::vector<uint32_t> items;
+        items.reserve(statements.size());
+        for (auto stmt : statements) items.push_back(statement(stmt));
+        return {list(items), static_cast<uint32_t>(items.size())};
+    }
+
+    uint32_t literal(std::string_view text, TokenType token, ValueType type, const ExprNode* from = nullptr) {
+        ast.literals.push_back({text, token, type});
+        FlatNode node{NodeKind::Literal};
+        node.a = static_cast<uint32_t>(ast.literals.size() - 1);
+        if (from) {
+            node.b = from->position.line;
+            node.c = width(from);
+        }
+        return add(node);
+    }
+
+    uint32_t variable(uint32_t symbol, const ExprNode* from = nullptr) {
+        FlatNode node{NodeKind::Variable};
+        node.a = symbol;
+        if (from) {
+            node.b = from->position.line;
+            node.c = width(from);
+        }
+        return add(node);
+    }
+
+    uint32_t width(const ExprNode* e) const {
+        auto it = context.integerOps.find(e);
+        return static_cast<uint32_t>(it == context.integerOps.end() ? IntegerOp::Narrow : it->second);
+    }
+
+    uint32_t atom(std::string_view text) {
+        if (!isNumberLiteral(text)) return variable(symbols.intern(text));
+        return literal(text, NUMBER, text.find('.') != std::string_view::npos ? ValueType::Real : ValueType::Int);
+    }
+
+    uint32_t expr(const ExprNode* e) {
+        if (auto var = dynamic_cast<const VariableExpr*>(e)) return variable(var->symbol, e);
+        if (auto lit = dynamic_cast<const LiteralExpr*>(e)) return literal(lit->value, lit->type, lit->literalType(), e);
+        if (auto bin = dynamic_cast<const BinaryExpr*>(e)) {
+            FlatNode node{NodeKind::Binary, binaryOp(bin->op)};
+            node.a = expr(bin->left);
+            node.b = expr(bin->right);
+            node.c = width(bin);
+            node.d = e->position.line;
+            return add(node);
+        }
+        if (auto unary = dynamic_cast<const UnaryExpr*>(e)) {
+            FlatNode node{unary->op == "NOT" ? NodeKind::Not : NodeKind::Negate};
+            node.a = expr(unary->operand);
+            if (node.kind == NodeKind::Negate) {
+                node.b = width(unary);
+                node.c = e->position.line;
+            }
+            return add(node);
+        }
+        if (auto idx = dynamic_cast<const IndexExpr*>(e)) {
+            FlatNode node{NodeKind::Index};
+            node.a = expr(idx->base);
+            std::vector<uint32_t> items;
+            for (auto index : idx->indices) items.push_back(expr(index));
+            node.b = list(items);
+            node.c = static_cast<uint32_t>(items.size());
+            node.d = idx->checked;
+            return add(node);
+        }
+        throw std::runtime_error("Unsupported expression: " + e->toString());
+    }
+
+    uint32_t statement(const ASTNode* stmt) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            FlatNode node{NodeKind::Input};
+            node.a = input->symbol;
+            return add(node);
+        }
+        if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+            FlatNode node{NodeKind::Output};
+            node.a = expr(output->expr);
+            return add(node);
+        }
+        if (auto output = dynamic_cast<const OutputNode*>(stmt)) {
+            FlatNode node{NodeKind::Output};
+            node.a = output->type == STRING ? literal(output->value, STRING, ValueType::String) : atom(output->value);
+            return add(node);
+        }
+        if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            FlatNode node{NodeKind::Assign};
+            node.a = assign->symbol;
+            node.b = expr(assign->expr);
+            return add(node);
+        }
+        if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            FlatNode node{NodeKind::ElementAssign};
+            node.a = expr(assign->target);
+            node.b = expr(assign->expr);
+            return add(node);
+        }
+        if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            recordArray(ast.arrays, declare);
+            FlatNode node{NodeKind::Declare};
+            node.a = declare->symbol;
+            std::vector<uint32_t> items;
+            for (const auto& bound : declare->bounds) {
+                items.push_back(expr(bound.lower));
+                items.push_back(expr(bound.upper));
+            }
+            node.b = list(items);
+            node.c = static_cast<uint32_t>(declare->bounds.size());
+            return add(node);
+        }
+        if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            FlatNode node{NodeKind::If};
+            node.a = expr(ifNode->condition);
+            std::vector<uint32_t> items;
+            for (auto s : ifNode->thenBranch) items.push_back(statement(s));
+            for (auto s : ifNode->elseBranch) items.push_back(statement(s));
+            node.b = list(items);
+            node.c = static_cast<uint32_t>(ifNode->thenBranch.size());
+            node.d = static_cast<uint32_t>(ifNode->elseBranch.size());
+            return add(node);
+        }
+        if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            FlatNode node{NodeKind::While};
+            node.a = expr(whileNode->condition);
+            std::tie(node.b, node.c) = block(whileNode->body);
+            return add(node);
+        }
+        if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            FlatNode node{NodeKind::Repeat};
+            node.a = expr(repeat->condition);
+            std::tie(node.b, node.c) = block(repeat->body);
+            return add(node);
+        }
+        if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            FlatNode node{NodeKind::For};
+            node.a = forNode->symbol;
+            std::vector<uint32_t> items = {expr(forNode->startExpr), expr(forNode->endExpr), expr(forNode->stepExpr)};
+            for (auto s : forNode->body) items.push_back(statement(s));
+            node.b = list(items);
+            node.c = static_cast<uint32_t>(forNode->body.size());
+            return add(node);
+        }
+        throw std::runtime_error("Unsupported statement");
+    }
+};
+
+ValueType join(ValueType a, ValueType b) {
+    if (a == ValueType::Unknown) return b;
+    if (b == ValueType::Unknown) return a;
+    if (a == ValueType::String || b == ValueType::String) return ValueType::String;
+    if (a == ValueType::Real || b == ValueType::Real) return ValueType::Real;
+    if (a == ValueType::Long || b == ValueType::Long) return ValueType::Long;
+    if (a == ValueType::Int || b == ValueType::Int) return ValueType::Int;
+    return ValueType::Bool;
+}
+
+// The array an Index node reads from, or null for a character of a string.
+const ArrayInfo* indexedArray(const FlatAst& ast, const FlatNode& node) {
+    const FlatNode& base = ast.nodes[node.a];
+    if (base.kind != NodeKind::Variable) return nullptr;
+    auto it = ast.arrays.find(base.a);
+    return it == ast.arrays.end() ? nullptr : &it->second;
+}
+
+ValueType exprType(const FlatAst& ast, const std::vector<ValueType>& types, uint32_t index) {
+    const FlatNode& node = ast.nodes[index];
+    switch (node.kind) {
+        case NodeKind::Variable:
+            return types[node.a];
+        case NodeKind::Literal:
+            return ast.literals[node.a].type;
+        case NodeKind::Binary: {
+            if (isComparison(node.op) || isLogical(node.op)) return ValueType::Bool;
+            ValueType l = exprType(ast, types, node.a);
+            ValueType r = exprType(ast, types, node.b);
+            if (node.op == BinaryOp::Add && (l == ValueType::String || r == ValueType::String)) return ValueType::String;
+            if (l == ValueType::Real || r == ValueType::Real) return ValueType::Real;
+            if (l == ValueType::Long || r == ValueType::Long || node.c) return ValueType::Long;
+            return ValueType::Int;
+        }
+        case NodeKind::Index:
+            if (const ArrayInfo* array = indexedArray(ast, node)) return array->element;
+            return exprType(ast, types, node.a) == ValueType::String ? ValueType::String : ValueType::Unknown;
+        case NodeKind::Negate: {
+            ValueType type = exprType(ast, types, node.a);
+            if (type == ValueType::Real) return ValueType::Real;
+            return type == ValueType::Long || node.b ? ValueType::Long : ValueType::Int;
+        }
+        case NodeKind::Not:
+            return ValueType::Bool;
+        default:
+            return ValueType::Unknown;
+    }
+}
+
+// Mirrors TypeInference in types.cpp. Variables that were never seen stay
+// Unknown, which is how callers tell them apart from declared ones.
+class FlatTypeInference {
+    const FlatAst& ast;
+    std::vector<ValueType> types;
+    std::vector<bool> seen;
+    std::set<uint32_t> inputs;
+    bool changed = false;
+
+public:
+    explicit FlatTypeInference(const FlatAst& ast)
+            : ast(ast), types(ast.symbols->size(), ValueType::Unknown), seen(ast.symbols->size(), false) {
+        for (const auto& [symbol, type] : ast.typeHints) {
+            types[symbol] = type;
+            seen[symbol] = true;
+        }
+    }
+
+    std::vector<ValueType> run() {
+        const FlatNode& root = ast.nodes[ast.root];
+        while (true) {
+            do {
+                changed = false;
+                visitBlock(root.a, root.b);
+            } while (changed);
+
+            bool defaulted = false;
+            for (uint32_t symbol : inputs) {
+                if (types[symbol] == ValueType::Unknown) {
+                    types[symbol] = ValueType::String;
+                    defaulted = true;
+                }
+            }
+            if (!defaulted) break;
+        }
+        for (size_t symbol = 0; symbol < types.size(); symbol++)
+            if (seen[symbol] && types[symbol] == ValueType::Unknown) types[symbol] = ValueType::Int;
+        for (const auto& [symbol, info] : ast.arrays)
+            if (seen[symbol]) throw std::runtime_error(std::string(ast.name(symbol)) + " is an array and needs an index");
+        return std::move(types);
+    }
+
+private:
+    void widen(uint32_t symbol, ValueType type) {
+        seen[symbol] = true;
+        // Widths come from chooseIntegerWidths as type hints: a 64-bit
+        // value stored into a variable it chose to keep at 32 bits fits.
+        if (type == ValueType::Long) type = ValueType::Int;
+        ValueType next = join(types[symbol], type);
+        if (next != types[symbol]) {
+            types[symbol] = next;
+            changed = true;
+        }
+    }
+
+    void expectNumeric(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        if (node.kind != NodeKind::Variable) return;
+        ValueType current = types[node.a];
+        if (current == ValueType::Unknown || current == ValueType::Bool) widen(node.a, ValueType::Int);
+    }
+
+    void expectCondition(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        if (node.kind == NodeKind::Variable && types[node.a] == ValueType::Unknown) widen(node.a, ValueType::Bool);
+        if (exprType(ast, types, index) == ValueType::String)
+            throw std::runtime_error("AND, OR and NOT need BOOLEAN operands, not a STRING");
+    }
+
+    void visitExpr(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        switch (node.kind) {
+            case NodeKind::Variable:
+                seen[node.a] = true;
+                break;
+            case NodeKind::Negate:
+                visitExpr(node.a);
+                expectNumeric(node.a);
+                if (exprType(ast, types, node.a) == ValueType::String) throw std::runtime_error("Cannot negate a STRING");
+                break;
+            case NodeKind::Not:
+                visitExpr(node.a);
+                expectCondition(node.a);
+                break;
+            case NodeKind::Binary: {
+                visitExpr(node.a);
+                visitExpr(node.b);
+                ValueType l = exprType(ast, types, node.a);
+                ValueType r = exprType(ast, types, node.b);
+                if (isLogical(node.op)) {
+                    expectCondition(node.a);
+                    expectCondition(node.b);
+                } else if (isComparison(node.op)) {
+                    if (l != ValueType::String && r != ValueType::String) {
+                        expectNumeric(node.a);
+                        expectNumeric(node.b);
+                    }
+                } else if (node.op == BinaryOp::Add) {
+                    if (isNumeric(l)) expectNumeric(node.b);
+                    if (isNumeric(r)) expectNumeric(node.a);
+                } else {
+                    expectNumeric(node.a);
+                    expectNumeric(node.b);
+                }
+                break;
+            }
+            case NodeKind::Index:
+                if (const ArrayInfo* array = indexedArray(ast, node)) {
+                    if (node.c != array->rank) throw std::runtime_error("Wrong number of indices for an array");
+                } else {
+                    if (node.c != 1) throw std::runtime_error("Only arrays take several indices");
+                    visitExpr(node.a);
+                }
+                for (uint32_t i = node.b; i < node.b + node.c; i++) {
+                    visitExpr(ast.lists[i]);
+                    expectNumeric(ast.lists[i]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void visitBlock(uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) visitStatement(ast.lists[i]);
+    }
+
+    void visitStatement(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        switch (node.kind) {
+            case NodeKind::Input:
+                inputs.insert(node.a);
+                seen[node.a] = true;
+                break;
+            case NodeKind::Output:
+                visitExpr(node.a);
+                break;
+            case NodeKind::Assign:
+                visitExpr(node.b);
+                widen(node.a, exprType(ast, types, node.b));
+                break;
+            case NodeKind::ElementAssign:
+                if (!indexedArray(ast, ast.nodes[node.a])) throw std::runtime_error("Cannot assign to a string character");
+                visitExpr(node.a);
+                visitExpr(node.b);
+                break;
+            case NodeKind::Declare:
+                for (uint32_t i = node.b; i < node.b + 2 * node.c; i++) {
+                    visitExpr(ast.lists[i]);
+                    expectNumeric(ast.lists[i]);
+                }
+                break;
+            case NodeKind::If:
+                visitExpr(node.a);
+                visitBlock(node.b, node.c + node.d);
+                break;
+            case NodeKind::While:
+                visitExpr(node.a);
+                visitBlock(node.b, node.c);
+                break;
+            case NodeKind::Repeat:
+                visitBlock(node.b, node.c);
+                visitExpr(node.a);
+                break;
+            case NodeKind::For:
+                widen(node.a, ValueType::Int);
+                for (uint32_t i = node.b; i < node.b + 3; i++) {
+                    visitExpr(ast.lists[i]);
+                    expectNumeric(ast.lists[i]);
+                }
+                visitBlock(node.b + 3, node.c);
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+class FlatCodegen {
+    const FlatAst& ast;
+    const std::vector<ValueType>& types;
+    CompilationContext& context;
+    std::ostream& out;
+
+public:
+    FlatCodegen(const FlatAst& ast, const std::vector<ValueType>& types, CompilationContext& context, std::ostream& out)
+            : ast(ast), types(types), context(context), out(out) {}
+
+    void emitBlock(uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) emitStatement(ast.lists[i]);
+    }
+
+private:
+    ValueType typeOf(uint32_t index) const { return exprType(ast, types, index); }
+
+    void emitExpr(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        switch (node.kind) {
+            case NodeKind::Variable:
+                out << ast.name(node.a);
+                break;
+            case NodeKind::Literal: {
+                const FlatLiteral& lit = ast.literals[node.a];
+                if (lit.token == STRING) out << "\"" << lit.text << "\"";
+                else if (lit.token == TRUE) out << "true";
+                else if (lit.token == FALSE) out << "false";
+                else out << cppNumberLiteral(lit.text, lit.type);
+                break;
+            }
+            case NodeKind::Binary: {
+                ValueType operandType = typeOf(index);
+                ValueType l = typeOf(node.a);
+                ValueType r = typeOf(node.b);
+                if (isComparison(node.op)) {
+                    if (l == ValueType::String && r == ValueType::String) operandType = ValueType::String;
+                    else if (l == ValueType::Real || r == ValueType::Real) operandType = ValueType::Real;
+                    else if (l == ValueType::Long || r == ValueType::Long) operandType = ValueType::Long;
+                    else operandType = ValueType::Int;
+                }
+                if (isLogical(node.op)) operandType = ValueType::Bool;
+                if (node.c == static_cast<uint32_t>(IntegerOp::Checked)) {
+                    context.usesIo = true;
+                    out << checkedOperation(cppOperator(node.op)) << "(";
+                    emitAs(node.a, operandType);
+                    out << ", ";
+                    emitAs(node.b, operandType);
+                    out << ", " << node.d << ")";
+                    break;
+                }
+                bool wrapLeft = operandType == ValueType::String && ast.nodes[node.a].kind == NodeKind::Literal
+                                && ast.nodes[node.b].kind == NodeKind::Literal;
+                bool widenLeft = node.c && l != ValueType::Long && r != ValueType::Long;
+                out << "(";
+                if (wrapLeft) out << "string(";
+                if (widenLeft) out << "static_cast<long long>(";
+                emitAs(node.a, operandType);
+                if (wrapLeft || widenLeft) out << ")";
+                out << " " << cppOperator(node.op) << " ";
+                emitAs(node.b, operandType);
+                out << ")";
+                break;
+            }
+            case NodeKind::Index: {
+                if (indexedArray(ast, node)) {
+                    std::vector<std::string> indices;
+                    for (uint32_t i = node.b; i < node.b + node.c; i++) indices.push_back(generated(ast.lists[i]));
+                    emitElement(out, ast.name(ast.nodes[node.a].a), indices, node.d);
+                    break;
+                }
+                bool isString = typeOf(node.a) == ValueType::String;
+                if (isString) out << "string(1, ";
+                emitExpr(node.a);
+                out << "[";
+                emitAs(ast.lists[node.b], ValueType::Int);
+                out << "]";
+                if (isString) out << ")";
+                break;
+            }
+            case NodeKind::Negate:
+                if (node.b == static_cast<uint32_t>(IntegerOp::Checked)) {
+                    context.usesIo = true;
+                    out << "pseudo::checkedNeg(";
+                    emitAs(node.a, ValueType::Long);
+                    out << ", " << node.c << ")";
+                    break;
+                }
+                out << "(- ";
+                if (node.b && typeOf(node.a) != ValueType::Long) out << "static_cast<long long>(";
+                emitAs(node.a, typeOf(index));
+                if (node.b && typeOf(node.a) != ValueType::Long) out << ")";
+                out << ")";
+                break;
+            case NodeKind::Not:
+                out << "(! ";
+                emitAs(node.a, ValueType::Bool);
+                out << ")";
+                break;
+            default:
+                throw std::runtime_error("Statement used as expression");
+        }
+    }
+
+    void emitAs(uint32_t index, ValueType want) {
+        ValueType have = typeOf(index);
+        if (want == ValueType::String && isNumeric(have)) {
+            context.includes.insert("string");
+            out << "to_string(";
+            emitExpr(index);
+            out << ")";
+        } else if (isNumeric(want) && have == ValueType::String) {
+            context.includes.insert("string");
+            out << parseFunction(want);
+            emitExpr(index);
+            out << ")";
+        } else if (want == ValueType::Int && have == ValueType::Long && !width(ast.nodes[index])) {
+            out << "static_cast<int>(";
+            emitExpr(index);
+            out << ")";
+        } else if (want == ValueType::Int && have == ValueType::Long) {
+            context.usesIo = true;
+            out << "pseudo::checkedNarrow(";
+            emitExpr(index);
+            out << ", " << line(ast.nodes[index]) << ")";
+        } else {
+            emitExpr(index);
+        }
+    }
+
+    // The line an expression that can be Long starts on, and its IntegerOp.
+    static uint32_t line(const FlatNode& node) {
+        if (node.kind == NodeKind::Binary) return node.d;
+        return node.kind == NodeKind::Negate ? node.c : node.b;
+    }
+    static uint32_t width(const FlatNode& node) {
+        if (node.kind == NodeKind::Variable || node.kind == NodeKind::Literal || node.kind == NodeKind::Binary)
+            return node.c;
+        return node.kind == NodeKind::Negate ? node.b : 0;
+    }
+
+    // An integer expression as text, for emitCountedFor.
+    std::string generated(uint32_t index, ValueType want = ValueType::Int) {
+        std::ostringstream text;
+        FlatCodegen(ast, types, context, text).emitAs(index, want);
+        return text.str();
+    }
+
+    void emitStatement(uint32_t index) {
+        const FlatNode& node = ast.nodes[index];
+        switch (node.kind) {
+            case NodeKind::Input:
+                context.usesIo = true;
+                out << "\tpseudo::read(" << ast.name(node.a) << ");\n";
+                break;
+            case NodeKind::Output:
+                context.usesIo = true;
+                out << "\tpseudo::print(";
+                emitExpr(node.a);
+                out << ");\n";
+                break;
+            case NodeKind::Assign:
+                out << "\t" << ast.name(node.a) << " = ";
+                emitAs(node.b, types[node.a]);
+                out << ";\n";
+                break;
+            case NodeKind::ElementAssign:
+                out << "\t";
+                emitExpr(node.a);
+                out << " = ";
+                emitAs(node.b, typeOf(node.a));
+                out << ";\n";
+                break;
+            case NodeKind::Declare: {
+                context.usesIo = true;
+                std::vector<std::string> bounds;
+                for (uint32_t i = node.b; i < node.b + 2 * node.c; i++) bounds.push_back(generated(ast.lists[i]));
+                emitArrayDeclaration(out, ast.name(node.a), bounds);
+                break;
+            }
+            case NodeKind::If:
+                out << "\tif (";
+                emitExpr(node.a);
+                out << ") {\n";
+                emitBlock(node.b, node.c);
+                out << "\t}";
+                if (node.d > 0) {
+                    out << " else {\n";
+                    emitBlock(node.b + node.c, node.d);
+                    out << "\t}";
+                }
+                out << "\n";
+                break;
+            case NodeKind::While:
+                out << "\twhile (";
+                emitExpr(node.a);
+                out << ") {\n";
+                emitBlock(node.b, node.c);
+                out << "\t}\n";
+                break;
+            case NodeKind::Repeat:
+                out << "\tdo {\n";
+                emitBlock(node.b, node.c);
+                out << "\t} while (!";
+                emitExpr(node.a);
+                out << ");\n";
+                break;
+            case NodeKind::For: {
+                uint32_t end = ast.lists[node.b + 1], step = ast.lists[node.b + 2];
+                auto literal = [&](uint32_t index) {
+                    const FlatNode& bound = ast.nodes[index];
+                    return bound.kind == NodeKind::Literal ? &ast.literals[bound.a] : nullptr;
+                };
+                const FlatLiteral* endLiteral = literal(end);
+                const FlatLiteral* stepLiteral = literal(step);
+                ValueType type = types[node.a];
+                emitCountedFor(out, ast.name(node.a), cppTypeName(type), generated(ast.lists[node.b], type),
+                               generated(end, type), endLiteral && endLiteral->token == NUMBER, generated(step, type),
+                               stepLiteral ? literalStepSign(stepLiteral->token, stepLiteral->text) : 0,
+                               [&] { emitBlock(node.b + 3, node.c); });
+                break;
+            }
+            default:
+                throw std::runtime_error("Expression used as statement");
+        }
+    }
+};
+
+}
+
+FlatAst flattenProgram(const ProgramNode* program, CompilationContext& context) {
+    return Flattener(context).run(program);
+}
+
+std::vector<ValueType> inferFlatTypes(const FlatAst& ast) {
+    return FlatTypeInference(ast).run();
+}
+
+GeneratedProgram generateFlatBody(const FlatAst& ast, CompilationContext& context) {
+    context.includes.clear();
+    context.usesIo = false;
+    std::vector<ValueType> types = inferFlatTypes(ast);
+
+    context.variables.clear();
+    for (uint32_t symbol = 0; symbol < types.size(); symbol++)
+        if (types[symbol] != ValueType::Unknown) context.variables.assign(symbol, types[symbol]);
+    context.arrays = ast.arrays;
+
+    std::ostringstream body;
+    emitDeclarations(body, context);
+    const FlatNode& root = ast.nodes[ast.root];
+    FlatCodegen(ast, types, context, body).emitBlock(root.a, root.b);
+    return {body.str(), context.includes, context.usesIo, {}};
+}
+
+void generateFlatProgram(const FlatAst& ast, CompilationContext& context, std::ostream& out,
+                         const CodegenOptions& options) {
+    emitTranslationUnit(generateFlatBody(ast, context), out, options);
+}
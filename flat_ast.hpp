@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "symbols.hpp"
+
+// A flat, index-based copy of the tree. Every node is a fixed-size record in
+// one array and is visited by switching on its kind; no virtual calls or RTTI.
+enum class NodeKind : uint8_t {
+    Program, Input, Output, Assign, If, While, Repeat, For, Declare, ElementAssign,
+    Variable, Literal, Binary, Index, Negate, Not
+};
+
+enum class BinaryOp : uint8_t {
+    Add, Sub, Mul, Div, Mod, Lt, Le, Gt, Ge, Eq, Ne, And, Or
+};
+
+// Field meaning by kind (lists are ranges into FlatAst::lists):
+//   Program            a = first, b = count
+//   Input              a = symbol
+//   Output             a = expr
+//   Assign             a = symbol, b = expr
+//   If                 a = cond, b = first, c = then count, d = else count
+//   While, Repeat      a = cond, b = first, c = count
+//   For                a = symbol, b = first (start, end, step, body...), c = body count
+//   Declare            a = symbol, b = first (lower, upper per dimension), c = rank
+//   ElementAssign      a = target (an Index), b = expr
+//   Variable           a = symbol, b = line, c = IntegerOp
+//   Literal            a = literal, b = line, c = IntegerOp
+//   Binary (op)        a = left, b = right, c = IntegerOp, d = line
+//   Index              a = base, b = first index, c = count, d = checked
+//   Negate             a = operand, b = IntegerOp, c = line
+//   Not                a = operand
+struct FlatNode {
+    NodeKind kind;
+    BinaryOp op = BinaryOp::Add;
+    uint32_t a = 0, b = 0, c = 0, d = 0;
+};
+
+struct FlatLiteral {
+    std::string_view text;
+    TokenType token;
+    ValueType type;
+};
+
+struct FlatAst {
+    std::vector<FlatNode> nodes;
+    std::vector<uint32_t> lists;
+    std::vector<FlatLiteral> literals;
+    std::vector<std::pair<uint32_t, ValueType>> typeHints;
+    ArrayTable arrays;
+    const SymbolTable* symbols = nullptr;
+    uint32_t root = 0;
+
+    std::string_view name(uint32_t symbol) const { return symbols->name(symbol); }
+};
+
+// Types program and chooses its integer widths in context first, so the
+// copy computes every operation in the width the tree would.
+FlatAst flattenProgram(const ProgramNode* program, CompilationContext& context);
+
+// Same inference as inferTypes, indexed by symbol id instead of by name.
+std::vector<ValueType> inferFlatTypes(const FlatAst& ast);
+
+// Produce exactly the same output as generateBody and generateProgram.
+GeneratedProgram generateFlatBody(const FlatAst& ast, CompilationContext& context);
+void generateFlatProgram(const FlatAst& ast, CompilationContext& context, std::ostream& out,
+                         const CodegenOptions& options = {});
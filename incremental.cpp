@@ -0,0 +1,305 @@
+#include "incremental.hpp"
+#include "lexer.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "ranges.hpp"
+#include "toolchain.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// A translation unit ends after a fragment whose fingerprint is a multiple
+// of chunkSpread once it holds minChunkBytes of C++, so where units end
+// depends only on nearby statements and an edit does not shift the rest.
+constexpr uint64_t chunkSpread = 32;
+constexpr size_t minChunkBytes = 32 * 1024;
+constexpr size_t maxChunkBytes = 256 * 1024;
+// A statement continued on the next line is cut in two by splitStatements;
+// a piece the parser rejects is retried joined with up to this many more.
+constexpr size_t maxJoined = 8;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string quoted(const fs::path& path) {
+    return "\"" + path.string() + "\"";
+}
+
+uint64_t fnv1a(std::string_view text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) hash = (hash ^ c) * 1099511628211ull;
+    return hash;
+}
+
+std::string hex(uint64_t value) {
+    char buffer[17];
+    snprintf(buffer, sizeof buffer, "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+bool opensBlock(TokenType type) {
+    return type == IF || type == WHILE || type == FOR || type == REPEAT || type == PROCEDURE || type == FUNCTION;
+}
+bool closesBlock(TokenType type) {
+    return type == ENDIF || type == ENDWHILE || type == NEXT || type == UNTIL || type == ENDPROCEDURE ||
+           type == ENDFUNCTION;
+}
+
+// Cuts source into top-level statements without parsing it: a statement
+// starts with the first token on a line at nesting depth zero and runs to
+// the line the next one starts on, blank lines included.
+std::vector<std::string_view> splitStatements(std::string_view source, SymbolTable& symbols) {
+    std::vector<std::string_view> pieces;
+    Lexer lexer(source, symbols);
+    size_t start = 0, previousEnd = 0;
+    int depth = 0;
+    bool first = true;
+    for (Token token = lexer.next(); token.type != END; token = lexer.next()) {
+        size_t tokenStart = token.type == STRING ? token.offset - 1 : token.offset;
+        size_t newline = source.rfind('\n', tokenStart);
+        if (!first && depth == 0 && newline != std::string_view::npos && newline >= previousEnd) {
+            pieces.push_back(source.substr(start, newline + 1 - start));
+            start = newline + 1;
+        }
+        if (opensBlock(token.type)) depth++;
+        else if (closesBlock(token.type)) depth--;
+        previousEnd = token.offset + token.length + (token.type == STRING);
+        first = false;
+    }
+    if (!first) pieces.push_back(source.substr(start));
+    return pieces;
+}
+
+std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+struct Unit {
+    std::string name;
+    std::string source;
+};
+
+}
+
+IncrementalCompiler::IncrementalCompiler(IncrementalOptions options)
+    : options(std::move(options)), context(std::make_unique<CompilationContext>()) {}
+
+IncrementalCompiler::Fragment& IncrementalCompiler::fragment(std::string_view text, IncrementalStats& stats) {
+    auto [it, inserted] = fragments.try_emplace(std::string(text));
+    Fragment& entry = it->second;
+    if (inserted) {
+        try {
+            size_t before = context->arena.bytesUsed();
+            Lexer lexer(text, context->symbols);
+            Parser parser(lexer, *context);
+            ProgramNode* parsed = parser.parseProgram();
+            entry.statements = parsed->statements;
+            entry.subroutines = parsed->subroutines;
+            entry.fingerprint = fnv1a(text);
+            entry.arenaBytes = context->arena.bytesUsed() - before;
+        } catch (...) {
+            fragments.erase(it);
+            throw;
+        }
+        stats.parsed += entry.statements.size() + entry.subroutines.size();
+    }
+    entry.lastBuild = builds;
+    return entry;
+}
+
+// Forgets fragments the last build did not use. Their nodes stay in the
+// arena, so once it is mostly garbage the session starts over.
+void IncrementalCompiler::collectGarbage() {
+    size_t live = 0;
+    for (auto it = fragments.begin(); it != fragments.end();) {
+        if (it->second.lastBuild != builds) {
+            it = fragments.erase(it);
+        } else {
+            live += it->second.arenaBytes;
+            ++it;
+        }
+    }
+    if (context->arena.bytesUsed() > 2 * live + (16 << 20)) {
+        fragments.clear();
+        context = std::make_unique<CompilationContext>();
+    }
+}
+
+IncrementalStats IncrementalCompiler::build(std::string_view source) {
+    auto start = Clock::now();
+    IncrementalStats stats;
+    builds++;
+
+    std::vector<std::string_view> pieces = splitStatements(source, context->symbols);
+    std::vector<Fragment*> order;
+    std::vector<ASTNode*> statements;
+    std::vector<SubroutineNode*> subroutines;
+    for (size_t i = 0; i < pieces.size();) {
+        std::string error;
+        for (size_t count = 1;; count++) {
+            const std::string_view& last = pieces[i + count - 1];
+            std::string_view text(pieces[i].data(), last.data() + last.size() - pieces[i].data());
+            try {
+                Fragment& entry = fragment(text, stats);
+                order.push_back(&entry);
+                statements.insert(statements.end(), entry.statements.begin(), entry.statements.end());
+                subroutines.insert(subroutines.end(), entry.subroutines.begin(), entry.subroutines.end());
+                i += count;
+                break;
+            } catch (const std::exception& e) {
+                if (error.empty()) error = e.what();
+                if (count == maxJoined || i + count == pieces.size()) throw std::runtime_error(error);
+            }
+        }
+    }
+    stats.statements = statements.size() + subroutines.size();
+
+    auto* program = context->arena.make<ProgramNode>();
+    program->statements = context->arena.copyArray(statements);
+    program->subroutines = context->arena.copyArray(subroutines);
+    inferTypes(program, *context);
+    chooseIntegerWidths(program, *context);
+    // Widths live outside the header, so a change to any of them redoes
+    // the C++ for every fragment; the nodes they belong to persist between
+    // builds, so their addresses identify them.
+    uint64_t widthsKey = 0;
+    for (auto [node, width] : context->integerOps)
+        widthsKey += fnv1a(std::string_view(reinterpret_cast<const char*>(&node), sizeof node)) * static_cast<uint64_t>(width);
+
+    // Variables become static members of a base class of every unit, which
+    // unqualified names in the generated statements find before std's.
+    std::vector<std::pair<std::string_view, uint32_t>> names;
+    for (uint32_t symbol : context->variables.declarations()) names.emplace_back(context->symbols.name(symbol), symbol);
+    std::sort(names.begin(), names.end());
+    std::ostringstream prelude, header, definitions;
+    emitPrelude({"map", "string", "tuple"}, true, prelude, options.codegen);
+    // A precompiled runtime header is only used when it comes first.
+    std::string unitPrefix = options.codegen.useRuntimeHeader ? prelude.str() : "";
+    unitPrefix += "#include \"program.hpp\"\n\n";
+    if (!options.codegen.useRuntimeHeader) header << prelude.str();
+    header << "struct ProgramVariables {\n";
+    for (auto [name, symbol] : names) {
+        ValueType type = context->variables.typeOf(symbol);
+        header << "\tstatic " << cppTypeName(type) << " " << name << ";\n";
+        definitions << cppTypeName(type) << " ProgramVariables::" << name;
+        if (type != ValueType::String) definitions << " = " << (type == ValueType::Bool ? "false" : "0");
+        definitions << ";\n";
+    }
+    for (const auto& storage : arrayStorage(*context)) {
+        header << "\tstatic " << storage.type << " " << storage.name << ";\n";
+        definitions << storage.type << " ProgramVariables::" << storage.name;
+        if (!storage.initial.empty()) definitions << " = " << storage.initial;
+        definitions << ";\n";
+    }
+    header << "};\n";
+    // Subroutines are free functions that any unit may call. Whether one is
+    // memoized depends on what it calls, so that is part of the header too.
+    for (auto subroutine : subroutines) {
+        const SubroutineInfo& info = context->subroutines.at(subroutine->symbol);
+        emitPrototype(subroutine, *context, header);
+        header << ";" << (info.pure && info.recursive ? " // pure, recursive" : "") << "\n";
+    }
+    std::string headerText = header.str();
+    uint64_t typesKey = fnv1a(unitPrefix, fnv1a(headerText));
+
+    std::vector<Unit> units;
+    std::vector<std::string> chunks;
+    std::string body, functions;
+    auto closeUnit = [&] {
+        std::string name = "chunk_" + hex(fnv1a(body, fnv1a(functions, typesKey)));
+        units.push_back({name, unitPrefix + functions + "namespace {\nstruct Chunk : ProgramVariables {\n"
+                               "static void run() {\n" + body + "}\n};\n}\n\nvoid " + name +
+                               "() { Chunk::run(); }\n"});
+        chunks.push_back(name);
+        body.clear();
+        functions.clear();
+    };
+    for (Fragment* entry : order) {
+        if (entry->typesKey != typesKey || entry->widthsKey != widthsKey) {
+            std::ostringstream cpp, definitions;
+            for (auto stmt : entry->statements) stmt->generateCode(cpp, *context);
+            for (auto subroutine : entry->subroutines) emitSubroutine(subroutine, *context, options.codegen, definitions);
+            entry->cpp = cpp.str();
+            entry->functions = definitions.str();
+            entry->typesKey = typesKey;
+            entry->widthsKey = widthsKey;
+        }
+        body += entry->cpp;
+        functions += entry->functions;
+        size_t size = body.size() + functions.size();
+        if (size >= maxChunkBytes || (size >= minChunkBytes && entry->fingerprint % chunkSpread == 0))
+            closeUnit();
+    }
+    if (!body.empty() || !functions.empty()) closeUnit();
+
+    std::string main = unitPrefix + definitions.str() + "\n";
+    for (const auto& chunk : chunks) main += "void " + chunk + "();\n";
+    main += "\nint main() {\n";
+    for (const auto& chunk : chunks) main += "\t" + chunk + "();\n";
+    main += "}\n";
+    units.push_back({"main_" + hex(fnv1a(main, typesKey)), main});
+    stats.units = units.size();
+
+    collectGarbage();
+    stats.frontEndMs = elapsedMs(start);
+    start = Clock::now();
+
+    const fs::path& dir = options.workDir;
+    fs::create_directories(dir);
+    if (readFile(dir / "program.hpp") != headerText) {
+        std::ofstream out(dir / "program.hpp", std::ios::binary);
+        out << headerText;
+        if (!out) throw std::runtime_error("Could not write " + (dir / "program.hpp").string());
+    }
+
+    std::vector<const Unit*> missing;
+    for (const auto& unit : units)
+        if (!fs::exists(dir / (unit.name + ".o"))) missing.push_back(&unit);
+    stats.compiled = missing.size();
+
+    // Objects are compiled under a temporary name so that an interrupted
+    // compile never leaves a file that a later build would trust.
+    std::vector<char> failed(missing.size());
+    parallelFor(missing.size(), options.jobs, [&](size_t i) {
+        fs::path cpp = dir / (missing[i]->name + ".cpp");
+        fs::path object = dir / (missing[i]->name + ".o");
+        fs::path partial = dir / (missing[i]->name + ".o.part");
+        std::ofstream(cpp, std::ios::binary) << missing[i]->source;
+        std::error_code ignored;
+        failed[i] = invokeCompiler(options.compiler, options.flags + (options.flags.empty() ? "-c" : " -c"),
+                                   quoted(cpp), quoted(partial)) != 0;
+        if (!failed[i]) fs::rename(partial, object, ignored);
+    });
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+        throw std::runtime_error("C++ code compilation failed");
+
+    std::string objects;
+    std::set<std::string> live = {"program.hpp"};
+    for (const auto& unit : units) {
+        objects += (objects.empty() ? "" : " ") + quoted(dir / (unit.name + ".o"));
+        live.insert(unit.name + ".cpp");
+        live.insert(unit.name + ".o");
+    }
+    if (invokeCompiler(options.compiler, options.flags, objects, quoted(options.output)) != 0)
+        throw std::runtime_error("Linking " + options.output.string() + " failed");
+
+    std::error_code ignored;
+    for (const auto& file : fs::directory_iterator(dir))
+        if (!live.count(file.path().filename().string())) fs::remove(file.path(), ignored);
+    stats.buildMs = elapsedMs(start);
+    return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "codegen.hpp"
+#include "context.hpp"
+
+struct IncrementalOptions {
+    std::string compiler = "g++";
+    std::string flags;
+    CodegenOptions codegen;
+    unsigned jobs = 1;
+    // One source and object file per translation unit. Objects are named
+    // after a hash of their source, so they are reused across runs too.
+    std::filesystem::path workDir = "output.inc";
+    std::filesystem::path output = "output.exe";
+};
+
+struct IncrementalStats {
+    size_t statements = 0;
+    size_t parsed = 0;     // statements that were not in the fragment cache
+    size_t units = 0;      // translation units linked, including main()
+    size_t compiled = 0;   // units that had no object file yet
+    double frontEndMs = 0;
+    double buildMs = 0;
+};
+
+// Rebuilds one program over and over, as --watch does. Each top-level
+// statement or subroutine is a fragment fingerprinted by its text: unchanged fragments
+// keep their AST and generated C++, and the C++ is split into translation
+// units at content-defined boundaries so that an edit only recompiles the
+// unit it falls in. The optimizer works across statements and is not run.
+class IncrementalCompiler {
+public:
+    explicit IncrementalCompiler(IncrementalOptions options);
+
+    // Throws on parse errors and when the C++ compiler or linker fails.
+    IncrementalStats build(std::string_view source);
+
+private:
+    struct Fragment {
+        NodeList statements;
+        std::span<SubroutineNode*> subroutines;
+        uint64_t fingerprint = 0;
+        size_t arenaBytes = 0;
+        // The C++ for statements, valid while the variable types hash to
+        // typesKey and the integer widths to widthsKey; any type change alters
+        // every declaration it relies on.
+        uint64_t typesKey = 0;
+        uint64_t widthsKey = 0;
+        std::string cpp;
+        std::string functions;
+        uint64_t lastBuild = 0;
+    };
+
+    Fragment& fragment(std::string_view text, IncrementalStats& stats);
+    void collectGarbage();
+
+    IncrementalOptions options;
+    std::unique_ptr<CompilationContext> context;
+    // Keyed by the statement's text, layout included.
+    std::unordered_map<std::string, Fragment> fragments;
+    uint64_t builds = 0;
+};
@@ -1,108 +1,199 @@
 #include "lexer.hpp"
-#include <cctype>
-
-TokenType lookKeyword(const std::string& word) {
-    if (word == "INPUT") return INPUT;
-    if (word == "OUTPUT") return OUTPUT;
-    if (word == "TRUE") return TRUE;
-    if (word == "FALSE") return FALSE;
-    if (word == "IF") return IF;
-    if (word == "THEN") return THEN;
-    if (word == "ELSE") return ELSE;
-    if (word == "ENDIF") return ENDIF;
-    if (word == "FOR") return FOR;
-    if (word == "TO") return TO;
-    if (word == "NEXT") return NEXT;
-    if (word == "WHILE") return WHILE;
-    if (word == "ENDWHILE") return ENDWHILE;
-    if (word == "REPEAT") return REPEAT;
-    if (word == "UNTIL") return UNTIL;
-    if (word == "PROCEDURE") return PROCEDURE;
-    if (word == "FUNCTION") return FUNCTION;
-    if (word == "RETURN") return RETURN;
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+enum CharClass : uint8_t {
+    SPACE = 1, ALPHA = 2, DIGIT = 4, IDENT = 8, PUNCT = 16
+};
+
+constexpr std::array<uint8_t, 256> makeCharTable() {
+    std::array<uint8_t, 256> table{};
+    for (char c : {' ', '\t', '\n', '\r', '\v', '\f'}) table[static_cast<unsigned char>(c)] = SPACE;
+    for (int c = 'a'; c <= 'z'; c++) table[c] = ALPHA | IDENT;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] = ALPHA | IDENT;
+    for (int c = '0'; c <= '9'; c++) table[c] = DIGIT | IDENT;
+    table['_'] = IDENT;
+    for (char c : std::string_view("+-*/=<>%():,")) table[static_cast<unsigned char>(c)] = PUNCT;
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> charTable = makeCharTable();
+
+inline bool is(char c, uint8_t cls) {
+    return charTable[static_cast<unsigned char>(c)] & cls;
+}
+
+constexpr const char* keywordSpellings[] = {
+    "INPUT", "OUTPUT", nullptr, nullptr, nullptr, nullptr,
+    "TRUE", "FALSE", nullptr,
+    "IF", "THEN", "ELSE", "ENDIF",
+    "FOR", "TO", "STEP", "NEXT",
+    "WHILE", "ENDWHILE", "REPEAT", "UNTIL",
+    "PROCEDURE", "ENDPROCEDURE", "FUNCTION", "ENDFUNCTION", "RETURN", "RETURNS", "CALL",
+    "DECLARE", "ARRAY", "OF",
+    "AND", "OR", "NOT",
+    nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr
+};
+
+}
+
+// Every keyword is uniquely identified by its length and first letter, so
+// a candidate needs at most one full comparison.
+TokenType lookKeyword(std::string_view word) {
+    auto check = [&](const char* keyword, TokenType type) {
+        return word == keyword ? type : IDENTIFIER;
+    };
+    switch (word.size()) {
+        case 2:
+            if (word[0] == 'I') return check("IF", IF);
+            if (word[0] == 'T') return check("TO", TO);
+            if (word[0] == 'O') return word[1] == 'F' ? check("OF", OF) : check("OR", OR);
+            break;
+        case 3:
+            if (word[0] == 'F') return check("FOR", FOR);
+            if (word[0] == 'A') return check("AND", AND);
+            if (word[0] == 'N') return check("NOT", NOT);
+            break;
+        case 4:
+            if (word[0] == 'T') return word[1] == 'H' ? check("THEN", THEN) : check("TRUE", TRUE);
+            if (word[0] == 'E') return check("ELSE", ELSE);
+            if (word[0] == 'N') return check("NEXT", NEXT);
+            if (word[0] == 'S') return check("STEP", STEP);
+            if (word[0] == 'C') return check("CALL", CALL);
+            break;
+        case 5:
+            if (word[0] == 'I') return check("INPUT", INPUT);
+            if (word[0] == 'E') return check("ENDIF", ENDIF);
+            if (word[0] == 'F') return check("FALSE", FALSE);
+            if (word[0] == 'W') return check("WHILE", WHILE);
+            if (word[0] == 'U') return check("UNTIL", UNTIL);
+            if (word[0] == 'A') return check("ARRAY", ARRAY);
+            break;
+        case 6:
+            if (word[0] == 'O') return check("OUTPUT", OUTPUT);
+            if (word[0] == 'R') return word[2] == 'P' ? check("REPEAT", REPEAT) : check("RETURN", RETURN);
+            break;
+        case 7:
+            if (word[0] == 'D') return check("DECLARE", DECLARE);
+            if (word[0] == 'R') return check("RETURNS", RETURNS);
+            break;
+        case 8:
+            if (word[0] == 'E') return check("ENDWHILE", ENDWHILE);
+            if (word[0] == 'F') return check("FUNCTION", FUNCTION);
+            break;
+        case 9:
+            if (word[0] == 'P') return check("PROCEDURE", PROCEDURE);
+            break;
+        case 11:
+            if (word[0] == 'E') return check("ENDFUNCTION", ENDFUNCTION);
+            break;
+        case 12:
+            if (word[0] == 'E') return check("ENDPROCEDURE", ENDPROCEDURE);
+            break;
+    }
     return IDENTIFIER;
 }
 
-std::vector<Token> tokenize(const std::string& code) {
-    std::vector<Token> tokens;
-    size_t pos = 0;
-    while (pos < code.length()) {
-        char c = code[pos];
+Lexer::Lexer(std::string_view source, SymbolTable& symbols) : source(source), symbols(symbols) {
+    if (source.size() >= UINT32_MAX) throw std::runtime_error("Source file too large (4 GiB limit)");
+    for (char c : std::string_view("+-*/=<>%():,[]")) charSymbols[static_cast<unsigned char>(c)] = symbols.intern(std::string_view(&c, 1));
+    for (int type = 0; type <= END; type++)
+        if (keywordSpellings[type]) keywordSymbols[type] = symbols.intern(keywordSpellings[type]);
+    assignSymbol = symbols.intern("<-");
+    lessEqualSymbol = symbols.intern("<=");
+    greaterEqualSymbol = symbols.intern(">=");
+    notEqualSymbol = symbols.intern("<>");
+}
 
-        if (isspace(c)) {
-            pos++;
-            continue;
+Token Lexer::next() {
+    const char* data = source.data();
+    size_t length = source.size();
+    while (pos < length && is(data[pos], SPACE)) {
+        if (data[pos] == '\n') {
+            line++;
+            lineStart = pos + 1;
         }
+        pos++;
+    }
 
-        if (c == '[') {
-            tokens.push_back({LPAREN, "["});
-            pos++;
-            continue;
-        }
+    SourcePosition position{line, static_cast<uint32_t>(pos - lineStart + 1)};
+    if (pos >= length) return {END, static_cast<uint32_t>(length), 0, 0, position};
 
-        if (c == ']') {
-            tokens.push_back({RPAREN, "]"});
-            pos++;
-            continue;
-        }
+    auto make = [&](TokenType type, size_t start, size_t size, uint32_t symbol) {
+        return Token{type, static_cast<uint32_t>(start), static_cast<uint32_t>(size), symbol, position};
+    };
 
-        if (isalpha(c)) {
-            size_t start = pos;
-            while (pos < code.length() && (isalnum(code[pos]) || code[pos] == '_')) pos++;
-            std::string word = code.substr(start, pos - start);
-            TokenType type = lookKeyword(word);
-            tokens.push_back({type, word});
-            continue;
-        }
+    size_t start = pos;
+    char c = data[pos];
 
-        if (isdigit(c)) {
-            size_t start = pos;
-            while (pos < code.length() && isdigit(code[pos])) pos++;
-            std::string number = code.substr(start, pos - start);
-            tokens.push_back({NUMBER, number});
-            continue;
-        }
+    if (c == '[') {
+        pos++;
+        return make(LPAREN, start, 1, charSymbols['[']);
+    }
 
-        if (c == '"') {
-            pos++;
-            size_t start = pos;
-            while (pos < code.length() && code[pos] != '"') pos++;
-            std::string str = code.substr(start, pos - start);
-            if (pos < code.length()) pos++;
-            tokens.push_back({STRING, str});
-            continue;
-        }
+    if (c == ']') {
+        pos++;
+        return make(RPAREN, start, 1, charSymbols[']']);
+    }
 
-        if (pos + 1 < code.length() && code.substr(pos, 2) == "<-") {
-            tokens.push_back({ASSIGN, "<-"});
-            pos += 2;
-            continue;
+    if (is(c, ALPHA)) {
+        while (pos < length && is(data[pos], IDENT)) pos++;
+        std::string_view word(data + start, pos - start);
+        TokenType type = lookKeyword(word);
+        uint32_t symbol = type == IDENTIFIER ? symbols.intern(word) : keywordSymbols[type];
+        return make(type, start, pos - start, symbol);
+    }
+
+    if (is(c, DIGIT)) {
+        while (pos < length && is(data[pos], DIGIT)) pos++;
+        // A REAL literal has digits on both sides of its point.
+        if (pos + 1 < length && data[pos] == '.' && is(data[pos + 1], DIGIT)) {
+            pos++;
+            while (pos < length && is(data[pos], DIGIT)) pos++;
         }
+        return make(NUMBER, start, pos - start, symbols.intern(std::string_view(data + start, pos - start)));
+    }
 
-        if (pos + 1 < code.length()) {
-            std::string two = code.substr(pos, 2);
-            if (two == "<=" || two == ">=" || two == "<>") {
-                tokens.push_back({OPERATOR, two});
-                pos += 2;
-                continue;
-            }
+    if (c == '"') {
+        const char* close = static_cast<const char*>(std::memchr(data + start + 1, '"', length - start - 1));
+        size_t end = close ? static_cast<size_t>(close - data) : length;
+        pos = close ? end + 1 : length;
+        std::string_view text(data + start + 1, end - start - 1);
+        // A literal may run over several lines.
+        for (size_t at = text.find('\n'); at != std::string_view::npos; at = text.find('\n', at + 1)) {
+            line++;
+            lineStart = start + 1 + at + 1;
         }
+        return make(STRING, start + 1, text.size(), symbols.intern(text));
+    }
 
-        if (std::string("+-*/=<>%():,").find(c) != std::string::npos) {
-            TokenType type = OPERATOR;
-            if (c == '(') type = LPAREN;
-            else if (c == ')') type = RPAREN;
-            else if (c == ':') type = COLON;
-            else if (c == ',') type = COMMA;
-            tokens.push_back({type, std::string(1, c)});
-            pos++;
-            continue;
+    if (pos + 1 < length) {
+        char d = data[pos + 1];
+        uint32_t symbol = 0;
+        TokenType type = OPERATOR;
+        if (c == '<' && d == '-') { type = ASSIGN; symbol = assignSymbol; }
+        else if (c == '<' && d == '=') symbol = lessEqualSymbol;
+        else if (c == '>' && d == '=') symbol = greaterEqualSymbol;
+        else if (c == '<' && d == '>') symbol = notEqualSymbol;
+        if (symbol) {
+            pos += 2;
+            return make(type, start, 2, symbol);
         }
+    }
 
-        tokens.push_back({UNKNOWN, std::string(1, c)});
-        pos++;
+    pos++;
+    if (is(c, PUNCT)) {
+        TokenType type = OPERATOR;
+        if (c == '(') type = LPAREN;
+        else if (c == ')') type = RPAREN;
+        else if (c == ':') type = COLON;
+        else if (c == ',') type = COMMA;
+        return make(type, start, 1, charSymbols[static_cast<unsigned char>(c)]);
     }
 
-    tokens.push_back({END, ""});
-    return tokens;
+    return make(UNKNOWN, start, 1, symbols.intern(std::string_view(data + start, 1)));
 }
@@ -1,22 +1,82 @@
 #pragma once
-#include <string>
-#include <vector>
+#include <cstdint>
+#include <string_view>
+#include "symbols.hpp"
 
 enum TokenType {
     INPUT, OUTPUT, IDENTIFIER, NUMBER, STRING, OPERATOR,
     TRUE, FALSE, ASSIGN,
     IF, THEN, ELSE, ENDIF,
-    FOR, TO, NEXT,
+    FOR, TO, STEP, NEXT,
     WHILE, ENDWHILE, REPEAT, UNTIL,
-    PROCEDURE, FUNCTION, RETURN,
+    PROCEDURE, ENDPROCEDURE, FUNCTION, ENDFUNCTION, RETURN, RETURNS, CALL,
+    DECLARE, ARRAY, OF,
+    AND, OR, NOT,
     COLON, LPAREN, RPAREN, COMMA,
     UNKNOWN, END
 };
 
+// Where a token or node starts, counted from 1. Nodes the compiler makes
+// up itself are at line 0.
+struct SourcePosition {
+    uint32_t line = 0;
+    uint32_t column = 0;
+};
+
+// Tokens do not own text: offset/length locate the lexeme in the source
+// and symbol is its interned spelling (string literals without quotes).
 struct Token {
     TokenType type;
-    std::string value;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t symbol;
+    SourcePosition position;
+};
+
+TokenType lookKeyword(std::string_view word);
+
+class Lexer {
+    std::string_view source;
+    SymbolTable& symbols;
+    size_t pos = 0;
+    uint32_t line = 1;
+    size_t lineStart = 0;
+    uint32_t charSymbols[256] = {};
+    uint32_t keywordSymbols[END + 1] = {};
+    uint32_t assignSymbol, lessEqualSymbol, greaterEqualSymbol, notEqualSymbol;
+
+public:
+    Lexer(std::string_view source, SymbolTable& symbols);
+    Token next();
 };
 
-TokenType lookKeyword(const std::string& word);
-std::vector<Token> tokenize(const std::string& code);
+// Pull-based lookahead over a Lexer. Tokens are produced on demand into a
+// small ring buffer, so memory does not grow with the size of the input.
+class TokenStream {
+    static constexpr size_t capacity = 4;
+
+    Lexer& lexer;
+    Token ring[capacity];
+    size_t head = 0;
+    size_t count = 0;
+
+public:
+    explicit TokenStream(Lexer& lexer) : lexer(lexer) {}
+
+    const Token& peek(size_t ahead = 0) {
+        while (count <= ahead) {
+            ring[(head + count) % capacity] = lexer.next();
+            count++;
+        }
+        return ring[(head + ahead) % capacity];
+    }
+
+    Token advance() {
+        Token token = peek();
+        if (token.type != END) {
+            head = (head + 1) % capacity;
+            count--;
+        }
+        return token;
+    }
+};
@@ -2,52 +2,451 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "incremental.hpp"
+#include "vm.hpp"
+#include "compile_cache.hpp"
+#include "runtime.hpp"
+#include "server.hpp"
+#include "toolchain.hpp"
+#include "source.hpp"
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+    std::vector<std::string> inputs;
+    unsigned jobs = 0;
+    std::string unityOutput;
+    bool runMode = false;
+    bool elfMode = false;
+    bool useCache = true;
+    bool showCacheStats = false;
+    bool usePch = false;
+    bool flatAst = false;
+    bool optimize = true;
+    bool showOptReport = false;
+    bool emitCpp = false;
+    bool memoize = false;
+    bool lineProfile = false;
+    bool timeReport = false;
+    bool timeReportJson = false;
+    bool incremental = false;
+    bool watch = false;
+    std::string servePath;
+    unsigned workers = 0;
+    const char* serverEnv = std::getenv("PSEUDOCODE_SERVER");
+    std::string serverPath = serverEnv ? serverEnv : "";
+    bool showServerStats = false;
+    // Options that a compile server can take on our behalf; any other makes
+    // this process compile by itself.
+    std::vector<std::string> forwarded;
+    bool localOnly = false;
+    OptimizationProfile profile = OptimizationProfile::Default;
+    std::string pgoInput;
+    std::filesystem::path cacheDir = CompileCache::defaultDirectory();
+    uintmax_t cacheMaxMb = 256;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (serverAcceptsOption(arg)) forwarded.push_back(arg);
+        else if (arg.rfind("--", 0) == 0 && arg != "--server") localOnly = true;
+        if (arg == "--run") {
+            runMode = true;
+        } else if (arg == "--elf") {
+            elfMode = true;
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "--fast-compile") {
+            profile = OptimizationProfile::FastCompile;
+        } else if (arg == "--O2") {
+            profile = OptimizationProfile::O2;
+        } else if (arg == "--native") {
+            profile = OptimizationProfile::Native;
+        } else if (arg == "--pgo" && i + 1 < argc) {
+            pgoInput = argv[++i];
+        } else if (arg == "--pch") {
+            usePch = true;
+        } else if (arg == "--flat-ast") {
+            flatAst = true;
+        } else if (arg == "--no-opt") {
+            optimize = false;
+        } else if (arg == "--opt-report") {
+            showOptReport = true;
+        } else if (arg == "--emit-cpp") {
+            emitCpp = true;
+        } else if (arg == "--memoize") {
+            memoize = true;
+        } else if (arg == "--profile") {
+            lineProfile = true;
+        } else if (arg == "--time-report" || arg == "--time-report=json") {
+            timeReport = true;
+            timeReportJson = arg == "--time-report=json";
+        } else if (arg == "--incremental" || arg == "--watch") {
+            incremental = true;
+            watch = watch || arg == "--watch";
+        } else if ((arg == "--serve" || arg == "--server") && i + 1 < argc) {
+            (arg == "--serve" ? servePath : serverPath) = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workers = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--server-stats") {
+            showServerStats = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--unity" && i + 1 < argc) {
+            unityOutput = argv[++i];
+        } else if (arg == "--cache-stats") {
+            showCacheStats = true;
+        } else if ((arg == "--cache-dir" || arg == "--cache-max-mb") && i + 1 < argc) {
+            if (arg == "--cache-dir") cacheDir = argv[++i];
+            else cacheMaxMb = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (!servePath.empty()) {
+        ServerOptions server;
+        server.socketPath = servePath;
+        server.workers = workers > 0 ? workers : std::max(1u, std::thread::hardware_concurrency());
+        server.useCache = useCache;
+        server.cacheDir = cacheDir;
+        server.cacheMaxBytes = cacheMaxMb * 1024 * 1024;
+        return runServer(server);
+    }
+
+    if (showServerStats) {
+        ServerRequest request;
+        request.kind = ServerRequest::Stats;
+        auto response = serverPath.empty() ? std::nullopt : sendRequest(serverPath, request);
+        if (!response) {
+            std::cerr << "Error: No compile server at " << (serverPath.empty() ? "(none given)" : serverPath) << std::endl;
+            return 1;
+        }
+        std::cout << response->out;
+        if (inputs.empty()) return 0;
+    }
+
+    if (showCacheStats) {
+        CacheStats stats = CompileCache(cacheDir, cacheMaxMb * 1024 * 1024).stats();
+        std::cout << "Cache " << cacheDir.string() << ": " << stats.hits << " hits, "
+                  << stats.misses << " misses, " << stats.evictions << " evictions" << std::endl;
+        if (inputs.empty()) return 0;
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--run | --elf] [--no-cache] [--cache-dir <dir>] [--cache-max-mb <n>] [--cache-stats] [--pch] [--fast-compile | --O2 | --native] [--pgo <training_input>] [--flat-ast] [--no-opt] [--opt-report] [--emit-cpp] [--memoize] [--profile] [--time-report[=json]] [--incremental | --watch] [--jobs <n>] [--unity <name>] [--server <socket>] <input_file>...\n       " << argv[0] << " --serve <socket> [--workers <n>] [--no-cache] [--cache-dir <dir>] [--cache-max-mb <n>]" << std::endl;
         return 1;
     }
 
-    std::ifstream inputFile(argv[1]);
-    if (!inputFile.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+    bool batchMode = inputs.size() > 1 || jobs > 0 || !unityOutput.empty();
+    if (batchMode && (runMode || elfMode || timeReport || !pgoInput.empty())) {
+        std::cerr << "Error: --run, --elf, --time-report and --pgo take a single input file" << std::endl;
+        return 1;
+    }
+    if (incremental && (batchMode || runMode || elfMode || timeReport || !pgoInput.empty())) {
+        std::cerr << "Error: --incremental and --watch cannot be combined with --run, --elf, --time-report, --pgo or batch builds" << std::endl;
+        return 1;
+    }
+    if (emitCpp && (runMode || elfMode || incremental)) {
+        std::cerr << "Error: --emit-cpp cannot be combined with --run, --elf, --incremental or --watch" << std::endl;
         return 1;
     }
+    if (memoize && (runMode || elfMode)) {
+        std::cerr << "Error: --memoize applies to the generated C++ and cannot be combined with --run or --elf" << std::endl;
+        return 1;
+    }
+    if (lineProfile && (runMode || elfMode || flatAst || incremental || batchMode)) {
+        std::cerr << "Error: --profile builds a single output.exe from the tree AST and cannot be combined with --run, --elf, --flat-ast, --incremental, --watch or batch builds" << std::endl;
+        return 1;
+    }
+
+    // A compile server, when one is given and listening, does everything the
+    // single-file build below would and answers with what it would print.
+    if (!serverPath.empty() && !localOnly && !batchMode && pgoInput.empty()) {
+        ServerRequest request;
+        request.options = forwarded;
+        try {
+            request.workingDirectory = std::filesystem::current_path();
+            request.source = SourceFile(inputs.front()).text();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        if (auto response = sendRequest(serverPath, request)) {
+            std::cout << response->out << std::flush;
+            std::cerr << response->err << std::flush;
+            return response->exitCode;
+        }
+        std::cerr << "Warning: no compile server at " << serverPath << ", compiling locally" << std::endl;
+    }
+
+    CompileOptions compileOptions;
+    compileOptions.optimize = optimize;
+    compileOptions.flatAst = flatAst;
+    compileOptions.codegen.useRuntimeHeader = usePch;
+    compileOptions.codegen.memoize = memoize;
+    compileOptions.codegen.profile = lineProfile;
+
+    // The report goes to stderr, after the compiler's own messages.
+    TimeReport timing;
+    if (timeReport) compileOptions.timing = &timing;
+    auto phase = [&](const char* name) { return timeReport ? &timing.begin(name) : nullptr; };
+    auto printTimeReport = [&] {
+        if (!timeReport) return;
+        timing.end();
+        timing.print(std::cerr, timeReportJson);
+    };
+
+    auto reportOptimization = [&](const OptimizationStats& stats) {
+        if (showOptReport)
+            std::cerr << "Optimizer: " << stats.folded << " expressions folded, " << stats.propagated
+                      << " constants propagated, " << stats.removed << " statements removed, "
+                      << stats.inlined << " calls inlined, " << stats.uncheckedIndexes << " bounds checks removed"
+                      << std::endl;
+    };
 
-    std::stringstream buffer;
-    buffer << inputFile.rdbuf();
-    std::string code = buffer.str();
-    inputFile.close();
+    // The native backend needs no C++ compiler and is faster than a cache
+    // lookup, so it skips the cache entirely.
+    if (elfMode) {
+        std::unique_ptr<SourceFile> source;
+        try {
+            PhaseTiming* read = phase("read");
+            source = std::make_unique<SourceFile>(inputs.front());
+            if (read) read->bytes = source->text().size();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        CompileResult compiled = compileNative(source->text(), "output.exe", compileOptions);
+        if (!compiled.ok) {
+            std::cerr << "Error: " << compiled.error << std::endl;
+            printTimeReport();
+            return 1;
+        }
+        if (optimize) reportOptimization(compiled.optimization);
+        std::cout << "Code compiled succesfully: output.exe created." << std::endl;
+        printTimeReport();
+        return 0;
+    }
+
+    const std::string compiler = "g++";
+    if (!pgoInput.empty() && profile == OptimizationProfile::Default) profile = OptimizationProfile::O2;
+    const std::string flags = profileFlags(profile);
+    if (!runMode) phase("probe g++");
+    std::string version = runMode ? "" : compilerVersion(compiler);
+    if (timeReport) timing.end();
+    std::filesystem::path pchDir;
+    std::string compileFlags = flags;
+    if (usePch && !runMode) {
+        pchDir = runtimePchDirectory(cacheDir, version, flags);
+        compileFlags += (compileFlags.empty() ? "" : " ") + std::string("-I\"") + pchDir.string() + "\"";
+    }
+
+    std::unique_ptr<CompileCache> cache;
+    if (useCache && !runMode && !incremental) {
+        try {
+            cache = std::make_unique<CompileCache>(cacheDir, cacheMaxMb * 1024 * 1024);
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Warning: compile cache disabled: " << e.what() << std::endl;
+        }
+    }
+
+    if (batchMode) {
+        BatchOptions batch;
+        batch.jobs = jobs > 0 ? jobs : std::max(1u, std::thread::hardware_concurrency());
+        batch.compiler = compiler;
+        batch.flags = compileFlags;
+        batch.compile = compileOptions;
+        batch.cache = unityOutput.empty() ? cache.get() : nullptr;
+        batch.compilerVersion = version;
+        batch.cacheFlags = std::string(optimize ? "" : " --no-opt") + (memoize ? " --memoize" : "");
+        batch.unityOutput = unityOutput;
+        batch.emitCpp = emitCpp;
+        try {
+            if (usePch) ensureRuntimePch(pchDir, compiler, flags);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        BatchReport report = compileBatch(inputs, batch);
+        printBatchSummary(report, batch, std::cout);
+        bool failed = std::any_of(report.items.begin(), report.items.end(), [](const BatchItem& item) { return !item.ok; });
+        return failed ? 2 : 0;
+    }
+
+    // Incremental builds keep their objects in output.inc/ instead of the
+    // cache. --watch rebuilds whenever the input file's timestamp changes.
+    if (incremental) {
+        IncrementalOptions options;
+        options.compiler = compiler;
+        options.flags = compileFlags;
+        options.codegen = compileOptions.codegen;
+        options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        IncrementalCompiler builder(options);
+        auto rebuild = [&] {
+            try {
+                if (usePch) ensureRuntimePch(pchDir, compiler, flags);
+                IncrementalStats stats = builder.build(SourceFile(inputs.front()).text());
+                std::cout << "Code compiled succesfully: output.exe created (" << stats.parsed << "/" << stats.statements
+                          << " statements parsed, " << stats.compiled << "/" << stats.units << " units compiled, "
+                          << static_cast<long>(stats.frontEndMs + stats.buildMs) << " ms)." << std::endl;
+                return true;
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return false;
+            }
+        };
+        bool ok = rebuild();
+        if (!watch) return ok ? 0 : 1;
+
+        std::cout << "Watching " << inputs.front() << " for changes." << std::endl;
+        std::error_code error;
+        auto stamp = std::filesystem::last_write_time(inputs.front(), error);
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto current = std::filesystem::last_write_time(inputs.front(), error);
+            if (error || current == stamp) continue;
+            stamp = current;
+            rebuild();
+        }
+    }
+
+    std::unique_ptr<SourceFile> source;
+    try {
+        PhaseTiming* read = phase("read");
+        source = std::make_unique<SourceFile>(inputs.front());
+        if (read) read->bytes = source->text().size();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::string_view code = source->text();
+
+    // The generated C++ goes straight to g++ over a pipe; output.cpp is
+    // only written on request.
+    auto writeCpp = [&](const std::string& cpp) {
+        PhaseTiming* write = phase("write");
+        std::ofstream output("output.cpp", std::ios::binary);
+        output << cpp;
+        if (!output) {
+            std::cerr << "Error: Could not write output.cpp" << std::endl;
+            return false;
+        }
+        if (write) write->bytes = cpp.size();
+        return true;
+    };
+
+    std::string cacheKey;
+    if (cache) {
+        try {
+            PhaseTiming* lookup = phase("cache");
+            std::string keyFlags = compileFlags;
+            if (!optimize) keyFlags += " --no-opt";
+            if (memoize) keyFlags += " --memoize";
+            if (lineProfile) keyFlags += " --profile";
+            if (!pgoInput.empty()) {
+                std::ifstream training(pgoInput);
+                std::stringstream trainingData;
+                trainingData << training.rdbuf();
+                keyFlags += '\0' + std::string("pgo:") + trainingData.str();
+            }
+            cacheKey = CompileCache::makeKey(code, version, keyFlags);
+            if (cache->lookup(cacheKey, "output.exe")) {
+                if (lookup) {
+                    lookup->count = 1;
+                    lookup->countUnit = "hit";
+                    lookup->bytes = std::filesystem::file_size("output.exe");
+                }
+                if (emitCpp) {
+                    CompileResult compiled = compile(code, compileOptions);
+                    if (compiled.ok && !writeCpp(compiled.cpp)) return 1;
+                }
+                std::cout << "Code compiled succesfully: output.exe restored from cache." << std::endl;
+                printTimeReport();
+                return 0;
+            }
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Warning: compile cache disabled: " << e.what() << std::endl;
+            cache.reset();
+        }
+    }
 
-    std::vector<Token> tokens = tokenize(code);
-    Parser parser(tokens);
     try {
-        ProgramNode* ast = parser.parseProgram();
+        if (runMode) {
+            CompilationContext context;
+            PhaseTiming* parse = phase("parse");
+            Lexer lexer(code, context.symbols);
+            Parser parser(lexer, context);
+            ProgramNode* ast = parser.parseProgram();
+            if (parse) {
+                parse->count = parser.nodeCount();
+                parse->countUnit = "nodes";
+                parse->bytes = context.arena.bytesUsed();
+            }
+            if (optimize) {
+                phase("optimize");
+                reportOptimization(optimizeProgram(ast, context));
+            }
 
-        freopen("output.cpp", "w", stdout);
+            PhaseTiming* lower = phase("bytecode");
+            Chunk chunk = compileBytecode(ast);
+            if (lower) {
+                lower->count = chunk.code.size();
+                lower->countUnit = "instructions";
+            }
+            phase("run");
+            std::ios::sync_with_stdio(false);
+            runBytecode(chunk, std::cin, std::cout);
+            std::cout.flush();
+            printTimeReport();
+            return 0;
+        }
 
-        std::cout << "#include <bits/stdc++.h>\n";
-        std::cout << "using namespace std;\n\n";
-        std::cout << "int main() {\n";
-        ast->generateCode(std::cout);
-        std::cout << "}\n";
+        CompileResult compiled = compile(code, compileOptions);
+        if (!compiled.ok) {
+            std::cerr << "Error: " << compiled.error << std::endl;
+            printTimeReport();
+            return 1;
+        }
+        if (optimize) reportOptimization(compiled.optimization);
 
-        fclose(stdout);
+        if (usePch) {
+            phase("pch");
+            ensureRuntimePch(pchDir, compiler, flags);
+        }
 
-        delete ast;
+        if (emitCpp && !writeCpp(compiled.cpp)) {
+            printTimeReport();
+            return 1;
+        }
 
-        int result = system("g++ output.cpp -o output.exe");
+        PhaseTiming* build = phase(pgoInput.empty() ? "g++" : "g++ pgo");
+        int result = pgoInput.empty()
+            ? compileSource(compiler, compileFlags, compiled.cpp, "output.exe")
+            : buildWithPgo(compiler, compileFlags, compiled.cpp, "output.exe", pgoInput);
+        if (build && result == 0) build->bytes = std::filesystem::file_size("output.exe");
+        if (result == 0 && cache) {
+            phase("cache store");
+            cache->store(cacheKey, "output.exe");
+        }
         if (result != 0) {
             std::cerr << "Error: C++ code compilation failed" << std::endl;
+            printTimeReport();
             return 2;
         } else {
             std::cout << "Code compiled succesfully: output.exe created." << std::endl;
         }
+        printTimeReport();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        printTimeReport();
         return 1;
     }
 }
@@ -0,0 +1,1405 @@
+#include "native.hpp"
+#include "assembler.hpp"
+#include "ranges.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+using namespace x86;
+
+namespace {
+
+constexpr uint64_t kTextAddress = 0x400000;
+constexpr uint64_t kHeaderSize = 64 + 2 * 56;
+
+// Data segment layout. Everything is addressed with absolute 32-bit
+// displacements, so the segment has to stay below 2 GiB.
+constexpr uint32_t kDataAddress = 0x10000000;
+constexpr int32_t kBufferSize = 1 << 16;
+constexpr uint32_t kOutLen = kDataAddress;
+constexpr uint32_t kInPos = kDataAddress + 8;
+constexpr uint32_t kInLen = kDataAddress + 16;
+constexpr uint32_t kHeapPtr = kDataAddress + 24;
+constexpr uint32_t kHeapEnd = kDataAddress + 32;
+constexpr uint32_t kOutBuf = kDataAddress + 64;
+constexpr uint32_t kInBuf = kOutBuf + kBufferSize;
+constexpr uint32_t kSlots = kInBuf + kBufferSize;
+
+constexpr int kSysRead = 0;
+constexpr int kSysWrite = 1;
+constexpr int kSysMmap = 9;
+constexpr int kSysExit = 60;
+
+// Expression temporaries. The runtime routines preserve these (and any
+// variable pinned to r12-r15); rax, rcx, rdx, rsi, rdi and r11 are scratch.
+constexpr Reg kTemporaries[] = {RBX, R8, R9, R10};
+constexpr Reg kVariableRegisters[] = {R12, R13, R14, R15};
+
+// Integers and booleans are held sign-extended to 64 bits, in registers
+// and in variable slots alike, so INTEGER and 64-bit values mix freely.
+// String values are pointers to a 64-bit length followed by the bytes.
+// Literals live in the text segment, everything else on a bump heap that
+// is never freed.
+struct Routines {
+    Label flush, write, putChar, formatInt, printInt, printString;
+    Label alloc, intToString, stringToInt, stringToLong, concat, compare, charAt;
+    Label peek, readInt, readToken, fail, report;
+};
+
+// String literals reach the C++ backend unescaped, so the C++ compiler
+// interprets escape sequences; do the same here.
+std::string unescape(std::string_view text) {
+    std::string result;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\' || i + 1 == text.size()) {
+            result += text[i];
+            continue;
+        }
+        switch (char c = text[++i]) {
+            case 'n': result += '\n'; break;
+            case 't': result += '\t'; break;
+            case 'r': result += '\r'; break;
+            case '0': result += '\0'; break;
+            case 'a': result += '\a'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'v': result += '\v'; break;
+            default: result += c; break;
+        }
+    }
+    return result;
+}
+
+Cond conditionFor(std::string_view op) {
+    if (op == "<") return L;
+    if (op == "<=") return LE;
+    if (op == ">") return G;
+    if (op == ">=") return GE;
+    if (op == "=" || op == "==") return E;
+    return NE;
+}
+
+[[noreturn]] void unsupported(const std::string& what) {
+    throw std::runtime_error("Native backend does not support " + what);
+}
+
+class NativeCompiler {
+    CompilationContext& context;
+    Assembler as;
+    Routines rt;
+    std::map<std::string, Label> literals;
+
+    struct Home {
+        ValueType type;
+        bool inRegister;
+        Reg reg;
+        uint32_t address;
+    };
+    std::unordered_map<uint32_t, Home> homes;
+
+    // An array is a pointer to its elements in row-major order plus the
+    // lower bound and extent of each dimension, all in slots. Elements are
+    // 32-bit, or 64-bit string pointers.
+    struct ArrayHome {
+        ValueType element;
+        uint32_t base;
+        uint32_t bounds;   // lower at bounds + 16 * d, extent 8 bytes after it
+        Label outOfRange, invalidBounds;
+        uint32_t lower(size_t d) const { return bounds + 16 * static_cast<uint32_t>(d); }
+        uint32_t extent(size_t d) const { return lower(d) + 8; }
+    };
+    std::unordered_map<uint32_t, ArrayHome> arrays;
+    // Where a checked operation on each line goes when it overflows.
+    std::map<int, Label> overflows;
+    std::unordered_map<uint32_t, uint64_t> weights;
+    std::vector<uint32_t> order;
+    std::vector<Reg> freeTemporaries;
+    uint32_t slotCount = 0;
+
+public:
+    explicit NativeCompiler(CompilationContext& context) : context(context) {
+        rt = {as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(),
+              as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(),
+              as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel(), as.newLabel()};
+    }
+
+    NativeImage compile(const ProgramNode* program) {
+        // Procedures the optimizer inlined are gone by now.
+        if (!program->subroutines.empty()) unsupported("PROCEDURE and FUNCTION calls; compile without --elf");
+        inferTypes(program, context);
+        chooseIntegerWidths(program, context);
+        countUses(program->statements, 1);
+        assignHomes();
+
+        emitStartup();
+        emitBlock(program->statements);
+        as.call(rt.flush);
+        as.mov(RAX, kSysExit);
+        as.mov(RDI, 0);
+        as.syscall();
+        emitArrayFailures();
+        emitOverflowFailures();
+
+        emitRuntime();
+        emitLiterals();
+        return {as.finish(), kSlots - kDataAddress + uint64_t(slotCount) * 8};
+    }
+
+private:
+    // --- Variables -------------------------------------------------------
+
+    ValueType variableType(uint32_t symbol) const {
+        ValueType type = context.variables.typeOf(symbol);
+        if (type == ValueType::Real) unsupported("REAL variables");
+        return type == ValueType::Unknown ? ValueType::Int : type;
+    }
+
+    // Loop bodies count eight times per nesting level, so the registers go
+    // to the variables that are touched most often at run time.
+    void use(uint32_t symbol, uint64_t weight) {
+        auto [it, added] = weights.emplace(symbol, 0);
+        if (added) order.push_back(symbol);
+        it->second += weight;
+    }
+
+    void countUses(const ExprNode* expr, uint64_t weight) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            use(var->symbol, weight);
+        } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            countUses(unary->operand, weight);
+        } else if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
+            countUses(binary->left, weight);
+            countUses(binary->right, weight);
+        } else if (auto index = dynamic_cast<const IndexExpr*>(expr)) {
+            if (!index->array(context)) countUses(index->base, weight);
+            for (auto i : index->indices) countUses(i, weight);
+        }
+    }
+
+    void countUses(NodeList statements, uint64_t weight) {
+        uint64_t inner = std::min<uint64_t>(weight * 8, 1 << 24);
+        for (auto stmt : statements) {
+            if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+                use(input->symbol, weight);
+            } else if (auto output = dynamic_cast<const OutputNode*>(stmt)) {
+                if (output->type == IDENTIFIER) use(context.symbols.intern(output->value), weight);
+            } else if (auto outputExpr = dynamic_cast<const OutputExprNode*>(stmt)) {
+                countUses(outputExpr->expr, weight);
+            } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+                use(assign->symbol, weight);
+                countUses(assign->expr, weight);
+            } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+                countUses(assign->target, weight);
+                countUses(assign->expr, weight);
+            } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+                for (const auto& bound : declare->bounds) {
+                    countUses(bound.lower, weight);
+                    countUses(bound.upper, weight);
+                }
+            } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+                countUses(ifNode->condition, weight);
+                countUses(ifNode->thenBranch, weight);
+                countUses(ifNode->elseBranch, weight);
+            } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+                countUses(whileNode->condition, inner);
+                countUses(whileNode->body, inner);
+            } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+                countUses(repeat->condition, inner);
+                countUses(repeat->body, inner);
+            } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+                use(forNode->symbol, inner * 3);
+                for (auto bound : {forNode->startExpr, forNode->endExpr, forNode->stepExpr}) countUses(bound, weight);
+                countUses(forNode->body, inner);
+            }
+        }
+    }
+
+    void assignHomes() {
+        std::vector<uint32_t> candidates;
+        for (uint32_t symbol : order) {
+            ValueType type = variableType(symbol);
+            homes[symbol] = {type, false, RAX, kSlots + 8 * slotCount++};
+            if (type != ValueType::String) candidates.push_back(symbol);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [&](uint32_t a, uint32_t b) { return weights[a] > weights[b]; });
+        size_t pinned = std::min(candidates.size(), std::size(kVariableRegisters));
+        for (size_t i = 0; i < pinned; i++) {
+            homes[candidates[i]].inRegister = true;
+            homes[candidates[i]].reg = kVariableRegisters[i];
+        }
+        freeTemporaries.assign(std::begin(kTemporaries), std::end(kTemporaries));
+        for (size_t i = pinned; i < std::size(kVariableRegisters); i++) freeTemporaries.push_back(kVariableRegisters[i]);
+    }
+
+    const Home& home(uint32_t symbol) {
+        auto it = homes.find(symbol);
+        if (it == homes.end()) {
+            it = homes.emplace(symbol, Home{variableType(symbol), false, RAX, kSlots + 8 * slotCount++}).first;
+        }
+        return it->second;
+    }
+
+    void loadVariable(Reg dst, uint32_t symbol) {
+        const Home& h = home(symbol);
+        if (h.inRegister) as.mov(dst, h.reg);
+        else as.load(dst, absolute(h.address));
+    }
+
+    void storeVariable(uint32_t symbol, Reg src) {
+        const Home& h = home(symbol);
+        if (h.inRegister) as.mov(h.reg, src);
+        else as.store(absolute(h.address), src);
+    }
+
+    const ArrayHome& arrayHome(uint32_t symbol) {
+        auto it = arrays.find(symbol);
+        if (it != arrays.end()) return it->second;
+        const ArrayInfo& info = context.arrays.at(symbol);
+        if (info.element == ValueType::Real) unsupported("REAL arrays");
+        ArrayHome array{info.element, kSlots + 8 * slotCount, kSlots + 8 * (slotCount + 1),
+                        as.newLabel(), as.newLabel()};
+        slotCount += 1 + 2 * static_cast<uint32_t>(info.rank);
+        return arrays.emplace(symbol, array).first->second;
+    }
+
+    // --- Expressions -----------------------------------------------------
+
+    Reg allocate() {
+        if (freeTemporaries.empty()) throw std::logic_error("Native backend: out of temporaries");
+        Reg reg = freeTemporaries.back();
+        freeTemporaries.pop_back();
+        return reg;
+    }
+
+    void release(Reg reg) { freeTemporaries.push_back(reg); }
+
+    Label literal(std::string_view text) {
+        std::string bytes = unescape(text);
+        auto it = literals.find(bytes);
+        if (it == literals.end()) it = literals.emplace(bytes, as.newLabel()).first;
+        return it->second;
+    }
+
+    // An INTEGER literal that fits an instruction's 32-bit immediate.
+    static bool constantInt(const ExprNode* expr, long long& value) {
+        auto lit = dynamic_cast<const LiteralExpr*>(expr);
+        if (!lit || lit->literalType() != ValueType::Int) return false;
+        value = std::strtoll(std::string(lit->value).c_str(), nullptr, 10);
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    // Stores reg to a slot no variable uses and releases it.
+    uint32_t spill(Reg reg) {
+        uint32_t slot = kSlots + 8 * slotCount++;
+        as.store(absolute(slot), reg);
+        release(reg);
+        return slot;
+    }
+
+    Reg generate(const ExprNode* expr) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            Reg reg = allocate();
+            loadVariable(reg, var->symbol);
+            return reg;
+        }
+        if (auto lit = dynamic_cast<const LiteralExpr*>(expr)) {
+            Reg reg = allocate();
+            ValueType type = lit->literalType();
+            if (type == ValueType::Real) unsupported("REAL literals");
+            if (type == ValueType::String) as.lea(reg, literal(lit->value));
+            else if (type == ValueType::Bool) as.mov(reg, lit->type == TRUE ? 1 : 0);
+            else as.mov(reg, static_cast<int64_t>(std::strtoll(std::string(lit->value).c_str(), nullptr, 10)));
+            return reg;
+        }
+        if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            if (unary->op != "NOT") {
+                Reg reg = generateAs(unary->operand, ValueType::Long);
+                as.neg(reg);
+                if (checked(unary)) as.jcc(O, overflow(unary));
+                return reg;
+            }
+            Reg reg = generateAs(unary->operand, ValueType::Int);
+            as.test(reg, reg);
+            as.setcc(E, reg);
+            as.movzxByte(reg, reg);
+            return reg;
+        }
+        if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
+            if (isLogicalOperator(binary->op)) return generateLogical(binary);
+            return generateBinary(binary);
+        }
+        if (auto index = dynamic_cast<const IndexExpr*>(expr)) {
+            if (!index->array(context)) return generateIndex(index);
+            Reg address = elementAddress(index);
+            if (index->inferType(context) == ValueType::String) {
+                as.load(address, at(address));
+            } else {
+                as.load(address, at(address), false);
+                as.movsxd(address, address);
+            }
+            return address;
+        }
+        throw std::runtime_error("Native backend: unknown expression " + expr->toString());
+    }
+
+    bool checked(const ExprNode* expr) const {
+        auto width = context.integerOps.find(expr);
+        return width != context.integerOps.end() && width->second == IntegerOp::Checked;
+    }
+
+    Label overflow(const ExprNode* expr) {
+        auto it = overflows.find(expr->position.line);
+        if (it == overflows.end()) it = overflows.emplace(expr->position.line, as.newLabel()).first;
+        return it->second;
+    }
+
+    // Mirrors generateAs: converts only where the inferred types disagree.
+    // A 64-bit value stored into 32 bits is truncated where the range pass
+    // found it fits, and checked where it may not.
+    Reg generateAs(const ExprNode* expr, ValueType want) {
+        ValueType have = expr->inferType(context);
+        if (have == ValueType::Real || want == ValueType::Real) unsupported("REAL values");
+        Reg reg = generate(expr);
+        if (want == ValueType::String && isNumeric(have)) {
+            as.mov(RDI, reg);
+            as.call(rt.intToString);
+            as.mov(reg, RAX);
+        } else if (isNumeric(want) && have == ValueType::String) {
+            as.mov(RDI, reg);
+            as.call(want == ValueType::Long ? rt.stringToLong : rt.stringToInt);
+            as.mov(reg, RAX);
+        } else if (want == ValueType::Int && have == ValueType::Long && !context.integerOps.count(expr)) {
+            as.movsxd(reg, reg);
+        } else if (want == ValueType::Int && have == ValueType::Long) {
+            as.movsxd(RCX, reg);
+            as.alu(CMP, RCX, reg);
+            as.jcc(NE, overflow(expr));
+        }
+        return reg;
+    }
+
+    // Evaluates both operands. When the left value would hold the last free
+    // temporary it is parked on the stack and comes back in rax.
+    std::pair<Reg, Reg> generateOperands(const ExprNode* left, ValueType leftType,
+                                         const ExprNode* right, ValueType rightType) {
+        Reg lhs = generateAs(left, leftType);
+        bool spilled = freeTemporaries.empty();
+        if (spilled) {
+            as.push(lhs);
+            release(lhs);
+        }
+        Reg rhs = generateAs(right, rightType);
+        if (spilled) {
+            as.pop(RAX);
+            lhs = RAX;
+        }
+        return {lhs, rhs};
+    }
+
+    // The result goes to lhs unless lhs is the spill register.
+    Reg finishOperands(Reg lhs, Reg rhs, Reg value) {
+        Reg result = lhs == RAX ? rhs : lhs;
+        if (value != result) as.mov(result, value);
+        if (result != rhs) release(rhs);
+        return result;
+    }
+
+    Reg generateBinary(const BinaryExpr* binary) {
+        std::string_view op = binary->op;
+        ValueType operandType = binary->inferType(context);
+        bool comparison = isComparisonOperator(op);
+        if (comparison) {
+            ValueType l = binary->left->inferType(context);
+            ValueType r = binary->right->inferType(context);
+            if (l == ValueType::String && r == ValueType::String) operandType = ValueType::String;
+            else if (l == ValueType::Real || r == ValueType::Real) operandType = ValueType::Real;
+            else if (l == ValueType::Long || r == ValueType::Long) operandType = ValueType::Long;
+            else operandType = ValueType::Int;
+        }
+        if (operandType == ValueType::Real) unsupported("REAL arithmetic");
+
+        auto [lhs, rhs] = generateOperands(binary->left, operandType, binary->right, operandType);
+        if (operandType == ValueType::String) {
+            as.mov(RDI, lhs);
+            as.mov(RSI, rhs);
+            if (comparison) {
+                as.call(rt.compare);
+                as.test(RAX, RAX, false);
+                as.setcc(conditionFor(op), RAX);
+                as.movzxByte(RAX, RAX);
+            } else {
+                as.call(rt.concat);
+            }
+            return finishOperands(lhs, rhs, RAX);
+        }
+
+        // Sums and products are 64-bit, which changes nothing for the ones
+        // the range pass kept in 32 bits. Division stays 32-bit where it
+        // can, being the slower instruction.
+        if (comparison) {
+            as.alu(CMP, lhs, rhs);
+            as.setcc(conditionFor(op), lhs);
+            as.movzxByte(lhs, lhs);
+        } else if (op == "+") {
+            as.alu(ADD, lhs, rhs);
+        } else if (op == "-") {
+            as.alu(SUB, lhs, rhs);
+        } else if (op == "*") {
+            as.imul(lhs, rhs);
+        } else if (op == "/" || op == "%") {
+            bool wide = operandType == ValueType::Long;
+            if (checked(binary)) {
+                Label fits = as.newLabel();
+                as.alu(CMP, rhs, -1);
+                as.jcc(NE, fits);
+                as.mov(RCX, INT64_MIN);
+                as.alu(CMP, lhs, RCX);
+                as.jcc(E, overflow(binary));
+                as.bind(fits);
+            }
+            if (lhs != RAX) as.mov(RAX, lhs);
+            if (wide) as.cqo();
+            else as.cdq();
+            as.idiv(rhs, wide);
+            Reg value = op == "/" ? RAX : RDX;
+            if (wide) as.mov(lhs, value);
+            else as.movsxd(lhs, value);
+        } else {
+            unsupported("operator " + std::string(op));
+        }
+        if (checked(binary) && (op == "+" || op == "-" || op == "*")) as.jcc(O, overflow(binary));
+        return finishOperands(lhs, rhs, lhs);
+    }
+
+    // The right operand only runs when the left one leaves the result open.
+    // Either way the 0 or 1 ends up in the register the right operand was
+    // computed in.
+    Reg generateLogical(const BinaryExpr* binary) {
+        bool isAnd = binary->op == "AND";
+        Reg lhs = generateAs(binary->left, ValueType::Int);
+        as.test(lhs, lhs);
+        release(lhs);
+        Label decided = as.newLabel(), done = as.newLabel();
+        as.jcc(isAnd ? E : NE, decided);
+        Reg rhs = generateAs(binary->right, ValueType::Int);
+        as.test(rhs, rhs);
+        as.setcc(NE, rhs);
+        as.movzxByte(rhs, rhs);
+        as.jmp(done);
+        as.bind(decided);
+        as.mov(rhs, isAnd ? 0 : 1);
+        as.bind(done);
+        return rhs;
+    }
+
+    Reg generateIndex(const IndexExpr* index) {
+        if (index->base->inferType(context) != ValueType::String) unsupported("indexing a number");
+        auto [lhs, rhs] = generateOperands(index->base, ValueType::String, index->indices[0], ValueType::Int);
+        as.mov(RDI, lhs);
+        as.mov(RSI, rhs, false);
+        as.call(rt.charAt);
+        return finishOperands(lhs, rhs, RAX);
+    }
+
+    // The address of an array element. Each index has the lower bound taken
+    // off in 32 bits, so one unsigned compare against the extent catches
+    // both ends, and the zero-extended result is the 64-bit offset.
+    Reg elementAddress(const IndexExpr* index) {
+        const ArrayHome& array = arrayHome(static_cast<const VariableExpr*>(index->base)->symbol);
+        Reg offset = RAX;
+        for (size_t d = 0; d < index->indices.size(); d++) {
+            bool spilled = d > 0 && freeTemporaries.empty();
+            if (spilled) {
+                as.push(offset);
+                release(offset);
+            }
+            Reg value = generateAs(index->indices[d], ValueType::Int);
+            as.alu(SUB, value, absolute(array.lower(d)), false);
+            if (index->checked) {
+                as.alu(CMP, value, absolute(array.extent(d)), false);
+                as.jcc(AE, array.outOfRange);
+            }
+            if (d == 0) {
+                offset = value;
+                continue;
+            }
+            if (spilled) {
+                as.pop(RAX);
+                offset = RAX;
+            }
+            as.load(RCX, absolute(array.extent(d)));
+            as.imul(offset, RCX);
+            as.alu(ADD, offset, value);
+            if (offset == RAX) {
+                as.mov(value, RAX);
+                offset = value;
+            } else {
+                release(value);
+            }
+        }
+        as.shl(offset, array.element == ValueType::String ? 3 : 2);
+        as.alu(ADD, offset, absolute(array.base));
+        return offset;
+    }
+
+    void generateCondition(const ExprNode* condition, Label whenFalse) {
+        if (condition->inferType(context) == ValueType::String) unsupported("a STRING used as a condition");
+        Reg reg = generateAs(condition, ValueType::Int);
+        as.test(reg, reg);
+        as.jcc(E, whenFalse);
+        release(reg);
+    }
+
+    void print(Reg reg, ValueType type) {
+        if (type == ValueType::String) {
+            as.mov(RDI, reg);
+            as.call(rt.printString);
+        } else {
+            as.mov(RDI, reg);
+            as.call(rt.printInt);
+        }
+    }
+
+    // --- Statements ------------------------------------------------------
+
+    void emitBlock(NodeList statements) {
+        for (auto stmt : statements) emitStatement(stmt);
+    }
+
+    void emitStatement(const ASTNode* stmt) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            ValueType type = home(input->symbol).type;
+            if (type == ValueType::String) {
+                as.call(rt.readToken);
+            } else {
+                as.call(rt.readInt);
+                if (type == ValueType::Bool) {
+                    as.test(RAX, RAX);
+                    as.setcc(NE, RAX);
+                    as.movzxByte(RAX, RAX);
+                } else if (type == ValueType::Int) {
+                    as.movsxd(RCX, RAX);
+                    as.alu(CMP, RCX, RAX);
+                    as.lea(RDI, literal("Runtime error: integer overflow reading input\\n"));
+                    as.jcc(NE, rt.report);
+                }
+            }
+            storeVariable(input->symbol, RAX);
+        } else if (auto output = dynamic_cast<const OutputNode*>(stmt)) {
+            Reg reg = allocate();
+            ValueType type = ValueType::Int;
+            if (output->type == STRING) {
+                as.lea(reg, literal(output->value));
+                type = ValueType::String;
+            } else if (output->type == IDENTIFIER) {
+                uint32_t symbol = context.symbols.intern(output->value);
+                loadVariable(reg, symbol);
+                type = home(symbol).type;
+            } else {
+                as.mov(reg, static_cast<int64_t>(std::strtoll(std::string(output->value).c_str(), nullptr, 10)));
+            }
+            print(reg, type);
+            release(reg);
+        } else if (auto outputExpr = dynamic_cast<const OutputExprNode*>(stmt)) {
+            ValueType type = outputExpr->expr->inferType(context);
+            if (type == ValueType::Unknown) unsupported("printing " + outputExpr->expr->toString());
+            Reg reg = generate(outputExpr->expr);
+            print(reg, type);
+            release(reg);
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            Reg reg = generateAs(assign->expr, home(assign->symbol).type);
+            storeVariable(assign->symbol, reg);
+            release(reg);
+        } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            // The value first, as C++17 evaluates an assignment.
+            ValueType type = assign->target->inferType(context);
+            Reg value = generateAs(assign->expr, type);
+            Reg address = elementAddress(assign->target);
+            as.store(at(address), value, type == ValueType::String);
+            release(address);
+            release(value);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            emitDeclare(declare);
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            Label elseLabel = as.newLabel(), end = as.newLabel();
+            generateCondition(ifNode->condition, elseLabel);
+            emitBlock(ifNode->thenBranch);
+            if (!ifNode->elseBranch.empty()) as.jmp(end);
+            as.bind(elseLabel);
+            emitBlock(ifNode->elseBranch);
+            as.bind(end);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            Label top = as.newLabel(), end = as.newLabel();
+            as.bind(top);
+            generateCondition(whileNode->condition, end);
+            emitBlock(whileNode->body);
+            as.jmp(top);
+            as.bind(end);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            Label top = as.newLabel();
+            as.bind(top);
+            emitBlock(repeat->body);
+            generateCondition(repeat->condition, top);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            ValueType type = home(forNode->symbol).type;
+            if (type == ValueType::String) unsupported("a STRING loop counter");
+            // Like the C++ loop: the end and a non-literal step are evaluated
+            // once into slots of their own, literal ones become immediates.
+            Label top = as.newLabel(), body = as.newLabel(), end = as.newLabel();
+            long long endValue = 0, stepValue = 0;
+            bool endConstant = constantInt(forNode->endExpr, endValue);
+            bool stepConstant = constantInt(forNode->stepExpr, stepValue);
+            uint32_t endSlot = endConstant ? 0 : spill(generateAs(forNode->endExpr, type));
+            uint32_t stepSlot = stepConstant ? 0 : spill(generateAs(forNode->stepExpr, type));
+            Reg start = generateAs(forNode->startExpr, type);
+            storeVariable(forNode->symbol, start);
+            release(start);
+
+            as.bind(top);
+            Reg counter = allocate();
+            loadVariable(counter, forNode->symbol);
+            auto compareWithEnd = [&] {
+                if (endConstant) as.alu(CMP, counter, static_cast<int32_t>(endValue));
+                else as.alu(CMP, counter, absolute(endSlot));
+            };
+            if (!stepConstant) {
+                Label descending = as.newLabel();
+                Reg step = allocate();
+                as.load(step, absolute(stepSlot));
+                as.test(step, step);
+                release(step);
+                as.jcc(S, descending);
+                compareWithEnd();
+                as.jcc(G, end);
+                as.jmp(body);
+                as.bind(descending);
+            }
+            compareWithEnd();
+            as.jcc(stepConstant && stepValue >= 0 ? G : L, end);
+            release(counter);
+            as.bind(body);
+            emitBlock(forNode->body);
+            counter = allocate();
+            loadVariable(counter, forNode->symbol);
+            if (stepConstant) as.alu(ADD, counter, static_cast<int32_t>(stepValue));
+            else as.alu(ADD, counter, absolute(stepSlot));
+            storeVariable(forNode->symbol, counter);
+            release(counter);
+            as.jmp(top);
+            as.bind(end);
+        } else {
+            throw std::runtime_error("Native backend: unknown statement");
+        }
+    }
+
+    // Fixes the bounds and points the array at fresh heap memory. The heap
+    // is never reused, so new elements are already zero; strings are then
+    // set to the empty string.
+    void emitDeclare(const DeclareNode* declare) {
+        const ArrayHome& array = arrayHome(declare->symbol);
+        for (size_t d = 0; d < declare->bounds.size(); d++) {
+            Reg lower = generateAs(declare->bounds[d].lower, ValueType::Int);
+            as.store(absolute(array.lower(d)), lower, false);
+            release(lower);
+            Reg extent = generateAs(declare->bounds[d].upper, ValueType::Int);
+            as.alu(SUB, extent, absolute(array.lower(d)), false);
+            as.alu(ADD, extent, 1, false);
+            as.jcc(S, array.invalidBounds);
+            as.store(absolute(array.extent(d)), extent);
+            release(extent);
+        }
+        bool isString = array.element == ValueType::String;
+        Reg bytes = allocate();
+        as.mov(bytes, isString ? 8 : 4);
+        for (size_t d = 0; d < declare->bounds.size(); d++) {
+            as.load(RCX, absolute(array.extent(d)));
+            as.imul(bytes, RCX);
+        }
+        as.mov(RDI, bytes);
+        as.call(rt.alloc);
+        as.store(absolute(array.base), RAX);
+        if (isString) {
+            Label loop = as.newLabel(), done = as.newLabel();
+            as.lea(RDX, literal(""));
+            as.mov(RCX, bytes);
+            as.shr(RCX, 3);
+            as.bind(loop);
+            as.test(RCX, RCX);
+            as.jcc(E, done);
+            as.store(at(RAX), RDX);
+            as.alu(ADD, RAX, 8);
+            as.alu(SUB, RCX, 1);
+            as.jmp(loop);
+            as.bind(done);
+        }
+        release(bytes);
+    }
+
+    void emitArrayFailures() {
+        for (const auto& [symbol, array] : arrays) {
+            std::string name(context.symbols.name(symbol));
+            Label report = as.newLabel();
+            as.bind(array.outOfRange);
+            as.lea(RDI, literal("Runtime error: index out of range for array " + name + "\\n"));
+            as.jmp(report);
+            as.bind(array.invalidBounds);
+            as.lea(RDI, literal("Runtime error: invalid bounds for array " + name + "\\n"));
+            // Unlike other failures these flush first, as the C++ runtime does.
+            as.bind(report);
+            as.push(RDI);
+            as.call(rt.flush);
+            as.pop(RDI);
+            as.jmp(rt.fail);
+        }
+    }
+
+    void emitOverflowFailures() {
+        for (const auto& [line, label] : overflows) {
+            std::string where = line > 0 ? " on line " + std::to_string(line) : "";
+            as.bind(label);
+            as.lea(RDI, literal("Runtime error: integer overflow" + where + "\\n"));
+            as.jmp(rt.report);
+        }
+    }
+
+    // --- Runtime ---------------------------------------------------------
+
+    // Reserves the heap and gives string variables the empty string. Tries
+    // smaller reservations where the kernel refuses overcommit.
+    void emitStartup() {
+        Label retry = as.newLabel(), mapped = as.newLabel(), noMemory = as.newLabel();
+        as.mov(RSI, int64_t(1) << 35);
+        as.bind(retry);
+        as.mov(RAX, kSysMmap);
+        as.mov(RDI, 0);
+        as.mov(RDX, 3);                 // PROT_READ | PROT_WRITE
+        as.mov(R10, 0x4022);            // MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+        as.mov(R8, -1);
+        as.mov(R9, 0);
+        as.syscall();
+        as.test(RAX, RAX);
+        as.jcc(NS, mapped);
+        as.shr(RSI, 1);
+        as.alu(CMP, RSI, 1 << 20);
+        as.jcc(AE, retry);
+        as.jmp(noMemory);
+        as.bind(mapped);
+        as.store(absolute(kHeapPtr), RAX);
+        as.alu(ADD, RAX, RSI);
+        as.store(absolute(kHeapEnd), RAX);
+
+        as.lea(RAX, literal(""));
+        for (uint32_t symbol : order) {
+            const Home& h = homes[symbol];
+            if (h.type == ValueType::String) as.store(absolute(h.address), RAX);
+        }
+        Label begin = as.newLabel();
+        as.jmp(begin);
+        as.bind(noMemory);
+        as.lea(RDI, literal("Runtime error: out of memory\\n"));
+        as.jmp(rt.fail);
+        as.bind(begin);
+    }
+
+    void emitRuntime() {
+        emitOutput();
+        emitStrings();
+        emitInput();
+
+        // report(rdi = message): fail after flushing the output, as the C++
+        // runtime's own failures do.
+        as.bind(rt.report);
+        as.push(RDI);
+        as.call(rt.flush);
+        as.pop(RDI);
+
+        // fail(rdi = message): report on stderr and exit without flushing,
+        // like an uncaught exception in the C++ build.
+        as.bind(rt.fail);
+        as.load(RDX, at(RDI));
+        as.lea(RSI, at(RDI, 8));
+        as.mov(RDI, 2);
+        as.mov(RAX, kSysWrite);
+        as.syscall();
+        as.mov(RAX, kSysExit);
+        as.mov(RDI, 1);
+        as.syscall();
+    }
+
+    void emitOutput() {
+        // flush(): writes out the output buffer.
+        {
+            Label loop = as.newLabel(), reset = as.newLabel(), done = as.newLabel();
+            as.bind(rt.flush);
+            as.load(RDX, absolute(kOutLen));
+            as.test(RDX, RDX);
+            as.jcc(E, done);
+            as.mov(RSI, kOutBuf);
+            as.bind(loop);
+            as.mov(RDI, 1);
+            as.mov(RAX, kSysWrite);
+            as.syscall();
+            as.test(RAX, RAX);
+            as.jcc(LE, reset);
+            as.alu(ADD, RSI, RAX);
+            as.alu(SUB, RDX, RAX);
+            as.jcc(NE, loop);
+            as.bind(reset);
+            as.storeImm(absolute(kOutLen), 0);
+            as.bind(done);
+            as.ret();
+        }
+
+        // write(rdi = bytes, rsi = length): copies into the buffer in chunks.
+        {
+            Label loop = as.newLabel(), room = as.newLabel(), done = as.newLabel();
+            as.bind(rt.write);
+            as.mov(RDX, RSI);
+            as.mov(RSI, RDI);
+            as.bind(loop);
+            as.test(RDX, RDX);
+            as.jcc(E, done);
+            as.load(RAX, absolute(kOutLen));
+            as.alu(CMP, RAX, kBufferSize);
+            as.jcc(B, room);
+            as.push(RSI);
+            as.push(RDX);
+            as.call(rt.flush);
+            as.pop(RDX);
+            as.pop(RSI);
+            as.mov(RAX, 0);
+            as.bind(room);
+            as.mov(RCX, kBufferSize);
+            as.alu(SUB, RCX, RAX);
+            as.alu(CMP, RCX, RDX);
+            as.cmov(A, RCX, RDX);
+            as.alu(SUB, RDX, RCX);
+            as.lea(RDI, at(RAX, kOutBuf));
+            as.alu(ADD, RAX, RCX);
+            as.store(absolute(kOutLen), RAX);
+            as.repMovsb();
+            as.jmp(loop);
+            as.bind(done);
+            as.ret();
+        }
+
+        // putChar(dil)
+        {
+            Label room = as.newLabel();
+            as.bind(rt.putChar);
+            as.load(RAX, absolute(kOutLen));
+            as.alu(CMP, RAX, kBufferSize);
+            as.jcc(B, room);
+            as.push(RDI);
+            as.call(rt.flush);
+            as.pop(RDI);
+            as.mov(RAX, 0);
+            as.bind(room);
+            as.storeByte(at(RAX, kOutBuf), RDI);
+            as.alu(ADD, RAX, 1);
+            as.store(absolute(kOutLen), RAX);
+            as.ret();
+        }
+
+        // formatInt(rdi = value, rsi = end of buffer) -> rsi = first digit.
+        // The magnitude is divided unsigned, so the most negative value
+        // comes out right too.
+        {
+            Label positive = as.newLabel(), loop = as.newLabel(), done = as.newLabel();
+            as.bind(rt.formatInt);
+            as.mov(RAX, RDI);
+            as.test(RAX, RAX);
+            as.jcc(NS, positive);
+            as.neg(RAX);
+            as.bind(positive);
+            as.mov(RCX, 10);
+            as.bind(loop);
+            as.mov(RDX, 0);
+            as.div(RCX);
+            as.alu(ADD, RDX, '0', false);
+            as.alu(SUB, RSI, 1);
+            as.storeByte(at(RSI), RDX);
+            as.test(RAX, RAX);
+            as.jcc(NE, loop);
+            as.test(RDI, RDI);
+            as.jcc(NS, done);
+            as.alu(SUB, RSI, 1);
+            as.storeByteImm(at(RSI), '-');
+            as.bind(done);
+            as.ret();
+        }
+
+        // printInt(rdi): the value and a newline, without allocating.
+        as.bind(rt.printInt);
+        as.alu(SUB, RSP, 32);
+        as.lea(RSI, at(RSP, 32));
+        as.call(rt.formatInt);
+        as.lea(RDX, at(RSP, 32));
+        as.alu(SUB, RDX, RSI);
+        as.mov(RDI, RSI);
+        as.mov(RSI, RDX);
+        as.call(rt.write);
+        as.alu(ADD, RSP, 32);
+        as.mov(RDI, '\n');
+        as.jmp(rt.putChar);
+
+        // printString(rdi = string)
+        as.bind(rt.printString);
+        as.load(RSI, at(RDI));
+        as.alu(ADD, RDI, 8);
+        as.call(rt.write);
+        as.mov(RDI, '\n');
+        as.jmp(rt.putChar);
+    }
+
+    void emitStrings() {
+        // alloc(rdi = bytes) -> rax; clobbers rdx and rdi only.
+        {
+            Label full = as.newLabel();
+            as.bind(rt.alloc);
+            as.load(RAX, absolute(kHeapPtr));
+            as.alu(ADD, RDI, 7);
+            as.alu(AluOp::AND, RDI, -8);
+            as.mov(RDX, RAX);
+            as.alu(ADD, RDX, RDI);
+            as.alu(CMP, RDX, absolute(kHeapEnd));
+            as.jcc(A, full);
+            as.store(absolute(kHeapPtr), RDX);
+            as.ret();
+            as.bind(full);
+            as.lea(RDI, literal("Runtime error: out of memory\\n"));
+            as.jmp(rt.fail);
+        }
+
+        // intToString(rdi) -> rax, like std::to_string.
+        as.bind(rt.intToString);
+        as.alu(SUB, RSP, 32);
+        as.lea(RSI, at(RSP, 32));
+        as.call(rt.formatInt);
+        as.lea(RDX, at(RSP, 32));
+        as.alu(SUB, RDX, RSI);
+        as.push(RSI);
+        as.push(RDX);
+        as.lea(RDI, at(RDX, 8));
+        as.call(rt.alloc);
+        as.pop(RCX);
+        as.pop(RSI);
+        as.store(at(RAX), RCX);
+        as.lea(RDI, at(RAX, 8));
+        as.repMovsb();
+        as.alu(ADD, RSP, 32);
+        as.ret();
+
+        // stringToInt(rdi = string) -> rax, like std::stoi: leading space,
+        // a sign and at least one digit; anything after the digits is ignored.
+        // stringToLong is the same up to 64 bits, like std::stoll. Either
+        // keeps the largest value it allows in rbx.
+        {
+            Label space = as.newLabel(), skip = as.newLabel(), sign = as.newLabel(), plus = as.newLabel();
+            Label consume = as.newLabel(), digits = as.newLabel(), loop = as.newLabel(), end = as.newLabel();
+            Label positive = as.newLabel(), done = as.newLabel(), invalid = as.newLabel(), range = as.newLabel();
+            Label start = as.newLabel();
+            as.bind(rt.stringToInt);
+            as.push(RBX);
+            as.mov(RBX, INT32_MAX);
+            as.jmp(start);
+            as.bind(rt.stringToLong);
+            as.push(RBX);
+            as.mov(RBX, INT64_MAX);
+            as.bind(start);
+            as.load(RCX, at(RDI));
+            as.alu(ADD, RDI, 8);
+            as.bind(space);
+            as.test(RCX, RCX);
+            as.jcc(E, invalid);
+            as.loadByte(RAX, at(RDI));
+            as.alu(CMP, RAX, ' ', false);
+            as.jcc(E, skip);
+            as.alu(CMP, RAX, '\t', false);
+            as.jcc(B, sign);
+            as.alu(CMP, RAX, '\r', false);
+            as.jcc(A, sign);
+            as.bind(skip);
+            as.alu(ADD, RDI, 1);
+            as.alu(SUB, RCX, 1);
+            as.jmp(space);
+            as.bind(sign);
+            as.mov(RSI, 0);
+            as.alu(CMP, RAX, '-', false);
+            as.jcc(NE, plus);
+            as.mov(RSI, 1);
+            as.jmp(consume);
+            as.bind(plus);
+            as.alu(CMP, RAX, '+', false);
+            as.jcc(NE, digits);
+            as.bind(consume);
+            as.alu(ADD, RDI, 1);
+            as.alu(SUB, RCX, 1);
+            as.bind(digits);
+            as.test(RCX, RCX);
+            as.jcc(E, invalid);
+            as.loadByte(RAX, at(RDI));
+            as.alu(SUB, RAX, '0', false);
+            as.alu(CMP, RAX, 9, false);
+            as.jcc(A, invalid);
+            as.mov(R11, 0);
+            as.bind(loop);
+            as.test(RCX, RCX);
+            as.jcc(E, end);
+            as.loadByte(RAX, at(RDI));
+            as.alu(SUB, RAX, '0', false);
+            as.alu(CMP, RAX, 9, false);
+            as.jcc(A, end);
+            // The magnitude stays at most one past the largest value, so
+            // ten times it plus a digit never wraps.
+            as.mov(RDX, INT64_MAX / 10);
+            as.alu(CMP, R11, RDX);
+            as.jcc(A, range);
+            as.imulImm(R11, R11, 10);
+            as.alu(ADD, R11, RAX);
+            as.lea(RDX, at(RBX, 1));
+            as.alu(CMP, R11, RDX);
+            as.jcc(A, range);
+            as.alu(ADD, RDI, 1);
+            as.alu(SUB, RCX, 1);
+            as.jmp(loop);
+            as.bind(end);
+            as.test(RSI, RSI);
+            as.jcc(E, positive);
+            as.neg(R11);
+            as.jmp(done);
+            as.bind(positive);
+            as.alu(CMP, R11, RBX);
+            as.jcc(A, range);
+            as.bind(done);
+            as.mov(RAX, R11);
+            as.pop(RBX);
+            as.ret();
+            for (auto [failure, what] : {std::pair{invalid, "invalid number"}, {range, "number out of range"}}) {
+                std::string message = "Runtime error: " + std::string(what) + " for ";
+                as.bind(failure);
+                as.lea(RDI, literal(message + "stoll\\n"));
+                as.alu(CMP, RBX, INT32_MAX);
+                as.jcc(NE, rt.fail);
+                as.lea(RDI, literal(message + "stoi\\n"));
+                as.jmp(rt.fail);
+            }
+        }
+
+        // concat(rdi, rsi) -> rax
+        as.bind(rt.concat);
+        as.push(RDI);
+        as.push(RSI);
+        as.load(RDI, at(RDI));
+        as.alu(ADD, RDI, at(RSI));
+        as.push(RDI);
+        as.alu(ADD, RDI, 8);
+        as.call(rt.alloc);
+        as.pop(RDX);
+        as.store(at(RAX), RDX);
+        as.pop(R11);
+        as.pop(RSI);
+        as.lea(RDI, at(RAX, 8));
+        as.load(RCX, at(RSI));
+        as.alu(ADD, RSI, 8);
+        as.repMovsb();
+        as.mov(RSI, R11);
+        as.load(RCX, at(RSI));
+        as.alu(ADD, RSI, 8);
+        as.repMovsb();
+        as.ret();
+
+        // compare(rdi, rsi) -> eax < 0, 0 or > 0, bytewise unsigned like
+        // std::string::compare.
+        {
+            Label loop = as.newLabel(), differ = as.newLabel(), lengths = as.newLabel();
+            Label less = as.newLabel(), greater = as.newLabel();
+            as.bind(rt.compare);
+            as.load(RCX, at(RDI));
+            as.load(RDX, at(RSI));
+            as.mov(R11, RCX);
+            as.alu(CMP, R11, RDX);
+            as.cmov(A, R11, RDX);
+            as.alu(ADD, RDI, 8);
+            as.alu(ADD, RSI, 8);
+            as.bind(loop);
+            as.test(R11, R11);
+            as.jcc(E, lengths);
+            as.loadByte(RAX, at(RDI));
+            as.cmpByte(RAX, at(RSI));
+            as.jcc(NE, differ);
+            as.alu(ADD, RDI, 1);
+            as.alu(ADD, RSI, 1);
+            as.alu(SUB, R11, 1);
+            as.jmp(loop);
+            as.bind(differ);
+            as.jcc(B, less);
+            as.jmp(greater);
+            as.bind(lengths);
+            as.alu(CMP, RCX, RDX);
+            as.jcc(B, less);
+            as.jcc(A, greater);
+            as.mov(RAX, 0);
+            as.ret();
+            as.bind(less);
+            as.mov(RAX, -1);
+            as.ret();
+            as.bind(greater);
+            as.mov(RAX, 1);
+            as.ret();
+        }
+
+        // charAt(rdi = string, esi = index) -> rax. Index == length reads
+        // the terminator, as std::string does.
+        {
+            Label make = as.newLabel(), bad = as.newLabel();
+            as.bind(rt.charAt);
+            as.movsxd(RSI, RSI);
+            as.test(RSI, RSI);
+            as.jcc(S, bad);
+            as.load(RCX, at(RDI));
+            as.alu(CMP, RSI, RCX);
+            as.jcc(A, bad);
+            as.mov(RCX, 0);
+            as.jcc(E, make);
+            as.alu(ADD, RDI, RSI);
+            as.loadByte(RCX, at(RDI, 8));
+            as.bind(make);
+            as.mov(RDI, 9);
+            as.call(rt.alloc);
+            as.storeImm(at(RAX), 1);
+            as.storeByte(at(RAX, 8), RCX);
+            as.ret();
+            as.bind(bad);
+            as.lea(RDI, literal("Runtime error: string index out of range\\n"));
+            as.jmp(rt.fail);
+        }
+    }
+
+    // Jumps to target when eax holds a whitespace character, as the C++
+    // runtime's reader defines it.
+    void jumpIfSpace(Label target) {
+        for (int c : {' ', '\n', '\r', '\t'}) {
+            as.alu(CMP, RAX, c, false);
+            as.jcc(E, target);
+        }
+    }
+
+    void emitInput() {
+        // peek() -> eax, the next input byte or -1 at end of input. Output
+        // is flushed before blocking so prompts appear.
+        {
+            Label have = as.newLabel(), got = as.newLabel();
+            as.bind(rt.peek);
+            as.load(RAX, absolute(kInPos));
+            as.alu(CMP, RAX, absolute(kInLen));
+            as.jcc(B, have);
+            as.call(rt.flush);
+            as.mov(RAX, kSysRead);
+            as.mov(RDI, 0);
+            as.mov(RSI, kInBuf);
+            as.mov(RDX, kBufferSize);
+            as.syscall();
+            as.storeImm(absolute(kInPos), 0);
+            as.test(RAX, RAX);
+            as.jcc(G, got);
+            as.storeImm(absolute(kInLen), 0);
+            as.mov(RAX, -1);
+            as.ret();
+            as.bind(got);
+            as.store(absolute(kInLen), RAX);
+            as.mov(RAX, 0);
+            as.bind(have);
+            as.loadByte(RAX, at(RAX, kInBuf));
+            as.ret();
+        }
+
+        // readInt() -> rax: optional sign and digits, failing like the C++
+        // runtime's read when there are no digits or the number does not
+        // fit in 64 bits.
+        {
+            Label space = as.newLabel(), advance = as.newLabel(), sign = as.newLabel(), plus = as.newLabel();
+            Label consume = as.newLabel(), digits = as.newLabel(), loop = as.newLabel(), done = as.newLabel();
+            Label positive = as.newLabel(), overflow = as.newLabel(), missing = as.newLabel();
+            as.bind(rt.readInt);
+            as.push(RBX);
+            as.push(R12);
+            as.bind(space);
+            as.call(rt.peek);
+            jumpIfSpace(advance);
+            as.jmp(sign);
+            as.bind(advance);
+            as.incMem(absolute(kInPos));
+            as.jmp(space);
+            as.bind(sign);
+            as.mov(R12, 0);
+            as.alu(CMP, RAX, '-', false);
+            as.jcc(NE, plus);
+            as.mov(R12, 1);
+            as.jmp(consume);
+            as.bind(plus);
+            as.alu(CMP, RAX, '+', false);
+            as.jcc(NE, digits);
+            as.bind(consume);
+            as.incMem(absolute(kInPos));
+            as.call(rt.peek);
+            as.bind(digits);
+            as.lea(RCX, at(RAX, -'0'));
+            as.alu(CMP, RCX, 9, false);
+            as.jcc(A, missing);
+            as.mov(RBX, 0);
+            as.bind(loop);
+            as.alu(SUB, RAX, '0', false);
+            as.alu(CMP, RAX, 9, false);
+            as.jcc(A, done);
+            // The magnitude may reach one past the largest value only for a
+            // negative number.
+            as.mov(RCX, INT64_MAX / 10);
+            as.alu(CMP, RBX, RCX);
+            as.jcc(A, overflow);
+            as.imulImm(RBX, RBX, 10);
+            as.alu(ADD, RBX, RAX);
+            as.mov(RCX, INT64_MAX);
+            as.alu(ADD, RCX, R12);
+            as.alu(CMP, RBX, RCX);
+            as.jcc(A, overflow);
+            as.incMem(absolute(kInPos));
+            as.call(rt.peek);
+            as.jmp(loop);
+            as.bind(done);
+            as.test(R12, R12);
+            as.jcc(E, positive);
+            as.neg(RBX);
+            as.bind(positive);
+            as.mov(RAX, RBX);
+            as.pop(R12);
+            as.pop(RBX);
+            as.ret();
+            as.bind(overflow);
+            as.lea(RDI, literal("Runtime error: integer overflow reading input\\n"));
+            as.jmp(rt.report);
+            as.bind(missing);
+            as.lea(RDI, literal("Runtime error: no integer in input\\n"));
+            as.jmp(rt.report);
+        }
+
+        // readToken() -> rax: the next whitespace-delimited word, built in
+        // place at the top of the heap.
+        {
+            Label space = as.newLabel(), advance = as.newLabel(), start = as.newLabel(), loop = as.newLabel();
+            Label end = as.newLabel(), full = as.newLabel();
+            as.bind(rt.readToken);
+            as.push(RBX);
+            as.push(R12);
+            as.bind(space);
+            as.call(rt.peek);
+            jumpIfSpace(advance);
+            as.jmp(start);
+            as.bind(advance);
+            as.incMem(absolute(kInPos));
+            as.jmp(space);
+            as.bind(start);
+            as.load(RBX, absolute(kHeapPtr));
+            as.mov(R12, 0);
+            as.bind(loop);
+            as.alu(CMP, RAX, -1, false);
+            as.jcc(E, end);
+            jumpIfSpace(end);
+            as.mov(RCX, RBX);
+            as.alu(ADD, RCX, R12);
+            as.alu(ADD, RCX, 9);
+            as.alu(CMP, RCX, absolute(kHeapEnd));
+            as.jcc(A, full);
+            as.storeByte(at(RCX, -1), RAX);
+            as.alu(ADD, R12, 1);
+            as.incMem(absolute(kInPos));
+            as.call(rt.peek);
+            as.jmp(loop);
+            as.bind(end);
+            as.store(at(RBX), R12);
+            as.lea(RDI, at(R12, 8));
+            as.call(rt.alloc);
+            as.mov(RAX, RBX);
+            as.pop(R12);
+            as.pop(RBX);
+            as.ret();
+            as.bind(full);
+            as.lea(RDI, literal("Runtime error: out of memory\\n"));
+            as.jmp(rt.fail);
+        }
+    }
+
+    void emitLiterals() {
+        for (auto& [bytes, label] : literals) {
+            as.align(8);
+            as.bind(label);
+            as.u64(bytes.size());
+            for (char c : bytes) as.byte(static_cast<uint8_t>(c));
+        }
+    }
+};
+
+void put(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+}
+
+NativeImage generateNative(const ProgramNode* program, CompilationContext& context) {
+    return NativeCompiler(context).compile(program);
+}
+
+// Two PT_LOAD segments and no sections: the headers and code mapped
+// read/execute at kTextAddress, and the data segment, which occupies no
+// file space, read/write at kDataAddress.
+void writeElfExecutable(const NativeImage& image, const fs::path& path) {
+    std::vector<uint8_t> file = {0x7F, 'E', 'L', 'F', 2, 1, 1, 0};
+    put(file, 0, 8);
+    put(file, 2, 2);                              // ET_EXEC
+    put(file, 62, 2);                             // EM_X86_64
+    put(file, 1, 4);
+    put(file, kTextAddress + kHeaderSize, 8);     // entry
+    put(file, 64, 8);                             // program headers
+    put(file, 0, 8);                              // section headers
+    put(file, 0, 4);
+    put(file, 64, 2);
+    put(file, 56, 2);
+    put(file, 2, 2);
+    put(file, 64, 2);
+    put(file, 0, 2);
+    put(file, 0, 2);
+
+    uint64_t textSize = kHeaderSize + image.code.size();
+    put(file, 1, 4);                              // PT_LOAD
+    put(file, 5, 4);                              // PF_R | PF_X
+    put(file, 0, 8);
+    put(file, kTextAddress, 8);
+    put(file, kTextAddress, 8);
+    put(file, textSize, 8);
+    put(file, textSize, 8);
+    put(file, 0x1000, 8);
+
+    put(file, 1, 4);                              // PT_LOAD
+    put(file, 6, 4);                              // PF_R | PF_W
+    put(file, 0, 8);
+    put(file, kDataAddress, 8);
+    put(file, kDataAddress, 8);
+    put(file, 0, 8);
+    put(file, image.dataSize, 8);
+    put(file, 0x1000, 8);
+
+    file.insert(file.end(), image.code.begin(), image.code.end());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+    out.close();
+    if (!out) throw std::runtime_error("Could not write " + path.string());
+    fs::permissions(path, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec,
+                    fs::perm_options::add);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "ast.hpp"
+
+// A static x86-64 Linux program: code, entered at its first byte, and string
+// literals loaded at a fixed address, plus a zero-filled data segment.
+struct NativeImage {
+    std::vector<uint8_t> code;
+    uint64_t dataSize = 0;
+};
+
+// Lowers the program straight to machine code with a built-in runtime, so
+// no C++ compiler is involved. Output matches the C++ backend byte for
+// byte, 64-bit integers and overflow checks included; REAL values are not
+// supported and throw.
+NativeImage generateNative(const ProgramNode* program, CompilationContext& context);
+
+// Writes image as an ELF executable and marks it executable.
+void writeElfExecutable(const NativeImage& image, const std::filesystem::path& path);
@@ -0,0 +1,776 @@
+#include "optimizer.hpp"
+#include "bounds.hpp"
+#include "types.hpp"
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using Constants = std::unordered_map<std::string_view, LiteralExpr*>;
+using Names = std::unordered_set<std::string_view>;
+
+bool intValue(const ExprNode* expr, long long& value) {
+    auto lit = dynamic_cast<const LiteralExpr*>(expr);
+    if (!lit || lit->type != NUMBER) return false;
+    auto [end, ec] = std::from_chars(lit->value.data(), lit->value.data() + lit->value.size(), value);
+    return ec == std::errc() && end == lit->value.data() + lit->value.size() && value >= INT_MIN && value <= INT_MAX;
+}
+
+const LiteralExpr* stringLiteral(const ExprNode* expr) {
+    auto lit = dynamic_cast<const LiteralExpr*>(expr);
+    return lit && lit->type == STRING ? lit : nullptr;
+}
+
+bool sameLiteral(const LiteralExpr* a, const LiteralExpr* b) {
+    return a->type == b->type && a->value == b->value;
+}
+
+size_t countStatements(NodeList block);
+
+size_t countStatements(const ASTNode* stmt) {
+    if (auto ifNode = dynamic_cast<const IfNode*>(stmt))
+        return 1 + countStatements(ifNode->thenBranch) + countStatements(ifNode->elseBranch);
+    if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) return 1 + countStatements(whileNode->body);
+    if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) return 1 + countStatements(repeat->body);
+    if (auto forNode = dynamic_cast<const ForNode*>(stmt)) return 1 + countStatements(forNode->body);
+    return 1;
+}
+
+size_t countStatements(NodeList block) {
+    size_t count = 0;
+    for (auto stmt : block) count += countStatements(stmt);
+    return count;
+}
+
+bool isVariableName(std::string_view text) {
+    return !text.empty() && !isdigit(static_cast<unsigned char>(text[0]));
+}
+
+void collectReads(const ExprNode* expr, Names& reads) {
+    if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+        reads.insert(var->name);
+    } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+        for (auto argument : call->arguments) collectReads(argument, reads);
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        collectReads(unary->operand, reads);
+    } else if (auto bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        collectReads(bin->left, reads);
+        collectReads(bin->right, reads);
+    } else if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+        collectReads(idx->base, reads);
+        for (auto index : idx->indices) collectReads(index, reads);
+    }
+}
+
+void collectReads(NodeList block, Names& reads);
+
+void collectReads(const ASTNode* stmt, Names& reads) {
+    if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+        collectReads(output->expr, reads);
+    } else if (auto output = dynamic_cast<const OutputNode*>(stmt)) {
+        if (output->type != STRING && isVariableName(output->value)) reads.insert(output->value);
+    } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+        collectReads(assign->expr, reads);
+    } else if (auto call = dynamic_cast<const CallNode*>(stmt)) {
+        collectReads(call->call, reads);
+    } else if (auto ret = dynamic_cast<const ReturnNode*>(stmt)) {
+        if (ret->value) collectReads(ret->value, reads);
+    } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+        collectReads(assign->target, reads);
+        collectReads(assign->expr, reads);
+    } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+        for (const auto& bound : declare->bounds) {
+            collectReads(bound.lower, reads);
+            collectReads(bound.upper, reads);
+        }
+    } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+        collectReads(ifNode->condition, reads);
+        collectReads(ifNode->thenBranch, reads);
+        collectReads(ifNode->elseBranch, reads);
+    } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+        collectReads(whileNode->condition, reads);
+        collectReads(whileNode->body, reads);
+    } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+        collectReads(repeat->condition, reads);
+        collectReads(repeat->body, reads);
+    } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+        // The step and the loop test read the iterator after every trip, so
+        // a store to it in the body is never dead.
+        reads.insert(forNode->iterator);
+        for (auto bound : {forNode->startExpr, forNode->endExpr, forNode->stepExpr}) collectReads(bound, reads);
+        collectReads(forNode->body, reads);
+    }
+}
+
+void collectReads(NodeList block, Names& reads) {
+    for (auto stmt : block) collectReads(stmt, reads);
+}
+
+void collectWrites(NodeList block, Names& writes) {
+    for (auto stmt : block) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            writes.insert(input->variableName);
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            writes.insert(assign->variableName);
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            collectWrites(ifNode->thenBranch, writes);
+            collectWrites(ifNode->elseBranch, writes);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            collectWrites(whileNode->body, writes);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            collectWrites(repeat->body, writes);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            writes.insert(forNode->iterator);
+            collectWrites(forNode->body, writes);
+        }
+    }
+}
+
+// Every subroutine block calls, directly or inside an expression.
+void collectCalls(const ExprNode* expr, std::vector<uint32_t>& calls) {
+    if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+        calls.push_back(call->symbol);
+        for (auto argument : call->arguments) collectCalls(argument, calls);
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        collectCalls(unary->operand, calls);
+    } else if (auto bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        collectCalls(bin->left, calls);
+        collectCalls(bin->right, calls);
+    } else if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+        collectCalls(idx->base, calls);
+        for (auto index : idx->indices) collectCalls(index, calls);
+    }
+}
+
+void collectCalls(NodeList block, std::vector<uint32_t>& calls) {
+    for (auto stmt : block) {
+        if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+            collectCalls(output->expr, calls);
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            collectCalls(assign->expr, calls);
+        } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            collectCalls(assign->target, calls);
+            collectCalls(assign->expr, calls);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            for (const auto& bound : declare->bounds) {
+                collectCalls(bound.lower, calls);
+                collectCalls(bound.upper, calls);
+            }
+        } else if (auto call = dynamic_cast<const CallNode*>(stmt)) {
+            collectCalls(call->call, calls);
+        } else if (auto ret = dynamic_cast<const ReturnNode*>(stmt)) {
+            if (ret->value) collectCalls(ret->value, calls);
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            collectCalls(ifNode->condition, calls);
+            collectCalls(ifNode->thenBranch, calls);
+            collectCalls(ifNode->elseBranch, calls);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            collectCalls(whileNode->condition, calls);
+            collectCalls(whileNode->body, calls);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            collectCalls(repeat->body, calls);
+            collectCalls(repeat->condition, calls);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            for (auto bound : {forNode->startExpr, forNode->endExpr, forNode->stepExpr}) collectCalls(bound, calls);
+            collectCalls(forNode->body, calls);
+        }
+    }
+}
+
+bool containsReturn(NodeList block) {
+    for (auto stmt : block) {
+        if (dynamic_cast<const ReturnNode*>(stmt)) return true;
+        if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            if (containsReturn(ifNode->thenBranch) || containsReturn(ifNode->elseBranch)) return true;
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            if (containsReturn(whileNode->body)) return true;
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            if (containsReturn(repeat->body)) return true;
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            if (containsReturn(forNode->body)) return true;
+        }
+    }
+    return false;
+}
+
+// Replaces each CALL of a small procedure that cannot reach itself with a
+// copy of its body, then drops the subroutines nothing calls any more. The
+// parameters and variables of the procedure become fresh variables of the
+// caller, which each copy first sets to the arguments and to their types'
+// default values, as a call would; typeHints keep them at the procedure's
+// types. Needs the types of the whole program.
+class Inliner {
+    static constexpr size_t maxStatements = 8;
+
+    CompilationContext& context;
+    Arena& arena;
+    SymbolTable& symbols;
+    std::vector<TypeHint>* hints = nullptr;
+    // The callee's variables and their fresh names, in the copy being made.
+    std::unordered_map<uint32_t, uint32_t> renamed;
+    std::vector<std::pair<uint32_t, uint32_t>> renamedOrder;
+    std::string prefix;
+    uint64_t copies = 0;
+
+public:
+    explicit Inliner(CompilationContext& context)
+            : context(context), arena(context.arena), symbols(context.symbols) {}
+
+    uint64_t run(ProgramNode* program) {
+        std::vector<TypeHint> programHints(program->typeHints.begin(), program->typeHints.end());
+        hints = &programHints;
+        program->statements = rewriteBlock(program->statements);
+        program->typeHints = arena.copyArray(programHints);
+        for (auto subroutine : program->subroutines) {
+            std::vector<TypeHint> localHints(subroutine->typeHints.begin(), subroutine->typeHints.end());
+            hints = &localHints;
+            // Arguments are typed in the caller's own scope.
+            context.variables.pushScope();
+            for (auto [symbol, type] : context.subroutines.at(subroutine->symbol).variables)
+                context.variables.declareLocal(symbol, type);
+            subroutine->body = rewriteBlock(subroutine->body);
+            context.variables.popScope();
+            subroutine->typeHints = arena.copyArray(localHints);
+        }
+        dropUnreachable(program);
+        return copies;
+    }
+
+private:
+    NodeList rewriteBlock(NodeList block) {
+        std::vector<ASTNode*> out;
+        out.reserve(block.size());
+        for (auto stmt : block) {
+            auto call = dynamic_cast<CallNode*>(stmt);
+            if (call && inlinable(call->call)) {
+                inlineCall(call->call, out);
+                continue;
+            }
+            if (auto ifNode = dynamic_cast<IfNode*>(stmt)) {
+                ifNode->thenBranch = rewriteBlock(ifNode->thenBranch);
+                ifNode->elseBranch = rewriteBlock(ifNode->elseBranch);
+            } else if (auto whileNode = dynamic_cast<WhileNode*>(stmt)) {
+                whileNode->body = rewriteBlock(whileNode->body);
+            } else if (auto repeat = dynamic_cast<RepeatUntilNode*>(stmt)) {
+                repeat->body = rewriteBlock(repeat->body);
+            } else if (auto forNode = dynamic_cast<ForNode*>(stmt)) {
+                forNode->body = rewriteBlock(forNode->body);
+            }
+            out.push_back(stmt);
+        }
+        return arena.copyArray(out);
+    }
+
+    // The body without a RETURN that ends it, which changes nothing inline.
+    static NodeList inlinedBody(const SubroutineNode* callee) {
+        NodeList body = callee->body;
+        if (!body.empty() && dynamic_cast<const ReturnNode*>(body.back())) body = body.first(body.size() - 1);
+        return body;
+    }
+
+    bool inlinable(const CallExpr* call) const {
+        const SubroutineNode* callee = call->callee(context);
+        if (!callee || callee->isFunction() || context.subroutines.at(callee->symbol).recursive) return false;
+        NodeList body = inlinedBody(callee);
+        if (countStatements(body) > maxStatements || containsReturn(body)) return false;
+        // A call converts its arguments, and assignments to parameters, to
+        // the parameter types; plain variables do neither, so only calls
+        // where no conversion could differ are inlined.
+        Names writes;
+        collectWrites(body, writes);
+        for (size_t i = 0; i < callee->parameters.size(); i++) {
+            const Parameter& parameter = callee->parameters[i];
+            if (writes.count(parameter.name)) return false;
+            ValueType argument = call->arguments[i]->inferType(context);
+            if (argument != parameter.type && !(parameter.type == ValueType::String && isNumeric(argument))) return false;
+        }
+        return true;
+    }
+
+    void inlineCall(CallExpr* call, std::vector<ASTNode*>& out) {
+        const SubroutineNode* callee = call->callee(context);
+        copies++;
+        prefix = "pseudo_" + std::string(callee->name) + std::to_string(copies) + "_";
+        renamed.clear();
+        renamedOrder.clear();
+        for (size_t i = 0; i < callee->parameters.size(); i++) {
+            uint32_t symbol = fresh(callee->parameters[i].symbol);
+            hints->push_back({symbol, callee->parameters[i].type});
+            out.push_back(arena.make<AssignNode>(symbols.name(symbol), symbol, call->arguments[i]));
+            out.back()->position = call->position;
+        }
+        std::vector<ASTNode*> body;
+        for (auto stmt : inlinedBody(callee)) body.push_back(copy(stmt));
+        for (size_t i = callee->parameters.size(); i < renamedOrder.size(); i++) {
+            auto [original, symbol] = renamedOrder[i];
+            ValueType type = typeIn(callee, original);
+            hints->push_back({symbol, type});
+            out.push_back(arena.make<AssignNode>(symbols.name(symbol), symbol, defaultValue(type)));
+            out.back()->position = call->position;
+        }
+        out.insert(out.end(), body.begin(), body.end());
+    }
+
+    // A variable of callee, as inferTypes found it or as an earlier inlining
+    // into it pinned it.
+    ValueType typeIn(const SubroutineNode* callee, uint32_t symbol) const {
+        for (auto [variable, type] : context.subroutines.at(callee->symbol).variables)
+            if (variable == symbol) return type;
+        for (const auto& hint : callee->typeHints)
+            if (hint.symbol == symbol) return hint.type;
+        return ValueType::Int;
+    }
+
+    LiteralExpr* defaultValue(ValueType type) {
+        auto literal = [&](std::string_view text, TokenType token) {
+            return arena.make<LiteralExpr>(symbols.name(symbols.intern(text)), token);
+        };
+        if (type == ValueType::String) return literal("", STRING);
+        if (type == ValueType::Bool) return literal("FALSE", FALSE);
+        return literal(type == ValueType::Real ? "0.0" : "0", NUMBER);
+    }
+
+    uint32_t fresh(uint32_t symbol) {
+        auto [it, added] = renamed.try_emplace(symbol, 0);
+        if (added) {
+            it->second = symbols.intern(prefix + std::string(symbols.name(symbol)));
+            renamedOrder.emplace_back(symbol, it->second);
+        }
+        return it->second;
+    }
+
+    // Copies keep the positions of the originals, so a profile charges an
+    // inlined statement to its line in the PROCEDURE.
+    ExprNode* copy(ExprNode* expr) {
+        ExprNode* copied = copyExpression(expr);
+        copied->position = expr->position;
+        return copied;
+    }
+
+    ExprNode* copyExpression(ExprNode* expr) {
+        if (auto var = dynamic_cast<VariableExpr*>(expr)) {
+            uint32_t symbol = fresh(var->symbol);
+            return arena.make<VariableExpr>(symbols.name(symbol), symbol);
+        }
+        if (auto unary = dynamic_cast<UnaryExpr*>(expr)) return arena.make<UnaryExpr>(unary->op, copy(unary->operand));
+        if (auto bin = dynamic_cast<BinaryExpr*>(expr))
+            return arena.make<BinaryExpr>(bin->op, copy(bin->left), copy(bin->right));
+        if (auto idx = dynamic_cast<IndexExpr*>(expr)) return arena.make<IndexExpr>(copy(idx->base), copy(idx->indices));
+        if (auto call = dynamic_cast<CallExpr*>(expr)) return copy(call);
+        // Literals are never changed in place, so copies can share them.
+        return expr;
+    }
+
+    CallExpr* copy(const CallExpr* call) {
+        auto* copied = arena.make<CallExpr>(call->name, call->symbol, copy(call->arguments));
+        copied->position = call->position;
+        return copied;
+    }
+
+    std::span<ExprNode*> copy(std::span<ExprNode*> exprs) {
+        std::vector<ExprNode*> copies;
+        for (auto expr : exprs) copies.push_back(copy(expr));
+        return arena.copyArray(copies);
+    }
+
+    NodeList copy(NodeList block) {
+        std::vector<ASTNode*> copies;
+        for (auto stmt : block) copies.push_back(copy(stmt));
+        return arena.copyArray(copies);
+    }
+
+    ASTNode* copy(ASTNode* stmt) {
+        ASTNode* copied = copyStatement(stmt);
+        copied->position = stmt->position;
+        return copied;
+    }
+
+    ASTNode* copyStatement(ASTNode* stmt) {
+        if (auto input = dynamic_cast<InputNode*>(stmt)) {
+            uint32_t symbol = fresh(input->symbol);
+            return arena.make<InputNode>(symbols.name(symbol), symbol);
+        }
+        if (auto output = dynamic_cast<OutputExprNode*>(stmt)) return arena.make<OutputExprNode>(copy(output->expr));
+        if (auto assign = dynamic_cast<AssignNode*>(stmt)) {
+            uint32_t symbol = fresh(assign->symbol);
+            return arena.make<AssignNode>(symbols.name(symbol), symbol, copy(assign->expr));
+        }
+        if (auto call = dynamic_cast<CallNode*>(stmt)) return arena.make<CallNode>(copy(call->call));
+        if (auto ifNode = dynamic_cast<IfNode*>(stmt))
+            return arena.make<IfNode>(copy(ifNode->condition), copy(ifNode->thenBranch), copy(ifNode->elseBranch));
+        if (auto whileNode = dynamic_cast<WhileNode*>(stmt))
+            return arena.make<WhileNode>(copy(whileNode->condition), copy(whileNode->body));
+        if (auto repeat = dynamic_cast<RepeatUntilNode*>(stmt))
+            return arena.make<RepeatUntilNode>(copy(repeat->condition), copy(repeat->body));
+        if (auto forNode = dynamic_cast<ForNode*>(stmt)) {
+            uint32_t symbol = fresh(forNode->symbol);
+            return arena.make<ForNode>(symbols.name(symbol), symbol, copy(forNode->startExpr), copy(forNode->endExpr),
+                                       copy(forNode->stepExpr), copy(forNode->body));
+        }
+        throw std::logic_error("Inliner: unexpected statement in a PROCEDURE");
+    }
+
+    void dropUnreachable(ProgramNode* program) {
+        std::vector<uint32_t> pending;
+        collectCalls(program->statements, pending);
+        std::unordered_set<uint32_t> reached;
+        while (!pending.empty()) {
+            uint32_t symbol = pending.back();
+            pending.pop_back();
+            auto it = context.subroutines.find(symbol);
+            if (it != context.subroutines.end() && reached.insert(symbol).second)
+                collectCalls(it->second.node->body, pending);
+        }
+        std::vector<SubroutineNode*> kept;
+        for (auto subroutine : program->subroutines)
+            if (reached.count(subroutine->symbol)) kept.push_back(subroutine);
+        program->subroutines = arena.copyArray(kept);
+    }
+};
+
+class Optimizer {
+    CompilationContext& context;
+    Arena& arena;
+    SymbolTable& symbols;
+    VariableTable types;
+    OptimizationStats stats;
+
+public:
+    explicit Optimizer(CompilationContext& context)
+            : context(context), arena(context.arena), symbols(context.symbols) {}
+
+    OptimizationStats run(ProgramNode* program) {
+        // Types are taken from the whole program up front. Propagation only
+        // substitutes literals of the variable's own type, and the same
+        // types are handed to codegen as hints once code has been removed.
+        inferTypes(program, context);
+        if (!program->subroutines.empty()) {
+            stats.inlined = Inliner(context).run(program);
+            inferTypes(program, context);
+        }
+        types = context.variables;
+        program->statements = optimizeBlock(program->statements);
+        program->typeHints = hintsFor(program->statements);
+
+        // Each subroutine on its own, with the types of its own scope.
+        for (auto subroutine : program->subroutines) {
+            types = VariableTable();
+            for (auto [symbol, type] : context.subroutines.at(subroutine->symbol).variables) types.assign(symbol, type);
+            subroutine->body = optimizeBlock(subroutine->body);
+            subroutine->typeHints = hintsFor(subroutine->body);
+        }
+        stats.uncheckedIndexes = elideBoundsChecks(program, context);
+        return stats;
+    }
+
+private:
+    NodeList optimizeBlock(NodeList block) {
+        Constants constants;
+        block = rewriteBlock(block, constants);
+        while (removeDeadStores(block)) {}
+        return block;
+    }
+
+    std::span<TypeHint> hintsFor(NodeList block) {
+        Names used;
+        collectReads(block, used);
+        collectWrites(block, used);
+        std::vector<TypeHint> hints;
+        for (uint32_t symbol : types.declarations())
+            if (used.count(symbols.name(symbol))) hints.push_back({symbol, types.typeOf(symbol)});
+        return arena.copyArray(hints);
+    }
+
+    // Whether evaluating expr could be seen: it calls a subroutine that is
+    // not pure.
+    bool hasEffects(const ExprNode* expr) const {
+        std::vector<uint32_t> calls;
+        collectCalls(expr, calls);
+        for (uint32_t symbol : calls) {
+            auto it = context.subroutines.find(symbol);
+            if (it == context.subroutines.end() || !it->second.pure) return true;
+        }
+        return false;
+    }
+
+    LiteralExpr* makeLiteral(std::string_view text, TokenType type) {
+        stats.folded++;
+        return arena.make<LiteralExpr>(symbols.name(symbols.intern(text)), type);
+    }
+
+    LiteralExpr* makeBool(bool value) {
+        return value ? makeLiteral("TRUE", TRUE) : makeLiteral("FALSE", FALSE);
+    }
+
+    static bool compare(std::string_view op, int cmp) {
+        if (op == "<") return cmp < 0;
+        if (op == "<=") return cmp <= 0;
+        if (op == ">") return cmp > 0;
+        if (op == ">=") return cmp >= 0;
+        if (op == "=" || op == "==") return cmp == 0;
+        return cmp != 0;
+    }
+
+    ExprNode* fold(UnaryExpr* unary) {
+        long long value;
+        bool truth;
+        if (unary->op == "NOT" && constantCondition(unary->operand, truth)) return makeBool(!truth);
+        if (unary->op == "-" && intValue(unary->operand, value) && value != INT_MIN)
+            return makeLiteral(std::to_string(-value), NUMBER);
+        return unary;
+    }
+
+    ExprNode* fold(BinaryExpr* bin) {
+        // A constant left operand of AND or OR decides whether the right one
+        // is evaluated at all.
+        bool leftTruth, rightTruth;
+        if (isLogicalOperator(bin->op) && constantCondition(bin->left, leftTruth)) {
+            bool isAnd = bin->op == "AND";
+            if (leftTruth != isAnd) return makeBool(leftTruth);
+            if (constantCondition(bin->right, rightTruth)) return makeBool(rightTruth);
+            return bin;
+        }
+
+        long long l, r;
+        bool leftInt = intValue(bin->left, l);
+        bool rightInt = intValue(bin->right, r);
+        const LiteralExpr* leftString = stringLiteral(bin->left);
+        const LiteralExpr* rightString = stringLiteral(bin->right);
+        std::string_view op = bin->op;
+
+        if (leftInt && rightInt) {
+            if (isComparisonOperator(op)) return makeBool(compare(op, l < r ? -1 : l > r ? 1 : 0));
+            if ((op == "/" || op == "%") && r == 0) return bin;
+            long long result = op == "+" ? l + r
+                             : op == "-" ? l - r
+                             : op == "*" ? l * r
+                             : op == "/" ? l / r
+                             : l % r;
+            if (result < INT_MIN || result > INT_MAX) return bin;
+            return makeLiteral(std::to_string(result), NUMBER);
+        }
+        if (leftString && rightString && isComparisonOperator(op))
+            return makeBool(compare(op, leftString->value.compare(rightString->value)));
+        if (op == "+" && (leftString || leftInt) && (rightString || rightInt) && (leftString || rightString)) {
+            std::string text = leftString ? std::string(leftString->value) : std::to_string(l);
+            text += rightString ? std::string(rightString->value) : std::to_string(r);
+            return makeLiteral(text, STRING);
+        }
+        return bin;
+    }
+
+    ExprNode* rewrite(ExprNode* expr, const Constants& constants) {
+        if (auto var = dynamic_cast<VariableExpr*>(expr)) {
+            auto it = constants.find(var->name);
+            if (it == constants.end()) return expr;
+            stats.propagated++;
+            return it->second;
+        }
+        if (auto unary = dynamic_cast<UnaryExpr*>(expr)) {
+            unary->operand = rewrite(unary->operand, constants);
+            return fold(unary);
+        }
+        if (auto bin = dynamic_cast<BinaryExpr*>(expr)) {
+            bin->left = rewrite(bin->left, constants);
+            bin->right = rewrite(bin->right, constants);
+            return fold(bin);
+        }
+        if (auto call = dynamic_cast<CallExpr*>(expr)) {
+            for (auto& argument : call->arguments) argument = rewrite(argument, constants);
+            return expr;
+        }
+        if (auto idx = dynamic_cast<IndexExpr*>(expr)) {
+            idx->base = rewrite(idx->base, constants);
+            for (auto& index : idx->indices) index = rewrite(index, constants);
+            const LiteralExpr* base = stringLiteral(idx->base);
+            long long i;
+            if (base && idx->indices.size() == 1 && intValue(idx->indices[0], i) && base->value.find('\\') == std::string_view::npos
+                && i >= 0 && i < static_cast<long long>(base->value.size()))
+                return makeLiteral(base->value.substr(i, 1), STRING);
+        }
+        return expr;
+    }
+
+    static bool constantCondition(const ExprNode* expr, bool& value) {
+        long long number;
+        if (intValue(expr, number)) {
+            value = number != 0;
+            return true;
+        }
+        auto lit = dynamic_cast<const LiteralExpr*>(expr);
+        if (!lit || (lit->type != TRUE && lit->type != FALSE)) return false;
+        value = lit->type == TRUE;
+        return true;
+    }
+
+    static void forget(Constants& constants, NodeList body) {
+        Names writes;
+        collectWrites(body, writes);
+        for (auto name : writes) constants.erase(name);
+    }
+
+    NodeList rewriteBlock(NodeList block, Constants& constants) {
+        std::vector<ASTNode*> out;
+        out.reserve(block.size());
+        for (auto stmt : block) rewriteStatement(stmt, constants, out);
+        return arena.copyArray(out);
+    }
+
+    void splice(NodeList block, Constants& constants, std::vector<ASTNode*>& out) {
+        for (auto stmt : block) rewriteStatement(stmt, constants, out);
+    }
+
+    void rewriteStatement(ASTNode* stmt, Constants& constants, std::vector<ASTNode*>& out) {
+        if (auto input = dynamic_cast<InputNode*>(stmt)) {
+            constants.erase(input->variableName);
+        } else if (auto output = dynamic_cast<OutputExprNode*>(stmt)) {
+            output->expr = rewrite(output->expr, constants);
+        } else if (auto assign = dynamic_cast<AssignNode*>(stmt)) {
+            assign->expr = rewrite(assign->expr, constants);
+            auto lit = dynamic_cast<LiteralExpr*>(assign->expr);
+            if (lit && lit->literalType() == types.typeOf(assign->symbol)) constants[assign->variableName] = lit;
+            else constants.erase(assign->variableName);
+        } else if (auto call = dynamic_cast<CallNode*>(stmt)) {
+            rewrite(call->call, constants);
+        } else if (auto ret = dynamic_cast<ReturnNode*>(stmt)) {
+            if (ret->value) ret->value = rewrite(ret->value, constants);
+        } else if (auto assign = dynamic_cast<ElementAssignNode*>(stmt)) {
+            rewrite(assign->target, constants);
+            assign->expr = rewrite(assign->expr, constants);
+        } else if (auto declare = dynamic_cast<DeclareNode*>(stmt)) {
+            for (auto& bound : declare->bounds) {
+                bound.lower = rewrite(bound.lower, constants);
+                bound.upper = rewrite(bound.upper, constants);
+            }
+        } else if (auto ifNode = dynamic_cast<IfNode*>(stmt)) {
+            ifNode->condition = rewrite(ifNode->condition, constants);
+            bool taken;
+            if (constantCondition(ifNode->condition, taken)) {
+                stats.removed += 1 + countStatements(taken ? ifNode->elseBranch : ifNode->thenBranch);
+                splice(taken ? ifNode->thenBranch : ifNode->elseBranch, constants, out);
+                return;
+            }
+            Constants elseConstants = constants;
+            ifNode->thenBranch = rewriteBlock(ifNode->thenBranch, constants);
+            ifNode->elseBranch = rewriteBlock(ifNode->elseBranch, elseConstants);
+            for (auto it = constants.begin(); it != constants.end();) {
+                auto other = elseConstants.find(it->first);
+                if (other == elseConstants.end() || !sameLiteral(it->second, other->second)) it = constants.erase(it);
+                else ++it;
+            }
+        } else if (auto whileNode = dynamic_cast<WhileNode*>(stmt)) {
+            forget(constants, whileNode->body);
+            whileNode->condition = rewrite(whileNode->condition, constants);
+            bool taken;
+            if (constantCondition(whileNode->condition, taken) && !taken) {
+                stats.removed += countStatements(stmt);
+                return;
+            }
+            Constants bodyConstants = constants;
+            whileNode->body = rewriteBlock(whileNode->body, bodyConstants);
+        } else if (auto repeat = dynamic_cast<RepeatUntilNode*>(stmt)) {
+            // The body always runs once, so what it leaves behind holds after
+            // the loop as well.
+            forget(constants, repeat->body);
+            size_t first = out.size();
+            splice(repeat->body, constants, out);
+            repeat->condition = rewrite(repeat->condition, constants);
+            bool done;
+            if (constantCondition(repeat->condition, done) && done) {
+                stats.removed++;
+                return;
+            }
+            repeat->body = arena.copyArray(std::vector<ASTNode*>(out.begin() + first, out.end()));
+            out.resize(first);
+        } else if (auto forNode = dynamic_cast<ForNode*>(stmt)) {
+            // The bounds are evaluated once, before the loop, so everything
+            // known at this point holds for them.
+            for (auto bound : {&forNode->startExpr, &forNode->endExpr, &forNode->stepExpr})
+                *bound = rewrite(*bound, constants);
+            constants.erase(forNode->iterator);
+            forget(constants, forNode->body);
+            long long start, end, step;
+            if (intValue(forNode->startExpr, start) && intValue(forNode->endExpr, end) &&
+                intValue(forNode->stepExpr, step) && (step < 0 ? start < end : start > end)) {
+                // The iterator is still assigned its start value.
+                stats.removed += countStatements(forNode->body);
+                out.push_back(arena.make<AssignNode>(forNode->iterator, forNode->symbol, forNode->startExpr));
+                out.back()->position = forNode->position;
+                return;
+            }
+            Constants bodyConstants = constants;
+            forNode->body = rewriteBlock(forNode->body, bodyConstants);
+        }
+        out.push_back(stmt);
+    }
+
+    // A store is dead when its variable is never read anywhere, or when the
+    // same block overwrites it before any statement could read it, unless
+    // its value comes from a call that could be seen. Walks
+    // each block backwards with the set of variables certain to be
+    // overwritten first; nested blocks start from an empty set.
+    bool removeDeadStores(NodeList& block) {
+        Names reads;
+        collectReads(block, reads);
+        uint64_t before = stats.removed;
+        block = pruneBlock(block, reads);
+        return stats.removed != before;
+    }
+
+    NodeList pruneBlock(NodeList block, const Names& reads) {
+        Names overwritten;
+        std::vector<ASTNode*> kept;
+        for (size_t i = block.size(); i-- > 0;) {
+            ASTNode* stmt = block[i];
+            if (auto assign = dynamic_cast<AssignNode*>(stmt)) {
+                if ((!reads.count(assign->variableName) || overwritten.count(assign->variableName)) &&
+                    !hasEffects(assign->expr)) {
+                    stats.removed++;
+                    continue;
+                }
+                // The right-hand side is read before the store, so a variable
+                // it reads is live above here even when it is the one stored.
+                overwritten.insert(assign->variableName);
+                Names used;
+                collectReads(assign->expr, used);
+                for (auto name : used) overwritten.erase(name);
+            } else if (auto input = dynamic_cast<InputNode*>(stmt)) {
+                overwritten.insert(input->variableName);
+            } else {
+                if (auto ifNode = dynamic_cast<IfNode*>(stmt)) {
+                    ifNode->thenBranch = pruneBlock(ifNode->thenBranch, reads);
+                    ifNode->elseBranch = pruneBlock(ifNode->elseBranch, reads);
+                    if (ifNode->thenBranch.empty() && ifNode->elseBranch.empty() && !hasEffects(ifNode->condition)) {
+                        stats.removed++;
+                        continue;
+                    }
+                } else if (auto whileNode = dynamic_cast<WhileNode*>(stmt)) {
+                    whileNode->body = pruneBlock(whileNode->body, reads);
+                } else if (auto repeat = dynamic_cast<RepeatUntilNode*>(stmt)) {
+                    repeat->body = pruneBlock(repeat->body, reads);
+                } else if (auto forNode = dynamic_cast<ForNode*>(stmt)) {
+                    forNode->body = pruneBlock(forNode->body, reads);
+                    overwritten.erase(forNode->iterator);
+                }
+                Names used;
+                collectReads(stmt, used);
+                for (auto name : used) overwritten.erase(name);
+            }
+            kept.push_back(stmt);
+        }
+        std::vector<ASTNode*> ordered(kept.rbegin(), kept.rend());
+        return arena.copyArray(ordered);
+    }
+};
+
+}
+
+OptimizationStats optimizeProgram(ProgramNode* program, CompilationContext& context) {
+    return Optimizer(context).run(program);
+}
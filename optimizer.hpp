@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include "ast.hpp"
+#include "context.hpp"
+
+struct OptimizationStats {
+    uint64_t folded = 0;
+    uint64_t propagated = 0;
+    uint64_t removed = 0;
+    uint64_t inlined = 0;
+    uint64_t uncheckedIndexes = 0;
+};
+
+// Inlines small procedures, folds literal arithmetic and comparisons,
+// propagates constants through assignments, prunes branches and loops with
+// constant conditions and drops stores that are never read, in the program
+// and in every subroutine, then drops the bounds checks elideBoundsChecks
+// can prove unnecessary. Rewrites the program in place; new nodes are
+// allocated from the context.
+OptimizationStats optimizeProgram(ProgramNode* program, CompilationContext& context);
@@ -0,0 +1,21 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs body(i) for every i below count on up to jobs threads. Items are
+// handed out one at a time, so a slow item does not hold up the others.
+inline void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& body) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    size_t threads = std::min<size_t>(std::max(jobs, 1u), count);
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([&] {
+            for (size_t item = next++; item < count; item = next++) body(item);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
@@ -1,74 +1,161 @@
 #include "ast.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include <algorithm>
+#include <charconv>
+#include <span>
 #include <stdexcept>
 
+namespace {
+
+enum class Fixity : uint8_t { Prefix, Left, Right };
+
+struct OperatorInfo {
+    std::string_view spelling;
+    uint8_t precedence;
+    Fixity fixity;
+};
+
+// Loosest first. NOT binds looser than comparisons, so NOT a = b negates
+// the comparison; unary minus binds tighter than everything.
+constexpr OperatorInfo binaryOperators[] = {
+    {"OR", 1, Fixity::Left},
+    {"AND", 2, Fixity::Left},
+    {"=", 4, Fixity::Left}, {"<>", 4, Fixity::Left}, {"<", 4, Fixity::Left},
+    {">", 4, Fixity::Left}, {"<=", 4, Fixity::Left}, {">=", 4, Fixity::Left},
+    {"+", 5, Fixity::Left}, {"-", 5, Fixity::Left},
+    {"*", 6, Fixity::Left}, {"/", 6, Fixity::Left}, {"%", 6, Fixity::Left},
+};
+
+constexpr OperatorInfo prefixOperators[] = {
+    {"NOT", 3, Fixity::Prefix},
+    {"-", 7, Fixity::Prefix},
+};
+
+const OperatorInfo* findOperator(std::span<const OperatorInfo> table, std::string_view spelling) {
+    for (const auto& info : table)
+        if (info.spelling == spelling) return &info;
+    return nullptr;
+}
+
+const OperatorInfo* binaryOperator(TokenType type, std::string_view spelling) {
+    if (type != OPERATOR && type != AND && type != OR) return nullptr;
+    return findOperator(binaryOperators, spelling);
+}
+
+const OperatorInfo* prefixOperator(TokenType type, std::string_view spelling) {
+    if (type != OPERATOR && type != NOT) return nullptr;
+    return findOperator(prefixOperators, spelling);
+}
+
+ValueType typeNamed(std::string_view name) {
+    if (name == "INTEGER") return ValueType::Int;
+    if (name == "REAL") return ValueType::Real;
+    if (name == "STRING" || name == "CHAR") return ValueType::String;
+    if (name == "BOOLEAN") return ValueType::Bool;
+    throw std::runtime_error("Parser error: Unknown type " + std::string(name));
+}
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), pos(0) {}
+}
 
-Token Parser::peek() const { return tokens[pos]; }
-Token Parser::advance() { return tokens[pos++]; }
+Parser::Parser(Lexer& lexer, CompilationContext& context)
+        : tokens(lexer), arena(context.arena), symbols(context.symbols) {}
+
+std::string_view Parser::text(const Token& token) const { return symbols.name(token.symbol); }
+
+const Token& Parser::peek(size_t ahead) { return tokens.peek(ahead); }
+Token Parser::advance() { return tokens.advance(); }
 
 bool Parser::match(TokenType type) {
-    if (pos < tokens.size() && tokens[pos].type == type) {
-        pos++;
+    if (peek().type == type) {
+        advance();
         return true;
     }
     return false;
 }
 
 Token Parser::expect(TokenType type, const std::string& errorMsg) {
-    if (pos < tokens.size() && tokens[pos].type == type)
-        return tokens[pos++];
+    if (peek().type == type)
+        return advance();
     throw std::runtime_error("Parser error: " + errorMsg);
 }
 
 ExprNode* Parser::parseLiteral() {
     Token token = advance();
-    if (token.type == IDENTIFIER) return new VariableExpr(token.value);
-    return new LiteralExpr(token.value, token.type);
+    // Integer literals are 64-bit at most; the range pass decides which
+    // of them need more than 32. The sign is part of the value, so the
+    // most negative 64-bit number can be written.
+    long long value;
+    std::string number = (negated ? "-" : "") + std::string(text(token));
+    if (token.type == NUMBER && number.find('.') == std::string::npos &&
+        std::from_chars(number.data(), number.data() + number.size(), value).ec != std::errc())
+        throw std::runtime_error("Parser error: " + number + " does not fit in 64 bits");
+    ExprNode* expr = token.type == IDENTIFIER ? static_cast<ExprNode*>(make<VariableExpr>(text(token), token.symbol))
+                                              : make<LiteralExpr>(text(token), token.type);
+    expr->position = token.position;
+    return expr;
+}
+
+bool Parser::atParenthesis(const char* spelling) {
+    return (peek().type == LPAREN || peek().type == RPAREN) && text(peek()) == spelling;
+}
+
+// Returns levels, or throws when an expression would nest that deeply.
+uint32_t Parser::deeper(uint32_t levels) const {
+    if (levels > maxExpressionDepth)
+        throw std::runtime_error("Parser error: Expression nested more than " + std::to_string(maxExpressionDepth) +
+                                 " levels deep");
+    return levels;
 }
 
+// Sets depth to the primary's nesting depth.
 ExprNode* Parser::parsePrimary() {
+    depth = 1;
+    if (peek().type == TRUE || peek().type == FALSE) return parseLiteral();
     if (peek().type == NUMBER || peek().type == STRING || peek().type == IDENTIFIER) {
-        ExprNode* expr = parseLiteral();
-        while (peek().type == LPAREN && peek().value == "[") {
+        bool isCall = peek().type == IDENTIFIER && peek(1).type == LPAREN && text(peek(1)) == "(";
+        ExprNode* expr = isCall ? parseCall() : parseLiteral();
+        while (peek().type == LPAREN && text(peek()) == "[") {
             advance();
-            ExprNode* idx = parseExpression();
+            uint32_t levels = depth;
+            std::vector<ExprNode*> indices = {parseExpression()};
+            levels = std::max(levels, depth);
+            while (match(COMMA)) {
+                indices.push_back(parseExpression());
+                levels = std::max(levels, depth);
+            }
+            depth = deeper(levels + 1);
             expect(RPAREN, "Expected ] after index");
-            expr = new IndexExpr(expr, idx);
+            SourcePosition position = expr->position;
+            expr = make<IndexExpr>(expr, arena.copyArray(indices));
+            expr->position = position;
         }
         return expr;
     }
     throw std::runtime_error("Expected primary expression");
 }
 
-int Parser::getPrecedence(const std::string& op) {
-    if (op == "+" || op == "-") return 1;
-    if (op == "*" || op == "/" || op == "%") return 2;
-    return 0;
-}
-
-ExprNode* Parser::parseBinaryOpRHS(int exprPrec, ExprNode* lhs) {
-    while (true) {
-        Token token = peek();
-        if (token.type != OPERATOR) break;
-        int prec = getPrecedence(token.value);
-        if (prec < exprPrec) break;
-
+// name, or name(arguments...), after CALL or inside an expression.
+CallExpr* Parser::parseCall() {
+    Token name = expect(IDENTIFIER, "Expected the name of a PROCEDURE or FUNCTION");
+    std::vector<ExprNode*> arguments;
+    uint32_t levels = 0;
+    if (atParenthesis("(")) {
         advance();
-        ExprNode* rhs = parsePrimary();
-
-        Token next = peek();
-        if (next.type == OPERATOR) {
-            int nextPrec = getPrecedence(next.value);
-            if (prec < nextPrec) {
-                rhs = parseBinaryOpRHS(prec + 1, rhs);
-            }
+        if (!atParenthesis(")")) {
+            do {
+                arguments.push_back(parseExpression());
+                levels = std::max(levels, depth);
+            } while (match(COMMA));
         }
-        lhs = new BinaryExpr(token.value, lhs, rhs);
+        if (!atParenthesis(")"))
+            throw std::runtime_error("Parser error: Expected ) after the arguments of " + std::string(text(name)));
+        advance();
     }
-    return lhs;
+    auto* call = make<CallExpr>(text(name), name.symbol, arena.copyArray(arguments));
+    call->position = name.position;
+    depth = deeper(levels + 1);
+    return call;
 }
 
 ASTNode* Parser::parseIf() {
@@ -77,28 +164,182 @@ ASTNode* Parser::parseIf() {
     expect(THEN, "Expected THEN after IF condition");
 
     std::vector<ASTNode*> thenBranch;
-    while (peek().type != ELSE && peek().type != ENDIF && pos < tokens.size()) {
+    while (peek().type != ELSE && peek().type != ENDIF && peek().type != END) {
         thenBranch.push_back(parseStatement());
     }
 
     std::vector<ASTNode*> elseBranch;
     if (peek().type == ELSE) {
         advance();
-        while (peek().type != ENDIF && pos < tokens.size()) {
+        while (peek().type != ENDIF && peek().type != END) {
             elseBranch.push_back(parseStatement());
         }
     }
     expect(ENDIF, "Expected ENDIF after IF block");
 
-    return new IfNode(cond, thenBranch, elseBranch);
+    return make<IfNode>(cond, arena.copyArray(thenBranch), arena.copyArray(elseBranch));
+}
+
+ASTNode* Parser::parseDeclare() {
+    advance();
+    Token name = expect(IDENTIFIER, "Expected array name after DECLARE");
+    expect(COLON, "Expected : after array name");
+    expect(ARRAY, "Expected ARRAY after DECLARE " + std::string(text(name)) + " :");
+    if (peek().type != LPAREN || text(peek()) != "[") throw std::runtime_error("Parser error: Expected [ after ARRAY");
+    advance();
+    std::vector<ArrayBound> bounds;
+    do {
+        ExprNode* lower = parseExpression();
+        expect(COLON, "Expected : between array bounds");
+        ExprNode* upper = parseExpression();
+        bounds.push_back({lower, upper});
+    } while (match(COMMA));
+    expect(RPAREN, "Expected ] after array bounds");
+    expect(OF, "Expected OF after array bounds");
+    Token type = expect(IDENTIFIER, "Expected element type after OF");
+    return make<DeclareNode>(text(name), name.symbol, typeNamed(text(type)), arena.copyArray(bounds));
+}
+
+// PROCEDURE name(parameter : TYPE, ...) ... ENDPROCEDURE, or
+// FUNCTION name(parameter : TYPE, ...) RETURNS TYPE ... ENDFUNCTION. The
+// parameter list may be left out when there are no parameters.
+SubroutineNode* Parser::parseSubroutine() {
+    auto* node = make<SubroutineNode>();
+    bool isFunction = advance().type == FUNCTION;
+    std::string kind = isFunction ? "FUNCTION" : "PROCEDURE";
+    Token name = expect(IDENTIFIER, "Expected a name after " + kind);
+    node->name = text(name);
+    node->symbol = name.symbol;
+
+    std::vector<Parameter> parameters;
+    if (atParenthesis("(")) {
+        advance();
+        if (!atParenthesis(")")) {
+            do {
+                Token parameter = expect(IDENTIFIER, "Expected a parameter name in " + kind + " " + std::string(node->name));
+                expect(COLON, "Expected : after parameter " + std::string(text(parameter)));
+                Token type = expect(IDENTIFIER, "Expected a type after " + std::string(text(parameter)) + " :");
+                parameters.push_back({text(parameter), parameter.symbol, typeNamed(text(type))});
+            } while (match(COMMA));
+        }
+        if (!atParenthesis(")")) throw std::runtime_error("Parser error: Expected ) after the parameters of " + std::string(node->name));
+        advance();
+    }
+    node->parameters = arena.copyArray(parameters);
+    if (isFunction) {
+        expect(RETURNS, "Expected RETURNS after FUNCTION " + std::string(node->name));
+        Token type = expect(IDENTIFIER, "Expected a type after RETURNS");
+        node->result = typeNamed(text(type));
+    }
+
+    subroutine = node;
+    std::vector<ASTNode*> body;
+    TokenType closing = isFunction ? ENDFUNCTION : ENDPROCEDURE;
+    while (peek().type != closing) body.push_back(parseStatement());
+    advance();
+    subroutine = nullptr;
+    node->body = arena.copyArray(body);
+    return node;
 }
 
+// Operator precedence parsing over explicit operand and operator stacks:
+// every token is shifted once and every operator reduced once, and nesting
+// grows the stacks instead of the call stack. A null operator marks an open
+// parenthesis. Each operand's nesting depth is kept beside it; depth is set
+// to the whole expression's.
 ExprNode* Parser::parseExpression() {
-    ExprNode* lhs = parsePrimary();
-    return parseBinaryOpRHS(0, lhs);
+    struct Pending {
+        const OperatorInfo* info;
+        SourcePosition position;
+    };
+    struct Close {
+        uint32_t& open;
+        ~Close() { open--; }
+    } close{++openExpressions};
+    if (openExpressions > maxNestedExpressions)
+        throw std::runtime_error("Parser error: Calls and indexes nested more than " +
+                                 std::to_string(maxNestedExpressions) + " levels deep");
+    std::vector<ExprNode*> operands;
+    std::vector<uint32_t> depths;
+    std::vector<Pending> operators;
+    size_t open = 0;
+
+    // A binary expression starts where its left operand does, a prefix one
+    // at its operator.
+    auto reduce = [&] {
+        auto [info, position] = operators.back();
+        operators.pop_back();
+        ExprNode* right = operands.back();
+        if (info->fixity != Fixity::Prefix) {
+            operands.pop_back();
+            uint32_t levels = std::max(depths.back(), depths[depths.size() - 2]);
+            depths.pop_back();
+            depths.back() = deeper(levels + 1);
+            position = operands.back()->position;
+            operands.back() = make<BinaryExpr>(info->spelling, operands.back(), right);
+            operands.back()->position = position;
+            return;
+        }
+        // A minus in front of a number is part of the literal, so STEP -1
+        // stays a constant even without the optimizer.
+        auto lit = dynamic_cast<LiteralExpr*>(right);
+        if (info->spelling == "-" && lit && lit->type == NUMBER && lit->value[0] != '-')
+            operands.back() = make<LiteralExpr>(symbols.name(symbols.intern("-" + std::string(lit->value))), NUMBER);
+        else {
+            operands.back() = make<UnaryExpr>(info->spelling, right);
+            depths.back() = deeper(depths.back() + 1);
+        }
+        operands.back()->position = position;
+    };
+
+    while (true) {
+        while (true) {
+            const Token& token = peek();
+            if (token.type == LPAREN && text(token) == "(") {
+                operators.push_back({nullptr, token.position});
+                open++;
+            } else if (const OperatorInfo* info = prefixOperator(token.type, text(token))) {
+                operators.push_back({info, token.position});
+            } else {
+                break;
+            }
+            advance();
+        }
+        negated = !operators.empty() && operators.back().info && operators.back().info->fixity == Fixity::Prefix &&
+                  operators.back().info->spelling == "-";
+        operands.push_back(parsePrimary());
+        negated = false;
+        depths.push_back(depth);
+
+        while (open && peek().type == RPAREN && text(peek()) == ")") {
+            while (operators.back().info) reduce();
+            operators.pop_back();
+            open--;
+            advance();
+        }
+        const OperatorInfo* info = binaryOperator(peek().type, text(peek()));
+        if (!info) break;
+        while (!operators.empty() && operators.back().info &&
+               (operators.back().info->precedence > info->precedence ||
+                (operators.back().info->precedence == info->precedence && info->fixity == Fixity::Left)))
+            reduce();
+        operators.push_back({info, peek().position});
+        advance();
+    }
+    if (open) throw std::runtime_error("Parser error: Expected ) to close (");
+    while (!operators.empty()) reduce();
+    depth = depths.back();
+    return operands.back();
 }
 
 ASTNode* Parser::parseStatement() {
+    SourcePosition position = peek().position;
+    ASTNode* stmt = parseBareStatement();
+    stmt->position = position;
+    return stmt;
+}
+
+ASTNode* Parser::parseBareStatement() {
     Token current = peek();
 
     if (current.type == IF) return parseIf();
@@ -106,26 +347,45 @@ ASTNode* Parser::parseStatement() {
     if (current.type == INPUT) {
         advance();
         Token var = expect(IDENTIFIER, "Expected identifier after INPUT");
-        return new InputNode(var.value);
+        return make<InputNode>(text(var), var.symbol);
     }
 
     if (current.type == OUTPUT) {
         advance();
         ExprNode* expr = parseExpression();
-        return new OutputExprNode(expr);
+        return make<OutputExprNode>(expr);
     }
 
-    if (current.type == IDENTIFIER && pos + 1 < tokens.size() && tokens[pos + 1].type == ASSIGN) {
-        std::string varName = advance().value;
+    if (current.type == DECLARE) return parseDeclare();
+
+    if (current.type == CALL) {
         advance();
-        ExprNode* expr = parseExpression();
+        return make<CallNode>(parseCall());
+    }
 
-        std::string type = "auto";
-        if (tokens[pos-1].type == STRING) type = "string";
-        else if (tokens[pos-1].type == NUMBER) type = "int";
+    if (current.type == RETURN) {
+        advance();
+        if (!subroutine) throw std::runtime_error("Parser error: RETURN outside a PROCEDURE or FUNCTION");
+        ExprNode* value = subroutine->isFunction() ? parseExpression() : nullptr;
+        return make<ReturnNode>(value, subroutine->result);
+    }
 
+    if (current.type == PROCEDURE || current.type == FUNCTION)
+        throw std::runtime_error("Parser error: " + std::string(text(current)) + " can only be defined at the top level");
 
-        return new AssignNode(varName, expr, type);
+    // Statements never start with an expression, so a[i] here is a store.
+    if (current.type == IDENTIFIER && peek(1).type == LPAREN && text(peek(1)) == "[") {
+        auto target = static_cast<IndexExpr*>(parsePrimary());
+        expect(ASSIGN, "Expected <- after array element");
+        ExprNode* expr = parseExpression();
+        return make<ElementAssignNode>(target, expr);
+    }
+
+    if (current.type == IDENTIFIER && peek(1).type == ASSIGN) {
+        Token var = advance();
+        advance();
+        ExprNode* expr = parseExpression();
+        return make<AssignNode>(text(var), var.symbol, expr);
     }
 
     if (current.type == IF) {
@@ -147,7 +407,7 @@ ASTNode* Parser::parseStatement() {
         }
 
         expect(ENDIF, "Expected ENDIF after IF block");
-        return new IfNode(condition, trueBranch, falseBranch);
+        return make<IfNode>(condition, arena.copyArray(trueBranch), arena.copyArray(falseBranch));
     }
 
     if (current.type == WHILE) {
@@ -159,7 +419,7 @@ ASTNode* Parser::parseStatement() {
             body.push_back(parseStatement());
         }
         expect(ENDWHILE, "Expected ENDWHILE after WHILE loop");
-        return new WhileNode(condition, body);
+        return make<WhileNode>(condition, arena.copyArray(body));
     }
 
     if (current.type == REPEAT) {
@@ -170,38 +430,40 @@ ASTNode* Parser::parseStatement() {
         }
         advance();
         ExprNode* condition = parseExpression();
-        return new RepeatUntilNode(condition, body);
+        return make<RepeatUntilNode>(condition, arena.copyArray(body));
     }
 
     if (current.type == FOR) {
         advance();
-        std::string iterator = expect(IDENTIFIER, "Expected loop variable after FOR").value;
+        Token iterator = expect(IDENTIFIER, "Expected loop variable after FOR");
         expect(ASSIGN, "Expected ← after loop variable");
-        std::string start = expect(NUMBER, "Expected start value").value;
+        ExprNode* start = parseExpression();
         expect(TO, "Expected TO after start value");
-        Token endToken = expect(IDENTIFIER, "Expected end value");
-        if (endToken.type != NUMBER && endToken.type != IDENTIFIER) throw std::runtime_error("Expected end value");
-        std::string end = endToken.value;
-
-        std::string step = "1";
+        ExprNode* end = parseExpression();
+        ExprNode* step = match(STEP) ? parseExpression() : make<LiteralExpr>(symbols.name(symbols.intern("1")), NUMBER);
         std::vector<ASTNode*> body;
         while (peek().type != NEXT) {
             body.push_back(parseStatement());
         }
         expect(NEXT, "Expected NEXT to close FOR loop");
 
-        return new ForNode(iterator, start, end, step, body);
+        return make<ForNode>(text(iterator), iterator.symbol, start, end, step, arena.copyArray(body));
     }
 
-    throw std::runtime_error("Unknown statement starting with: " + current.value);
+    throw std::runtime_error("Unknown statement starting with: " + std::string(text(current)));
 }
 
 ProgramNode* Parser::parseProgram() {
-    auto* program = new ProgramNode();
+    auto* program = make<ProgramNode>();
 
+    std::vector<ASTNode*> statements;
+    std::vector<SubroutineNode*> subroutines;
     while (peek().type != END) {
-        program->statements.push_back(parseStatement());
+        if (peek().type == PROCEDURE || peek().type == FUNCTION) subroutines.push_back(parseSubroutine());
+        else statements.push_back(parseStatement());
     }
+    program->statements = arena.copyArray(statements);
+    program->subroutines = arena.copyArray(subroutines);
 
     return program;
 }
@@ -3,22 +3,58 @@
 #include <string>
 #include "lexer.hpp"
 #include "ast.hpp"
+#include "context.hpp"
+
+// Typing, optimizing and generating code still walk expressions
+// recursively, so nesting is capped well below what their stack allows.
+// Calls and indexes inside one another also recurse in the parser, which
+// takes more stack per level, so they have a lower cap of their own.
+constexpr uint32_t maxExpressionDepth = 10000;
+constexpr uint32_t maxNestedExpressions = 1000;
 
 class Parser {
-    std::vector<Token> tokens;
-    size_t pos;
+    TokenStream tokens;
+    Arena& arena;
+    SymbolTable& symbols;
+    size_t nodes = 0;
+    // The PROCEDURE or FUNCTION whose body is being parsed.
+    const SubroutineNode* subroutine = nullptr;
+    // How deeply the expression parsed last nests, and how many expressions
+    // are open around the one being parsed, as in f(g(x)).
+    uint32_t depth = 0;
+    uint32_t openExpressions = 0;
+    // Set while parsing the operand of a prefix minus, which folds into a
+    // number literal.
+    bool negated = false;
+
+    uint32_t deeper(uint32_t levels) const;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        nodes++;
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
 public:
-    Parser(const std::vector<Token>& tokens);
-    Token peek() const;
+    Parser(Lexer& lexer, CompilationContext& context);
+    std::string_view text(const Token& token) const;
+    const Token& peek(size_t ahead = 0);
     Token advance();
     bool match(TokenType type);
     Token expect(TokenType type, const std::string& errorMsg);
+    // True when the next token is the parenthesis or bracket spelling.
+    bool atParenthesis(const char* spelling);
     ExprNode* parseLiteral();
     ExprNode* parseExpression();
     ExprNode* parsePrimary();
+    CallExpr* parseCall();
     ASTNode* parseIf();
-    int getPrecedence(const std::string& op);
-    ExprNode* parseBinaryOpRHS(int exprPrec, ExprNode* lhs);
+    SubroutineNode* parseSubroutine();
+    ASTNode* parseDeclare();
+    // A statement, positioned at its first token.
     ASTNode* parseStatement();
+    ASTNode* parseBareStatement();
     ProgramNode* parseProgram();
+    // AST nodes built so far.
+    size_t nodeCount() const { return nodes; }
 };
\ No newline at end of file
@@ -0,0 +1,537 @@
+#include "ranges.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Wide enough for the product of any two 64-bit values.
+using Bound = __int128;
+
+constexpr Bound int32Min = INT32_MIN, int32Max = INT32_MAX;
+constexpr Bound int64Min = INT64_MIN, int64Max = INT64_MAX;
+
+// The values an integer can take, both ends included. Empty for a value
+// that is never computed.
+struct Range {
+    Bound low = 1, high = 0;
+
+    bool empty() const { return low > high; }
+    bool within(Bound min, Bound max) const { return empty() || (low >= min && high <= max); }
+    bool operator==(const Range& other) const {
+        return (empty() && other.empty()) || (low == other.low && high == other.high);
+    }
+};
+
+constexpr Range everything{int64Min, int64Max};
+constexpr Range int32Values{int32Min, int32Max};
+constexpr Range boolean{0, 1};
+
+Range hull(Range a, Range b) {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    return {std::min(a.low, b.low), std::max(a.high, b.high)};
+}
+
+Range meet(Range a, Range b) {
+    return {std::max(a.low, b.low), std::min(a.high, b.high)};
+}
+
+Range sum(Range a, Range b) {
+    if (a.empty() || b.empty()) return Range();
+    return {a.low + b.low, a.high + b.high};
+}
+
+Range negated(Range a) {
+    return a.empty() ? a : Range{-a.high, -a.low};
+}
+
+Bound magnitude(Range a) {
+    return std::max(a.low < 0 ? -a.low : a.low, a.high < 0 ? -a.high : a.high);
+}
+
+Range corners(Bound a, Bound b, Bound c, Bound d) {
+    return {std::min({a, b, c, d}), std::max({a, b, c, d})};
+}
+
+// Truncating division is monotonic in each operand while the divisor keeps
+// its sign, so the corners of each sign of the divisor bound the quotient.
+// Dividing by zero is left to the program.
+Range quotient(Range a, Range b) {
+    Range result;
+    for (Range part : {meet(b, Range{int64Min, -1}), meet(b, Range{1, int64Max})}) {
+        if (part.empty()) continue;
+        result = hull(result, corners(a.low / part.low, a.low / part.high, a.high / part.low, a.high / part.high));
+    }
+    return result;
+}
+
+// A remainder is smaller than the divisor and no larger than the dividend,
+// and takes the dividend's sign.
+Range remainder(Range a, Range b) {
+    Bound limit = std::min(magnitude(b) - 1, magnitude(a));
+    return {a.low < 0 ? -limit : 0, a.high > 0 ? limit : 0};
+}
+
+std::string_view flipped(std::string_view op) {
+    if (op == "<") return ">";
+    if (op == ">") return "<";
+    if (op == "<=") return ">=";
+    if (op == ">=") return "<=";
+    return op;
+}
+
+// The comparison that holds when op does not; empty when that says nothing
+// a range can express.
+std::string_view opposite(std::string_view op) {
+    if (op == "<") return ">=";
+    if (op == "<=") return ">";
+    if (op == ">") return "<=";
+    if (op == ">=") return "<";
+    if (op == "<>" || op == "!=") return "=";
+    return "";
+}
+
+bool mentions(const ExprNode* expr, uint32_t symbol) {
+    if (auto var = dynamic_cast<const VariableExpr*>(expr)) return var->symbol == symbol;
+    if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) return mentions(unary->operand, symbol);
+    if (auto bin = dynamic_cast<const BinaryExpr*>(expr)) return mentions(bin->left, symbol) || mentions(bin->right, symbol);
+    if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+        if (mentions(idx->base, symbol)) return true;
+        return std::any_of(idx->indices.begin(), idx->indices.end(), [&](auto index) { return mentions(index, symbol); });
+    }
+    if (auto call = dynamic_cast<const CallExpr*>(expr))
+        return std::any_of(call->arguments.begin(), call->arguments.end(), [&](auto arg) { return mentions(arg, symbol); });
+    return false;
+}
+
+size_t countWrites(NodeList block, uint32_t symbol) {
+    size_t count = 0;
+    for (auto stmt : block) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            count += input->symbol == symbol;
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            count += assign->symbol == symbol;
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            count += countWrites(ifNode->thenBranch, symbol) + countWrites(ifNode->elseBranch, symbol);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            count += countWrites(whileNode->body, symbol);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            count += countWrites(repeat->body, symbol);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            count += (forNode->symbol == symbol) + countWrites(forNode->body, symbol);
+        }
+    }
+    return count;
+}
+
+// The range of every integer variable of one scope at one point of the
+// program, or nothing at all where the program cannot get to.
+struct Env {
+    std::vector<Range> values;
+    bool reachable = true;
+
+    bool operator==(const Env& other) const {
+        return reachable == other.reachable && (!reachable || values == other.values);
+    }
+};
+
+Env join(const Env& a, const Env& b) {
+    if (!a.reachable) return b;
+    if (!b.reachable) return a;
+    Env result = a;
+    for (size_t i = 0; i < result.values.size(); i++) result.values[i] = hull(a.values[i], b.values[i]);
+    return result;
+}
+
+// Follows the program statement by statement, so a variable's range at a
+// read is what the assignments that can reach it allow, narrowed by the
+// WHILE, IF and FOR conditions around it. Loops repeat until their ranges
+// settle; a bound that keeps growing jumps to the 64-bit limit after a few
+// rounds, and a few more rounds from there win back what the loop
+// conditions allow. Widths are only recorded on the last visit of each
+// statement, once the loops around it have settled.
+class RangeAnalysis {
+    static constexpr int growthLimit = 2;
+    static constexpr int narrowingRounds = 3;
+
+    // A variable that a FOR body changes once per trip, by adding or
+    // subtracting something else, stays within the trip count times what
+    // it adds. This keeps running sums out of 64-bit arithmetic.
+    struct Accumulator {
+        const AssignNode* assign;
+        size_t slot;
+        Range entry;
+        Range added;
+        Bound trips;
+
+        Range bound() const {
+            if (added.empty()) return entry;
+            Range reach{entry.low + trips * std::min<Bound>(added.low, 0),
+                        entry.high + trips * std::max<Bound>(added.high, 0)};
+            return meet(reach, everything);
+        }
+    };
+
+    CompilationContext& context;
+    std::unordered_map<uint32_t, size_t> slots;
+    std::vector<bool> declaredWidth;
+    std::vector<Range> seen;
+    std::vector<Accumulator> accumulators;
+    bool recording = true;
+
+public:
+    explicit RangeAnalysis(CompilationContext& context) : context(context) {}
+
+    void run(const ProgramNode* program) {
+        context.integerOps.clear();
+        for (auto subroutine : program->subroutines) {
+            SubroutineInfo& info = context.subroutines.at(subroutine->symbol);
+            context.variables.pushScope();
+            for (auto [symbol, type] : info.variables) context.variables.declareLocal(symbol, type);
+            Env env = scope(info.variables);
+            // Parameters keep their declared width; what is assigned to them
+            // is checked on the way in.
+            for (const auto& parameter : subroutine->parameters) {
+                auto it = slots.find(parameter.symbol);
+                if (it == slots.end()) continue;
+                env.values[it->second] = seen[it->second] = int32Values;
+                declaredWidth[it->second] = true;
+            }
+            visit(subroutine->body, env);
+            for (auto& [symbol, type] : info.variables) type = chosenType(symbol, type);
+            context.variables.popScope();
+        }
+
+        std::vector<std::pair<uint32_t, ValueType>> variables;
+        for (uint32_t symbol : context.variables.declarations())
+            variables.emplace_back(symbol, context.variables.typeOf(symbol));
+        Env env = scope(variables);
+        visit(program->statements, env);
+        for (auto [symbol, type] : variables) context.variables.assign(symbol, chosenType(symbol, type));
+    }
+
+private:
+    // Every integer variable starts at zero, as its C++ declaration does.
+    Env scope(const std::vector<std::pair<uint32_t, ValueType>>& variables) {
+        slots.clear();
+        for (auto [symbol, type] : variables)
+            if (isIntegral(type)) slots.emplace(symbol, slots.size());
+        declaredWidth.assign(slots.size(), false);
+        seen.assign(slots.size(), Range{0, 0});
+        return Env{std::vector<Range>(slots.size(), Range{0, 0})};
+    }
+
+    ValueType chosenType(uint32_t symbol, ValueType type) const {
+        auto it = slots.find(symbol);
+        if (type != ValueType::Int || it == slots.end() || declaredWidth[it->second]) return type;
+        return seen[it->second].within(int32Min, int32Max) ? ValueType::Int : ValueType::Long;
+    }
+
+    std::optional<size_t> slotOf(uint32_t symbol) const {
+        auto it = slots.find(symbol);
+        if (it == slots.end()) return std::nullopt;
+        return it->second;
+    }
+
+    void assign(Env& env, size_t slot, Range range) {
+        range = meet(range, declaredWidth[slot] ? int32Values : everything);
+        env.values[slot] = range;
+        if (recording) seen[slot] = hull(seen[slot], range);
+    }
+
+    // The range of an integer operation, variable or literal, which sets how
+    // it is computed or whether storing it into 32 bits needs a check.
+    Range classify(const ExprNode* node, Range result) {
+        IntegerOp width = IntegerOp::Narrow;
+        if (!result.within(int64Min, int64Max)) width = IntegerOp::Checked;
+        else if (!result.within(int32Min, int32Max)) width = IntegerOp::Wide;
+        if (recording && width != IntegerOp::Narrow) {
+            IntegerOp& recorded = context.integerOps[node];
+            recorded = std::max(recorded, width);
+        }
+        return meet(result, everything);
+    }
+
+    Range value(const ExprNode* expr, const Env& env) {
+        if (auto lit = dynamic_cast<const LiteralExpr*>(expr)) {
+            if (lit->type == TRUE || lit->type == FALSE) return boolean;
+            long long number;
+            auto [end, ec] = std::from_chars(lit->value.data(), lit->value.data() + lit->value.size(), number);
+            if (lit->type != NUMBER || ec != std::errc() || end != lit->value.data() + lit->value.size())
+                return everything;
+            return classify(lit, {number, number});
+        }
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            if (context.variables.typeOf(var->symbol) == ValueType::Bool) return boolean;
+            std::optional<size_t> slot = slotOf(var->symbol);
+            return slot ? classify(var, env.values[*slot]) : everything;
+        }
+        if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+            for (auto argument : call->arguments) value(argument, env);
+            ValueType result = call->inferType(context);
+            if (result == ValueType::Bool) return boolean;
+            return result == ValueType::Int ? int32Values : everything;
+        }
+        if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+            for (auto index : idx->indices) value(index, env);
+            ValueType element = idx->inferType(context);
+            if (element == ValueType::Bool) return boolean;
+            return element == ValueType::Int && idx->array(context) ? int32Values : everything;
+        }
+        if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            Range operand = value(unary->operand, env);
+            if (unary->op == "NOT") return boolean;
+            if (!isIntegral(unary->inferType(context)) || operand.empty()) return everything;
+            return classify(unary, negated(operand));
+        }
+        auto bin = dynamic_cast<const BinaryExpr*>(expr);
+        if (!bin) return everything;
+        Range l = value(bin->left, env), r = value(bin->right, env);
+        if (isComparisonOperator(bin->op) || isLogicalOperator(bin->op)) return boolean;
+        if (!isIntegral(bin->inferType(context)) || l.empty() || r.empty()) return everything;
+        if (bin->op == "+") return classify(bin, sum(l, r));
+        if (bin->op == "-") return classify(bin, sum(l, negated(r)));
+        if (bin->op == "*")
+            return classify(bin, corners(l.low * r.low, l.low * r.high, l.high * r.low, l.high * r.high));
+        if (bin->op == "/") return classify(bin, quotient(l, r));
+        // x % -1 traps where x / -1 overflows, so both go by the quotient.
+        classify(bin, quotient(l, r));
+        return remainder(l, r);
+    }
+
+    // Narrows env by a condition that holds, or that does not. Comparisons
+    // between an integer variable and an integer expression narrow the
+    // variable; AND and OR narrow by both sides where both must hold.
+    void assume(Env& env, const ExprNode* condition, bool holds) {
+        if (!env.reachable) return;
+        if (auto unary = dynamic_cast<const UnaryExpr*>(condition)) {
+            if (unary->op == "NOT") assume(env, unary->operand, !holds);
+            return;
+        }
+        auto bin = dynamic_cast<const BinaryExpr*>(condition);
+        if (!bin) return;
+        if ((bin->op == "AND" && holds) || (bin->op == "OR" && !holds)) {
+            assume(env, bin->left, holds);
+            assume(env, bin->right, holds);
+        } else if (isComparisonOperator(bin->op)) {
+            std::string_view op = holds ? bin->op : opposite(bin->op);
+            if (op.empty() || op == "<>" || op == "!=") return;
+            bound(env, bin->left, op, bin->right);
+            bound(env, bin->right, flipped(op), bin->left);
+        }
+    }
+
+    void bound(Env& env, const ExprNode* side, std::string_view op, const ExprNode* other) {
+        auto var = dynamic_cast<const VariableExpr*>(side);
+        std::optional<size_t> slot = var ? slotOf(var->symbol) : std::nullopt;
+        if (!slot || !env.reachable || !isIntegral(other->inferType(context))) return;
+        Range limit = value(other, env), allowed = everything;
+        if (op == "<") allowed.high = limit.high - 1;
+        else if (op == "<=") allowed.high = limit.high;
+        else if (op == ">") allowed.low = limit.low + 1;
+        else if (op == ">=") allowed.low = limit.low;
+        else allowed = limit;
+        Range narrowed = meet(env.values[*slot], allowed);
+        if (narrowed.empty()) env.reachable = false;
+        else env.values[*slot] = narrowed;
+    }
+
+    // Runs a loop to its fixpoint without recording, then once more with
+    // recording as it was, from the head that settled. iteration takes the
+    // state at the loop test and returns the one that comes back to it.
+    template <typename Iteration>
+    Env settle(const Env& entry, Iteration iteration) {
+        bool wasRecording = recording;
+        recording = false;
+        Env head = entry;
+        for (int round = 0;; round++) {
+            Env next = join(head, iteration(head));
+            if (round >= growthLimit && head.reachable && next.reachable) {
+                for (size_t i = 0; i < next.values.size(); i++) {
+                    Range before = head.values[i];
+                    Range& after = next.values[i];
+                    if (before.empty()) continue;
+                    if (after.low < before.low) after.low = int64Min;
+                    if (after.high > before.high) after.high = int64Max;
+                }
+            }
+            if (next == head) break;
+            head = next;
+        }
+        for (int round = 0; round < narrowingRounds; round++) {
+            Env next = join(entry, iteration(head));
+            if (next == head) break;
+            head = next;
+        }
+        recording = wasRecording;
+        return head;
+    }
+
+    void visit(NodeList block, Env& env) {
+        for (auto stmt : block) visit(stmt, env);
+    }
+
+    void visit(const ASTNode* stmt, Env& env) {
+        if (!env.reachable) return;
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            if (std::optional<size_t> slot = slotOf(input->symbol)) assign(env, *slot, everything);
+        } else if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+            value(output->expr, env);
+        } else if (auto assignment = dynamic_cast<const AssignNode*>(stmt)) {
+            visitAssign(assignment, env);
+        } else if (auto assignment = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            value(assignment->target, env);
+            value(assignment->expr, env);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            for (const auto& bound : declare->bounds) {
+                value(bound.lower, env);
+                value(bound.upper, env);
+            }
+        } else if (auto call = dynamic_cast<const CallNode*>(stmt)) {
+            value(call->call, env);
+        } else if (auto ret = dynamic_cast<const ReturnNode*>(stmt)) {
+            if (ret->value) value(ret->value, env);
+            env.reachable = false;
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            value(ifNode->condition, env);
+            Env otherwise = env;
+            assume(env, ifNode->condition, true);
+            visit(ifNode->thenBranch, env);
+            assume(otherwise, ifNode->condition, false);
+            visit(ifNode->elseBranch, otherwise);
+            env = join(env, otherwise);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            auto iteration = [&](Env state) {
+                value(whileNode->condition, state);
+                assume(state, whileNode->condition, true);
+                visit(whileNode->body, state);
+                return state;
+            };
+            env = settle(env, iteration);
+            iteration(env);
+            assume(env, whileNode->condition, false);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            Env after;
+            auto iteration = [&](Env state) {
+                visit(repeat->body, state);
+                if (state.reachable) value(repeat->condition, state);
+                after = state;
+                assume(state, repeat->condition, false);
+                return state;
+            };
+            iteration(settle(env, iteration));
+            env = after;
+            assume(env, repeat->condition, true);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            visitFor(forNode, env);
+        }
+    }
+
+    void visitAssign(const AssignNode* assignment, Env& env) {
+        std::optional<size_t> slot = slotOf(assignment->symbol);
+        auto accumulator = std::find_if(accumulators.begin(), accumulators.end(),
+                                        [&](const Accumulator& candidate) { return candidate.assign == assignment; });
+        if (!slot || accumulator == accumulators.end()) {
+            Range result = value(assignment->expr, env);
+            if (slot) assign(env, *slot, result);
+            return;
+        }
+        auto bin = static_cast<const BinaryExpr*>(assignment->expr);
+        bool onLeft = mentions(bin->left, assignment->symbol);
+        Range added = value(onLeft ? bin->right : bin->left, env);
+        if (bin->op == "-") added = negated(added);
+        accumulator->added = hull(accumulator->added, added);
+        Range result = meet(sum(env.values[*slot], added), accumulator->bound());
+        assign(env, *slot, classify(bin, result));
+    }
+
+    // The iterator runs from start towards end and stops one step past it,
+    // or stays at start when the body never runs. Inside the body it stays
+    // between the two unless the body assigns it.
+    void visitFor(const ForNode* forNode, Env& env) {
+        Range start = value(forNode->startExpr, env), end = value(forNode->endExpr, env);
+        Range step = value(forNode->stepExpr, env);
+        std::optional<size_t> iterator = slotOf(forNode->symbol);
+        if (!iterator || start.empty() || end.empty() || step.empty()) {
+            auto iteration = [&](Env state) {
+                if (iterator) assign(state, *iterator, everything);
+                visit(forNode->body, state);
+                return state;
+            };
+            env = settle(env, iteration);
+            iteration(env);
+            return;
+        }
+        Range inside, taken;
+        std::optional<Bound> trips;
+        if (step.low > 0) {
+            inside = {start.low, end.high};
+            taken = {start.low, std::max(start.high, end.high + step.high)};
+            trips = inside.empty() ? 0 : (end.high - start.low) / step.low + 1;
+        } else if (step.high < 0) {
+            inside = {end.low, start.high};
+            taken = {std::min(start.low, end.low + step.low), start.high};
+            trips = inside.empty() ? 0 : (start.high - end.low) / -step.high + 1;
+        } else {
+            inside = hull(start, end);
+            taken = {std::min(start.low, end.low + step.low), std::max(start.high, end.high + step.high)};
+        }
+        // The step past the end can leave the 64-bit range, where the
+        // increment itself overflows.
+        taken = meet(taken, everything);
+        assign(env, *iterator, start);
+        bool assigned = countWrites(forNode->body, forNode->symbol) > 0;
+
+        // A body that writes the iterator can keep the loop going for any
+        // number of trips.
+        size_t outer = accumulators.size();
+        if (!assigned && trips && *trips <= int32Max) findAccumulators(forNode, env, *trips);
+        auto iteration = [&](Env state) {
+            // Each trip adds to the running sums afresh.
+            for (size_t i = outer; i < accumulators.size(); i++) accumulators[i].added = Range();
+            if (!assigned) state.values[*iterator] = inside;
+            else if (step.low > 0) state.values[*iterator] = meet(state.values[*iterator], {int64Min, end.high});
+            else if (step.high < 0) state.values[*iterator] = meet(state.values[*iterator], {end.low, int64Max});
+            if (state.values[*iterator].empty()) state.reachable = false;
+            visit(forNode->body, state);
+            if (state.reachable) assign(state, *iterator, assigned ? sum(state.values[*iterator], step) : taken);
+            for (size_t i = outer; i < accumulators.size(); i++)
+                if (state.reachable) state.values[accumulators[i].slot] = accumulators[i].bound();
+            return state;
+        };
+        Env exit = join(env, iteration(settle(env, iteration)));
+        accumulators.resize(outer);
+        if (!assigned && exit.reachable) assign(exit, *iterator, taken);
+        env = exit;
+    }
+
+    // Statements of the body, outside any nested block, of the form
+    // v <- v + e, v <- e + v or v <- v - e, where e does not mention v and
+    // nothing else in the body writes v.
+    void findAccumulators(const ForNode* forNode, const Env& env, Bound trips) {
+        for (auto stmt : forNode->body) {
+            auto assignment = dynamic_cast<const AssignNode*>(stmt);
+            auto bin = assignment ? dynamic_cast<const BinaryExpr*>(assignment->expr) : nullptr;
+            if (!bin || (bin->op != "+" && bin->op != "-") || !isIntegral(bin->inferType(context))) continue;
+            uint32_t symbol = assignment->symbol;
+            std::optional<size_t> slot = slotOf(symbol);
+            if (!slot || declaredWidth[*slot] || symbol == forNode->symbol) continue;
+            auto left = dynamic_cast<const VariableExpr*>(bin->left);
+            auto right = dynamic_cast<const VariableExpr*>(bin->right);
+            bool onLeft = left && left->symbol == symbol && !mentions(bin->right, symbol);
+            bool onRight = bin->op == "+" && right && right->symbol == symbol && !mentions(bin->left, symbol);
+            if ((!onLeft && !onRight) || countWrites(forNode->body, symbol) != 1) continue;
+            accumulators.push_back({assignment, *slot, env.values[*slot], Range(), trips});
+        }
+    }
+};
+
+}
+
+void chooseIntegerWidths(const ProgramNode* program, CompilationContext& context) {
+    RangeAnalysis(context).run(program);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "ast.hpp"
+#include "context.hpp"
+
+// Chooses a width for every integer variable and operation, given the
+// types inferTypes found. Each variable's values are bounded over all its
+// assignments, with WHILE and IF conditions and FOR limits narrowing what a
+// read can see, so i in WHILE i < n stays below n. A variable whose values
+// may not fit in 32 bits becomes Long, INPUT included. Each +, -, *, /, %
+// and negation goes into context.integerOps as Wide when its result needs
+// 64 bits, and as Checked when even 64 may not be enough; a variable or
+// literal goes in as Wide when the value read may not fit in 32 bits.
+void chooseIntegerWidths(const ProgramNode* program, CompilationContext& context);
@@ -0,0 +1,376 @@
+#include "runtime.hpp"
+#include "compile_cache.hpp"
+#include "toolchain.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+const std::string& ioRuntimeSource() {
+    static const std::string source = R"runtime(#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#ifdef _WIN32
+#include <io.h>
+#define PSEUDO_READ ::_read
+#define PSEUDO_WRITE ::_write
+#else
+#include <unistd.h>
+#define PSEUDO_READ ::read
+#define PSEUDO_WRITE ::write
+#endif
+
+namespace pseudo {
+
+struct Output {
+    char buf[1 << 16];
+    size_t len = 0;
+    ~Output() { flush(); }
+    void flush() {
+        size_t done = 0;
+        while (done < len) {
+            long n = PSEUDO_WRITE(1, buf + done, static_cast<unsigned>(len - done));
+            if (n <= 0) break;
+            done += n;
+        }
+        len = 0;
+    }
+    void put(char c) {
+        if (len == sizeof(buf)) flush();
+        buf[len++] = c;
+    }
+    void put(const char* s, size_t n) {
+        while (n > 0) {
+            if (len == sizeof(buf)) flush();
+            size_t chunk = sizeof(buf) - len < n ? sizeof(buf) - len : n;
+            for (size_t i = 0; i < chunk; i++) buf[len + i] = s[i];
+            len += chunk;
+            s += chunk;
+            n -= chunk;
+        }
+    }
+};
+
+struct Input {
+    char buf[1 << 16];
+    size_t pos = 0, len = 0;
+    int peek();
+    void token(std::string& s) {
+        s.clear();
+        int c = peek();
+        while (c == ' ' || c == '\n' || c == '\r' || c == '\t') { pos++; c = peek(); }
+        while (c != EOF && c != ' ' && c != '\n' && c != '\r' && c != '\t') { s.push_back(static_cast<char>(c)); pos++; c = peek(); }
+    }
+};
+
+inline Output out;
+inline Input in;
+
+// Pending output is flushed before blocking on input so prompts appear.
+inline int Input::peek() {
+    if (pos == len) {
+        out.flush();
+        long n = PSEUDO_READ(0, buf, sizeof(buf));
+        pos = 0;
+        len = n > 0 ? static_cast<size_t>(n) : 0;
+        if (len == 0) return EOF;
+    }
+    return static_cast<unsigned char>(buf[pos]);
+}
+
+// Runtime errors keep the output printed so far, which is what shows where
+// the program got to.
+[[noreturn]] inline void fail(const char* message, const char* array) {
+    out.flush();
+    std::string text = std::string("Runtime error: ") + message + array + "\n";
+    long n = PSEUDO_WRITE(2, text.data(), static_cast<unsigned>(text.size()));
+    (void)n;
+    std::_Exit(1);
+}
+
+inline void read(std::string& s) { in.token(s); }
+inline void read(long long& x) {
+    int c = in.peek();
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') { in.pos++; c = in.peek(); }
+    bool negative = c == '-';
+    if (c == '-' || c == '+') { in.pos++; c = in.peek(); }
+    // The magnitude may reach LLONG_MAX + 1 only for a negative number.
+    unsigned long long limit = static_cast<unsigned long long>(LLONG_MAX) + negative;
+    unsigned long long v = 0;
+    if (c < '0' || c > '9') fail("no integer in input", "");
+    while (c >= '0' && c <= '9') {
+        if (v > (limit - (c - '0')) / 10) fail("integer overflow reading input", "");
+        v = v * 10 + (c - '0');
+        in.pos++;
+        c = in.peek();
+    }
+    x = negative ? static_cast<long long>(0ULL - v) : static_cast<long long>(v);
+}
+inline void read(int& x) {
+    long long v;
+    read(v);
+    if (v < INT_MIN || v > INT_MAX) fail("integer overflow reading input", "");
+    x = static_cast<int>(v);
+}
+inline void read(double& x) {
+    std::string s;
+    in.token(s);
+    x = std::strtod(s.c_str(), nullptr);
+}
+inline void read(bool& x) {
+    long long v;
+    read(v);
+    x = v != 0;
+}
+
+inline void write(long long x) {
+    char digits[24];
+    int n = 0;
+    unsigned long long u = x < 0 ? 0ULL - static_cast<unsigned long long>(x) : static_cast<unsigned long long>(x);
+    do { digits[n++] = static_cast<char>('0' + u % 10); u /= 10; } while (u);
+    if (x < 0) out.put('-');
+    while (n) out.put(digits[--n]);
+}
+inline void write(int x) { write(static_cast<long long>(x)); }
+inline void write(bool x) { out.put(x ? '1' : '0'); }
+inline void write(char c) { out.put(c); }
+inline void write(double x) {
+    char text[32];
+    int n = std::snprintf(text, sizeof(text), "%g", x);
+    out.put(text, static_cast<size_t>(n));
+}
+inline void write(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    out.put(s, n);
+}
+inline void write(const std::string& s) { out.put(s.data(), s.size()); }
+
+template <typename T>
+inline void print(const T& value) {
+    write(value);
+    out.put('\n');
+}
+
+// Elements of one array in row-major order, value-initialised. The
+// generated code keeps the bounds and does the index arithmetic.
+template <typename T>
+struct Array {
+    T* data = nullptr;
+    Array() = default;
+    Array(const Array&) = delete;
+    Array& operator=(const Array&) = delete;
+    ~Array() { delete[] data; }
+    void allocate(long long count) {
+        delete[] data;
+        data = new T[count]();
+    }
+    T& operator[](long long i) { return data[i]; }
+};
+
+inline long long extent(int lower, int upper, const char* array) {
+    if (upper < lower - 1) fail("invalid bounds for array ", array);
+    return static_cast<long long>(upper) - lower + 1;
+}
+
+inline long long index(long long i, int lower, int upper, const char* array) {
+    if (i < lower || i > upper) fail("index out of range for array ", array);
+    return i - lower;
+}
+
+// Arithmetic the range pass could not prove fits in 64 bits, and 64-bit
+// values stored into 32. Overflow ends the program like an array error.
+[[noreturn]] inline void overflow(int line) {
+    std::string where = line > 0 ? " on line " + std::to_string(line) : "";
+    fail("integer overflow", where.c_str());
+}
+
+inline long long checkedAdd(long long a, long long b, int line) {
+    long long r;
+    if (__builtin_add_overflow(a, b, &r)) overflow(line);
+    return r;
+}
+inline long long checkedSub(long long a, long long b, int line) {
+    long long r;
+    if (__builtin_sub_overflow(a, b, &r)) overflow(line);
+    return r;
+}
+inline long long checkedMul(long long a, long long b, int line) {
+    long long r;
+    if (__builtin_mul_overflow(a, b, &r)) overflow(line);
+    return r;
+}
+inline long long checkedDiv(long long a, long long b, int line) {
+    if (b == -1 && a == LLONG_MIN) overflow(line);
+    return a / b;
+}
+inline long long checkedMod(long long a, long long b, int line) {
+    if (b == -1 && a == LLONG_MIN) overflow(line);
+    return a % b;
+}
+inline long long checkedNeg(long long a, int line) {
+    if (a == LLONG_MIN) overflow(line);
+    return -a;
+}
+inline int checkedNarrow(long long a, int line) {
+    if (a < INT_MIN || a > INT_MAX) overflow(line);
+    return static_cast<int>(a);
+}
+
+}
+)runtime";
+    return source;
+}
+
+// Follows ioRuntimeSource() in a --profile build. Each probe reads the
+// cycle counter once and charges the time since the previous probe to the
+// line that one was for, so a line is only charged for its own work. Ticks
+// become milliseconds in proportion to the wall time of the whole run.
+const std::string& profileRuntimeSource() {
+    static const std::string source = R"runtime(#include <chrono>
+#include <csignal>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace pseudo {
+
+struct Profile {
+    struct Line {
+        unsigned long long hits = 0, ticks = 0;
+    };
+    std::vector<Line> lines;
+    const char* const* source = nullptr;
+    unsigned current = 0;
+    unsigned long long first = 0, last = 0;
+    std::chrono::steady_clock::time_point started;
+
+    ~Profile() { report(); }
+
+    static unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void begin(const char* const* text, unsigned count);
+    void at(unsigned line) {
+        resume(line);
+        lines[line].hits++;
+    }
+    void resume(unsigned line) {
+        unsigned long long now = ticks();
+        lines[current].ticks += now - last;
+        last = now;
+        current = line;
+    }
+    void report();
+};
+
+inline Profile profile;
+
+// Held by every PROCEDURE and FUNCTION, so that the rest of the calling
+// line is charged to the caller again.
+struct ProfileFrame {
+    unsigned caller = profile.current;
+    ~ProfileFrame() { profile.resume(caller); }
+};
+
+// A program stopped for taking too long still reports where the time went.
+inline void stopProfiled(int signal) {
+    profile.report();
+    std::_Exit(128 + signal);
+}
+
+inline void Profile::begin(const char* const* text, unsigned count) {
+    source = text;
+    lines.assign(count + 1, Line());
+    started = std::chrono::steady_clock::now();
+    first = last = ticks();
+    for (int signal : {SIGINT, SIGTERM})
+        std::signal(signal, stopProfiled);
+#ifdef SIGXCPU
+    std::signal(SIGXCPU, stopProfiled);
+#endif
+}
+
+// Goes to stderr, after the program's own output, and only once.
+inline void Profile::report() {
+    if (lines.empty()) return;
+    resume(current);
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    double total = static_cast<double>(last - first);
+    out.flush();
+    std::string text = "\nline        hits     self ms  self %  source\n";
+    char row[80];
+    for (size_t i = 1; i < lines.size(); i++) {
+        if (!lines[i].hits) continue;
+        double share = total > 0 ? lines[i].ticks / total : 0;
+        std::snprintf(row, sizeof(row), "%4zu %11llu %11.3f %6.1f%%  ", i, lines[i].hits, share * wallMs, share * 100);
+        text += row;
+        text += source[i];
+        text += '\n';
+    }
+    lines.clear();
+    size_t done = 0;
+    while (done < text.size()) {
+        long n = PSEUDO_WRITE(2, text.data() + done, static_cast<unsigned>(text.size() - done));
+        if (n <= 0) break;
+        done += n;
+    }
+}
+
+}
+)runtime";
+    return source;
+}
+
+const std::string& runtimeHeaderSource() {
+    static const std::string source =
+        "#include <map>\n"
+        "#include <string>\n"
+        "#include <tuple>\n"
+        "#include <vector>\n" + ioRuntimeSource() +
+        "using namespace std;\n";
+    return source;
+}
+
+fs::path runtimePchDirectory(const fs::path& cacheDir, const std::string& compilerVersion, const std::string& flags) {
+    return cacheDir / "pch" / CompileCache::makeKey(runtimeHeaderSource(), compilerVersion, flags).substr(0, 16);
+}
+
+void ensureRuntimePch(const fs::path& pchDir, const std::string& compiler, const std::string& flags) {
+    fs::path header = pchDir / runtimeHeaderName;
+    fs::path pch = header;
+    pch += ".gch";
+    if (fs::exists(pch)) return;
+
+    fs::create_directories(pchDir);
+    // Both files are written under a name of this process's own and renamed
+    // into place, so a concurrent compile never includes a half-written
+    // header or PCH. Every writer produces the same header, so replacing one
+    // another's is harmless.
+    std::string suffix = "." + std::to_string(getpid()) + ".tmp";
+    fs::path tempHeader = header;
+    tempHeader += suffix;
+    {
+        std::ofstream out(tempHeader);
+        out << runtimeHeaderSource();
+        if (!out) throw std::runtime_error("Could not write " + tempHeader.string());
+    }
+    fs::rename(tempHeader, header);
+
+    fs::path temp = pch;
+    temp += suffix;
+    std::string headerFlags = (flags.empty() ? "" : flags + " ") + "-x c++-header";
+    if (invokeCompiler(compiler, headerFlags, "\"" + header.string() + "\"", "\"" + temp.string() + "\"") != 0) {
+        fs::remove(temp);
+        throw std::runtime_error("Could not build precompiled runtime header");
+    }
+    fs::rename(temp, pch);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+inline constexpr const char* runtimeHeaderName = "pseudo_runtime.hpp";
+
+const std::string& ioRuntimeSource();
+const std::string& profileRuntimeSource();
+const std::string& runtimeHeaderSource();
+
+std::filesystem::path runtimePchDirectory(const std::filesystem::path& cacheDir, const std::string& compilerVersion, const std::string& flags);
+void ensureRuntimePch(const std::filesystem::path& pchDir, const std::string& compiler, const std::string& flags);
@@ -0,0 +1,524 @@
+#include "server.hpp"
+#include "compile_cache.hpp"
+#include "compiler.hpp"
+#include "runtime.hpp"
+#include "toolchain.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr uint32_t maxFieldBytes = 256u << 20;
+constexpr size_t latencySamples = 4096;
+
+std::atomic<bool> stopRequested{false};
+void requestStop(int) { stopRequested = true; }
+
+double elapsedMs(Clock::time_point start, Clock::time_point end = Clock::now()) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::string quoted(const fs::path& path) {
+    return "\"" + path.string() + "\"";
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// A message is a fixed sequence of fields, each a 32-bit length in host
+// byte order and that many bytes; both ends run on the same machine.
+bool writeField(int fd, std::string_view field) {
+    uint32_t length = static_cast<uint32_t>(field.size());
+    return writeAll(fd, reinterpret_cast<const char*>(&length), sizeof(length)) &&
+           writeAll(fd, field.data(), field.size());
+}
+
+bool readField(int fd, std::string& field) {
+    uint32_t length = 0;
+    if (!readAll(fd, reinterpret_cast<char*>(&length), sizeof(length)) || length > maxFieldBytes) return false;
+    field.resize(length);
+    return readAll(fd, field.data(), length);
+}
+
+bool writeResponse(int fd, const ServerResponse& response) {
+    return writeField(fd, std::to_string(response.exitCode)) && writeField(fd, response.out) &&
+           writeField(fd, response.err);
+}
+
+bool socketAddress(const fs::path& path, sockaddr_un& address) {
+    std::string name = path.string();
+    if (name.empty() || name.size() >= sizeof(address.sun_path)) return false;
+    address = {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+    return true;
+}
+
+int connectTo(const fs::path& path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whether the user behind a connection may create files in directory. The
+// server writes there with its own rights, which must not reach further
+// than the client's. Only the client's primary group counts, so a
+// directory it can only write through another group is turned away.
+bool writableBy(const fs::path& directory, const ucred& peer) {
+    struct stat info;
+    if (!directory.is_absolute() || stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) return false;
+    if (peer.uid == 0) return true;
+    mode_t needed = info.st_uid == peer.uid   ? S_IWUSR | S_IXUSR
+                    : info.st_gid == peer.gid ? S_IWGRP | S_IXGRP
+                                              : S_IWOTH | S_IXOTH;
+    return (info.st_mode & needed) == needed;
+}
+
+double percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) return 0;
+    auto nth = samples.begin() + static_cast<size_t>(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
+
+// Generated C++ by source and options, least recently used first out.
+class CodeCache {
+    struct Entry {
+        std::string cpp;
+        OptimizationStats optimization;
+        std::list<std::string>::iterator use;
+    };
+
+    std::mutex mutex;
+    size_t maxBytes;
+    size_t bytes = 0;
+    std::list<std::string> uses;
+    std::unordered_map<std::string, Entry> entries;
+
+public:
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    explicit CodeCache(size_t maxBytes) : maxBytes(maxBytes) {}
+
+    bool lookup(const std::string& key, std::string& cpp, OptimizationStats& optimization) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            misses++;
+            return false;
+        }
+        hits++;
+        uses.splice(uses.begin(), uses, it->second.use);
+        cpp = it->second.cpp;
+        optimization = it->second.optimization;
+        return true;
+    }
+
+    void store(const std::string& key, const std::string& cpp, const OptimizationStats& optimization) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cpp.size() > maxBytes || entries.count(key)) return;
+        uses.push_front(key);
+        entries[key] = {cpp, optimization, uses.begin()};
+        bytes += cpp.size();
+        while (bytes > maxBytes) {
+            auto oldest = entries.find(uses.back());
+            bytes -= oldest->second.cpp.size();
+            entries.erase(oldest);
+            uses.pop_back();
+        }
+    }
+
+    std::pair<size_t, size_t> size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {entries.size(), bytes};
+    }
+};
+
+// The listening thread queues connections and a fixed pool of workers
+// reads, compiles and answers them, one request per connection.
+class CompileServer {
+    struct Job {
+        int fd;
+        Clock::time_point accepted;
+        ucred peer;
+    };
+
+    const ServerOptions& options;
+    std::string version;
+    std::unique_ptr<CompileCache> cache;
+    std::mutex cacheMutex;
+    std::mutex pchMutex;
+    CodeCache code;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<Job> queue;
+    bool closing = false;
+
+    std::mutex statsMutex;
+    uint64_t served = 0;
+    uint64_t failed = 0;
+    uint64_t rejected = 0;
+    size_t maxDepth = 0;
+    std::vector<double> latencies;
+    std::vector<double> waits;
+    size_t nextSample = 0;
+
+public:
+    explicit CompileServer(const ServerOptions& options) : options(options), code(options.codeCacheBytes) {}
+
+    int run() {
+        sockaddr_un address;
+        if (!socketAddress(options.socketPath, address)) {
+            std::cerr << "Error: Invalid socket path " << options.socketPath.string() << std::endl;
+            return 1;
+        }
+        if (int probe = connectTo(options.socketPath); probe >= 0) {
+            close(probe);
+            std::cerr << "Error: A compile server is already listening on " << options.socketPath.string() << std::endl;
+            return 1;
+        }
+        std::error_code ignored;
+        fs::remove(options.socketPath, ignored);
+        // Only the user running the server may connect: the socket is
+        // created 0600 rather than chmod'ed afterwards, which would leave a
+        // window. No other thread runs yet, so changing the umask is safe.
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        mode_t umaskBefore = umask(0177);
+        bool bound = listener >= 0 && bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        umask(umaskBefore);
+        if (!bound || listen(listener, 128) != 0) {
+            std::cerr << "Error: Cannot listen on " << options.socketPath.string() << ": " << strerror(errno) << std::endl;
+            if (listener >= 0) close(listener);
+            return 1;
+        }
+
+        version = compilerVersion(options.compiler);
+        if (options.useCache) {
+            try {
+                cache = std::make_unique<CompileCache>(options.cacheDir, options.cacheMaxBytes);
+            } catch (const fs::filesystem_error& e) {
+                std::cerr << "Warning: compile cache disabled: " << e.what() << std::endl;
+            }
+        }
+
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < std::max(options.workers, 1u); i++) workers.emplace_back([this] { work(); });
+        std::cout << "Compile server listening on " << options.socketPath.string() << " with " << workers.size()
+                  << " workers." << std::endl;
+
+        while (!stopRequested) {
+            pollfd ready{listener, POLLIN, 0};
+            if (poll(&ready, 1, 200) <= 0) continue;
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            ucred peer;
+            socklen_t peerSize = sizeof(peer);
+            if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &peerSize) != 0) {
+                close(client);
+                continue;
+            }
+            // A client that connects and then stalls must not hold a worker forever.
+            timeval timeout{30, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            std::unique_lock<std::mutex> lock(queueMutex);
+            if (queue.size() >= options.maxQueue) {
+                lock.unlock();
+                writeResponse(client, {1, "", "Error: Compile server busy\n"});
+                close(client);
+                std::lock_guard<std::mutex> statsLock(statsMutex);
+                rejected++;
+                continue;
+            }
+            queue.push_back({client, Clock::now(), peer});
+            size_t depth = queue.size();
+            lock.unlock();
+            queueReady.notify_one();
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            maxDepth = std::max(maxDepth, depth);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            closing = true;
+        }
+        queueReady.notify_all();
+        for (auto& worker : workers) worker.join();
+        close(listener);
+        fs::remove(options.socketPath, ignored);
+        std::cerr << statsText();
+        return 0;
+    }
+
+private:
+    void work() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [&] { return closing || !queue.empty(); });
+                if (queue.empty()) return;
+                job = queue.front();
+                queue.pop_front();
+            }
+            serve(job);
+        }
+    }
+
+    void serve(const Job& job) {
+        auto started = Clock::now();
+        ServerRequest request;
+        std::string kind, directory, options;
+        bool ok = readField(job.fd, kind) && readField(job.fd, directory) && readField(job.fd, options) &&
+                  readField(job.fd, request.source);
+        ServerResponse response;
+        response.exitCode = 1;
+        if (ok) {
+            request.kind = kind == "stats" ? ServerRequest::Stats : ServerRequest::Compile;
+            request.workingDirectory = directory;
+            std::istringstream lines(options);
+            for (std::string option; std::getline(lines, option);) request.options.push_back(option);
+            try {
+                if (request.kind == ServerRequest::Stats) response = {0, statsText(), ""};
+                else if (!writableBy(request.workingDirectory, job.peer))
+                    response.err = "Error: " + request.workingDirectory.string() + " is not writable by the connecting user\n";
+                else response = compile(request);
+            } catch (const std::exception& e) {
+                response = {1, "", "Error: " + std::string(e.what()) + "\n"};
+            }
+            ok = writeResponse(job.fd, response);
+        }
+        close(job.fd);
+
+        auto finished = Clock::now();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        served++;
+        failed += !ok || response.exitCode != 0;
+        if (latencies.size() < latencySamples) {
+            latencies.push_back(elapsedMs(job.accepted, finished));
+            waits.push_back(elapsedMs(job.accepted, started));
+        } else {
+            latencies[nextSample] = elapsedMs(job.accepted, finished);
+            waits[nextSample] = elapsedMs(job.accepted, started);
+            nextSample = (nextSample + 1) % latencySamples;
+        }
+    }
+
+    // Mirrors the CLI's single-file build, messages included. Every g++ run
+    // uses the precompiled runtime header, since parsing the runtime is
+    // most of what a cold compiler spends on these programs.
+    ServerResponse compile(const ServerRequest& request) {
+        std::ostringstream out, err;
+        auto finish = [&](int exitCode) { return ServerResponse{exitCode, out.str(), err.str()}; };
+
+        CompileOptions compileOptions;
+        OptimizationProfile profile = OptimizationProfile::Default;
+        bool elf = false, useCache = true, showOptReport = false, emitCpp = false;
+        for (const auto& option : request.options) {
+            if (option == "--elf") elf = true;
+            else if (option == "--no-cache") useCache = false;
+            else if (option == "--fast-compile") profile = OptimizationProfile::FastCompile;
+            else if (option == "--O2") profile = OptimizationProfile::O2;
+            else if (option == "--native") profile = OptimizationProfile::Native;
+            else if (option == "--flat-ast") compileOptions.flatAst = true;
+            else if (option == "--no-opt") compileOptions.optimize = false;
+            else if (option == "--opt-report") showOptReport = true;
+            else if (option == "--emit-cpp") emitCpp = true;
+            else if (option == "--memoize") compileOptions.codegen.memoize = true;
+            else if (option != "--pch") {
+                err << "Error: Unknown option " << option << "\n";
+                return finish(1);
+            }
+        }
+        auto reportOptimization = [&](const OptimizationStats& stats) {
+            if (showOptReport && compileOptions.optimize)
+                err << "Optimizer: " << stats.folded << " expressions folded, " << stats.propagated
+                    << " constants propagated, " << stats.removed << " statements removed, "
+                    << stats.inlined << " calls inlined, " << stats.uncheckedIndexes << " bounds checks removed\n";
+        };
+
+        fs::path exe = request.workingDirectory / "output.exe";
+        if (elf) {
+            CompileResult compiled = compileNative(request.source, exe, compileOptions);
+            if (!compiled.ok) {
+                err << "Error: " << compiled.error << "\n";
+                return finish(1);
+            }
+            reportOptimization(compiled.optimization);
+            out << "Code compiled succesfully: output.exe created.\n";
+            return finish(0);
+        }
+
+        const std::string flags = profileFlags(profile);
+        fs::path pchDir = runtimePchDirectory(options.cacheDir, version, flags);
+        std::string compileFlags = flags + (flags.empty() ? "" : " ") + "-I" + quoted(pchDir);
+        compileOptions.codegen.useRuntimeHeader = true;
+
+        std::string memoFlag = compileOptions.codegen.memoize ? " --memoize" : "";
+        std::string codeKey = CompileCache::makeKey(request.source, "", std::string(compileOptions.optimize ? "" : "--no-opt") +
+                                                                           (compileOptions.flatAst ? " --flat-ast" : "") + memoFlag);
+        std::string cpp;
+        OptimizationStats optimization;
+        auto generate = [&] {
+            if (code.lookup(codeKey, cpp, optimization)) return true;
+            CompileResult compiled = ::compile(request.source, compileOptions);
+            if (!compiled.ok) {
+                err << "Error: " << compiled.error << "\n";
+                return false;
+            }
+            cpp = std::move(compiled.cpp);
+            optimization = compiled.optimization;
+            code.store(codeKey, cpp, optimization);
+            return true;
+        };
+        // output.cpp is only written on request; g++ reads the code from a pipe.
+        auto writeCpp = [&] {
+            fs::path cppPath = request.workingDirectory / "output.cpp";
+            std::ofstream file(cppPath, std::ios::binary);
+            file << cpp;
+            if (!file) err << "Error: Could not write " << cppPath.string() << "\n";
+            return static_cast<bool>(file);
+        };
+
+        std::string cacheKey;
+        if (cache && useCache) {
+            cacheKey = CompileCache::makeKey(request.source, version,
+                                             compileFlags + (compileOptions.optimize ? "" : " --no-opt") + memoFlag);
+            bool hit;
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                hit = cache->lookup(cacheKey, exe);
+            }
+            if (hit) {
+                if (emitCpp && generate() && !writeCpp()) return finish(1);
+                out << "Code compiled succesfully: output.exe restored from cache.\n";
+                return finish(0);
+            }
+        }
+
+        if (!generate()) return finish(1);
+        reportOptimization(optimization);
+
+        {
+            std::lock_guard<std::mutex> lock(pchMutex);
+            ensureRuntimePch(pchDir, options.compiler, flags);
+        }
+        if (emitCpp && !writeCpp()) return finish(1);
+
+        std::string diagnostics;
+        int result = compileSource(options.compiler, compileFlags, cpp, exe.string(), &diagnostics);
+        err << diagnostics;
+        if (result != 0) {
+            err << "Error: C++ code compilation failed\n";
+            return finish(2);
+        }
+        if (cache && useCache) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            cache->store(cacheKey, exe);
+        }
+        out << "Code compiled succesfully: output.exe created.\n";
+        return finish(0);
+    }
+
+    std::string statsText() {
+        size_t depth;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            depth = queue.size();
+        }
+        auto [entries, bytes] = code.size();
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(1);
+        std::lock_guard<std::mutex> lock(statsMutex);
+        text << "Compile server: " << served << " requests, " << failed << " failed, " << rejected
+             << " turned away; queue " << depth << " (max " << maxDepth << "), " << std::max(options.workers, 1u)
+             << " workers\n";
+        text << "Latency ms: p50 " << percentile(latencies, 0.5) << ", p90 " << percentile(latencies, 0.9)
+             << ", p99 " << percentile(latencies, 0.99) << "; queue wait p50 " << percentile(waits, 0.5)
+             << ", p99 " << percentile(waits, 0.99) << "\n";
+        text << "Code cache: " << code.hits << " hits, " << code.misses << " misses, " << entries << " entries, "
+             << bytes / 1024 << " KiB\n";
+        return text.str();
+    }
+};
+
+}
+
+bool serverAcceptsOption(const std::string& option) {
+    static const char* accepted[] = {"--elf", "--no-cache", "--fast-compile", "--O2", "--native",
+                                     "--pch", "--flat-ast", "--no-opt", "--opt-report", "--emit-cpp", "--memoize"};
+    return std::find(std::begin(accepted), std::end(accepted), option) != std::end(accepted);
+}
+
+int runServer(const ServerOptions& options) {
+    return CompileServer(options).run();
+}
+
+std::optional<ServerResponse> sendRequest(const fs::path& socketPath, const ServerRequest& request) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) return std::nullopt;
+    std::string options;
+    for (const auto& option : request.options) options += option + "\n";
+    std::string exitCode;
+    ServerResponse response;
+    bool ok = writeField(fd, request.kind == ServerRequest::Stats ? "stats" : "compile") &&
+              writeField(fd, request.workingDirectory.string()) && writeField(fd, options) &&
+              writeField(fd, request.source) && readField(fd, exitCode) && readField(fd, response.out) &&
+              readField(fd, response.err);
+    close(fd);
+    if (!ok) return std::nullopt;
+    response.exitCode = std::atoi(exitCode.c_str());
+    return response;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct ServerOptions {
+    std::filesystem::path socketPath;
+    unsigned workers = 1;
+    // Connections accepted beyond this many waiting ones are turned away.
+    size_t maxQueue = 256;
+    std::string compiler = "g++";
+    bool useCache = true;
+    std::filesystem::path cacheDir;
+    uintmax_t cacheMaxBytes = 0;
+    // Generated C++ kept in memory, keyed by source and options.
+    size_t codeCacheBytes = 64 << 20;
+};
+
+// One CLI invocation: the options it was given, its source, and the
+// directory its output.cpp and output.exe belong in.
+struct ServerRequest {
+    enum Kind : uint8_t { Compile, Stats } kind = Compile;
+    std::filesystem::path workingDirectory;
+    std::vector<std::string> options;
+    std::string source;
+};
+
+// What the CLI would have printed and returned.
+struct ServerResponse {
+    int exitCode = 0;
+    std::string out;
+    std::string err;
+};
+
+// Options a server-side compile accepts; the CLI handles anything else
+// itself.
+bool serverAcceptsOption(const std::string& option);
+
+// Serves until SIGINT or SIGTERM and returns the process exit code.
+int runServer(const ServerOptions& options);
+
+// nullopt when nothing is listening at socketPath or the server hung up.
+std::optional<ServerResponse> sendRequest(const std::filesystem::path& socketPath, const ServerRequest& request);
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Read-only view of an input file. On POSIX the file is memory-mapped so
+// the lexer works directly on the page cache without copying.
+class SourceFile {
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;
+
+public:
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view text() const { return {data, size}; }
+};
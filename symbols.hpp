@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "arena.hpp"
+
+// Interns source text into the arena. Symbol 0 is always the empty string,
+// so a default-initialised Token has a valid (empty) spelling.
+class SymbolTable {
+    Arena& arena;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> names;
+
+public:
+    explicit SymbolTable(Arena& arena) : arena(arena) {
+        names.push_back({});
+        ids.emplace(std::string_view(), 0);
+    }
+
+    uint32_t intern(std::string_view text) {
+        auto it = ids.find(text);
+        if (it != ids.end()) return it->second;
+        char* data = static_cast<char*>(arena.allocate(text.size() + 1, 1));
+        std::memcpy(data, text.data(), text.size());
+        data[text.size()] = '\0';
+        std::string_view stored(data, text.size());
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.push_back(stored);
+        ids.emplace(stored, id);
+        return id;
+    }
+
+    // Returns 0 for text that was never interned.
+    uint32_t find(std::string_view text) const {
+        auto it = ids.find(text);
+        return it == ids.end() ? 0 : it->second;
+    }
+
+    std::string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+};
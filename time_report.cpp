@@ -0,0 +1,95 @@
+#include "time_report.hpp"
+#include <algorithm>
+#include <iomanip>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Usage {
+    long peakRssKb = 0;
+    double childUserMs = 0;
+    double childSysMs = 0;
+};
+
+Usage currentUsage() {
+    Usage usage;
+#ifndef _WIN32
+    auto ms = [](const timeval& t) { return t.tv_sec * 1000.0 + t.tv_usec / 1000.0; };
+    rusage self{}, children{};
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    usage.peakRssKb = self.ru_maxrss;
+    usage.childUserMs = ms(children.ru_utime);
+    usage.childSysMs = ms(children.ru_stime);
+#endif
+    return usage;
+}
+
+}
+
+PhaseTiming& TimeReport::begin(std::string name) {
+    end();
+    Usage usage = currentUsage();
+    childUserAtStart = usage.childUserMs;
+    childSysAtStart = usage.childSysMs;
+    running = true;
+    rows.emplace_back().name = std::move(name);
+    start = Clock::now();
+    return rows.back();
+}
+
+void TimeReport::end() {
+    if (!running) return;
+    PhaseTiming& row = rows.back();
+    row.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    Usage usage = currentUsage();
+    row.peakRssKb = usage.peakRssKb;
+    row.childUserMs = usage.childUserMs - childUserAtStart;
+    row.childSysMs = usage.childSysMs - childSysAtStart;
+    running = false;
+}
+
+void TimeReport::print(std::ostream& out, bool json) const {
+    double totalMs = 0, childUserMs = 0, childSysMs = 0;
+    long peakRssKb = 0;
+    for (const auto& row : rows) {
+        totalMs += row.wallMs;
+        childUserMs += row.childUserMs;
+        childSysMs += row.childSysMs;
+        peakRssKb = std::max(peakRssKb, row.peakRssKb);
+    }
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    if (json) {
+        out << "{\"phases\":[";
+        for (size_t i = 0; i < rows.size(); i++) {
+            const PhaseTiming& row = rows[i];
+            out << (i ? "," : "") << "{\"name\":\"" << row.name << "\",\"wall_ms\":" << row.wallMs
+                << ",\"count\":" << row.count << ",\"count_unit\":\"" << row.countUnit << "\",\"bytes\":"
+                << row.bytes << ",\"peak_rss_kb\":" << row.peakRssKb << ",\"child_user_ms\":"
+                << row.childUserMs << ",\"child_sys_ms\":" << row.childSysMs << "}";
+        }
+        out << "],\"total_wall_ms\":" << totalMs << ",\"peak_rss_kb\":" << peakRssKb << ",\"child_user_ms\":"
+            << childUserMs << ",\"child_sys_ms\":" << childSysMs << "}\n";
+    } else {
+        out << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "wall ms"
+            << std::setw(18) << "count" << std::setw(14) << "bytes" << std::setw(12) << "peak KiB"
+            << std::setw(12) << "child usr" << std::setw(12) << "child sys" << "\n";
+        for (const auto& row : rows) {
+            std::string count = row.count ? std::to_string(row.count) + " " + row.countUnit : "-";
+            out << std::left << std::setw(12) << row.name << std::right << std::setw(12) << row.wallMs
+                << std::setw(18) << count << std::setw(14) << (row.bytes ? std::to_string(row.bytes) : "-")
+                << std::setw(12) << row.peakRssKb << std::setw(12) << row.childUserMs << std::setw(12)
+                << row.childSysMs << "\n";
+        }
+        out << std::left << std::setw(12) << "total" << std::right << std::setw(12) << totalMs << std::setw(18)
+            << "" << std::setw(14) << "" << std::setw(12) << peakRssKb << std::setw(12) << childUserMs
+            << std::setw(12) << childSysMs << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
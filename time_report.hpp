@@ -0,0 +1,43 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+
+// One row of --time-report. count and bytes mean whatever fits the phase
+// (tokens read, nodes built, bytes written) and are zero where they do not
+// apply. peakRssKb is the process high-water mark when the phase ended.
+struct PhaseTiming {
+    std::string name;
+    double wallMs = 0;
+    uint64_t count = 0;
+    std::string countUnit;
+    uint64_t bytes = 0;
+    long peakRssKb = 0;
+    double childUserMs = 0;
+    double childSysMs = 0;
+};
+
+// Per-phase timings for one compile. A phase runs from its begin() to the
+// next begin() or end(); child CPU time is that of the child processes
+// that were waited for in between, such as the C++ compiler.
+class TimeReport {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // The returned row stays valid for the life of the report.
+    PhaseTiming& begin(std::string name);
+    void end();
+
+    const std::deque<PhaseTiming>& phases() const { return rows; }
+    // A table, or a single-line JSON object when json is set.
+    void print(std::ostream& out, bool json) const;
+
+private:
+    std::deque<PhaseTiming> rows;
+    bool running = false;
+    Clock::time_point start;
+    double childUserAtStart = 0;
+    double childSysAtStart = 0;
+};
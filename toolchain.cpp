@@ -0,0 +1,171 @@
+#include "toolchain.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Splits a command line the way the shell would for the flags built here:
+// on spaces, with double quotes grouping and then dropped.
+std::vector<std::string> splitArguments(const std::string& line) {
+    std::vector<std::string> words;
+    std::string word;
+    bool inWord = false, quoted = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        } else if (c == ' ' && !quoted) {
+            if (inWord) words.push_back(std::move(word));
+            word.clear();
+            inWord = false;
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord) words.push_back(std::move(word));
+    return words;
+}
+
+}
+
+std::string profileFlags(OptimizationProfile profile) {
+    switch (profile) {
+        case OptimizationProfile::FastCompile: return "-O0 -g0";
+        case OptimizationProfile::O2: return "-O2";
+        case OptimizationProfile::Native: return "-O3 -march=native -flto";
+        default: return "";
+    }
+}
+
+std::string compilerCommand(const std::string& compiler, const std::string& flags, const std::string& source, const std::string& output) {
+    return compiler + " " + (flags.empty() ? "" : flags + " ") + source + " -o " + output;
+}
+
+int invokeCompiler(const std::string& compiler, const std::string& flags, const std::string& source, const std::string& output) {
+    return system(compilerCommand(compiler, flags, source, output).c_str());
+}
+
+int compileSource(const std::string& compiler, const std::string& flags, std::string_view code, const std::string& output, std::string* diagnostics) {
+    std::vector<std::string> args = splitArguments(compiler);
+    for (auto& flag : splitArguments(flags)) args.push_back(std::move(flag));
+    for (const char* arg : {"-x", "c++", "-", "-o"}) args.push_back(arg);
+    args.push_back(output);
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    int input[2], messages[2] = {-1, -1};
+    if (pipe2(input, O_CLOEXEC) != 0) return -1;
+    if (diagnostics && pipe2(messages, O_CLOEXEC) != 0) {
+        close(input[0]);
+        close(input[1]);
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input[0], STDIN_FILENO);
+    if (diagnostics) {
+        posix_spawn_file_actions_adddup2(&actions, messages[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, messages[1], STDERR_FILENO);
+    }
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(input[0]);
+    if (diagnostics) close(messages[1]);
+    if (spawned != 0) {
+        close(input[1]);
+        if (diagnostics) close(messages[0]);
+        return -1;
+    }
+
+    // The compiler may stop reading early, after an error or a bad flag;
+    // that must show up as its exit status, not kill this process with
+    // SIGPIPE. The write end never blocks, so a compiler busy printing
+    // diagnostics cannot deadlock against it.
+    sigset_t pipeSignal, previous;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+    fcntl(input[1], F_SETFL, O_NONBLOCK);
+    int writeFd = input[1], readFd = messages[0];
+    size_t written = 0;
+    if (code.empty()) {
+        close(writeFd);
+        writeFd = -1;
+    }
+    char buffer[4096];
+    while (writeFd >= 0 || readFd >= 0) {
+        pollfd fds[2];
+        nfds_t count = 0;
+        if (writeFd >= 0) fds[count++] = {writeFd, POLLOUT, 0};
+        if (readFd >= 0) fds[count++] = {readFd, POLLIN, 0};
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (nfds_t i = 0; i < count; i++) {
+            if (!fds[i].revents) continue;
+            if (fds[i].fd == writeFd) {
+                ssize_t sent = write(writeFd, code.data() + written, std::min<size_t>(code.size() - written, 1 << 16));
+                if (sent > 0) written += sent;
+                if ((sent < 0 && errno != EAGAIN && errno != EINTR) || written == code.size()) {
+                    close(writeFd);
+                    writeFd = -1;
+                }
+            } else {
+                ssize_t received = read(readFd, buffer, sizeof(buffer));
+                if (received > 0) {
+                    diagnostics->append(buffer, received);
+                } else if (received == 0 || errno != EINTR) {
+                    close(readFd);
+                    readFd = -1;
+                }
+            }
+        }
+    }
+    if (writeFd >= 0) close(writeFd);
+    if (readFd >= 0) close(readFd);
+    if (!sigismember(&previous, SIGPIPE)) {
+        timespec now{};
+        while (sigtimedwait(&pipeSignal, nullptr, &now) > 0) {}
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    return status;
+}
+
+int buildWithPgo(const std::string& compiler, const std::string& flags, std::string_view code, const std::string& output, const std::string& trainingInput) {
+    fs::path profileDir = fs::temp_directory_path() / ("pseudocode-pgo-" + std::to_string(getpid()));
+    fs::remove_all(profileDir);
+    std::string dirFlag = "=\"" + profileDir.string() + "\"";
+
+    int result = compileSource(compiler, flags + " -fprofile-generate" + dirFlag, code, output);
+    if (result != 0) return result;
+
+    std::string training = "\"" + fs::absolute(output).string() + "\" < \"" + trainingInput + "\" > /dev/null";
+    if (system(training.c_str()) != 0) {
+        fs::remove_all(profileDir);
+        throw std::runtime_error("PGO training run failed on " + trainingInput);
+    }
+
+    result = compileSource(compiler, flags + " -fprofile-use" + dirFlag + " -fprofile-correction", code, output);
+    fs::remove_all(profileDir);
+    return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+enum class OptimizationProfile {
+    Default, FastCompile, O2, Native
+};
+
+std::string profileFlags(OptimizationProfile profile);
+std::string compilerCommand(const std::string& compiler, const std::string& flags, const std::string& source, const std::string& output);
+int invokeCompiler(const std::string& compiler, const std::string& flags, const std::string& source, const std::string& output);
+// Streams code into the compiler as `-x c++ -` over a pipe, so the
+// compiler starts parsing while the rest is still being written and no
+// source file touches the disk. The compiler is started with posix_spawnp,
+// not through a shell; flags are split on spaces, with double quotes
+// grouping, and output is passed as is. Returns a wait status like
+// system(), or -1 when the compiler could not be started. diagnostics,
+// when given, receives what the compiler prints instead of this process's
+// stdout and stderr.
+int compileSource(const std::string& compiler, const std::string& flags, std::string_view code, const std::string& output, std::string* diagnostics = nullptr);
+// Builds code twice through compileSource, training on trainingInput in
+// between.
+int buildWithPgo(const std::string& compiler, const std::string& flags, std::string_view code, const std::string& output, const std::string& trainingInput);
@@ -0,0 +1,376 @@
+#include "types.hpp"
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+ValueType join(ValueType a, ValueType b) {
+    if (a == ValueType::Unknown) return b;
+    if (b == ValueType::Unknown) return a;
+    if (a == ValueType::String || b == ValueType::String) return ValueType::String;
+    if (a == ValueType::Real || b == ValueType::Real) return ValueType::Real;
+    if (a == ValueType::Long || b == ValueType::Long) return ValueType::Long;
+    if (a == ValueType::Int || b == ValueType::Int) return ValueType::Int;
+    return ValueType::Bool;
+}
+
+// Variable types are joined over every assignment and refined by numeric
+// uses, repeating until nothing changes. Variables that are only ever read
+// from INPUT and never used numerically stay strings.
+class TypeInference {
+    CompilationContext& context;
+    VariableTable& variables;
+    std::vector<uint32_t> inputs;
+    bool changed = false;
+    // The subroutine being typed, its parameters, whose types are fixed, and
+    // the subroutines its body calls.
+    const SubroutineNode* current = nullptr;
+    std::unordered_set<uint32_t> parameters;
+    std::vector<uint32_t> callees;
+    bool usesIo = false;
+    std::unordered_map<uint32_t, std::pair<std::vector<uint32_t>, bool>> calls;
+
+public:
+    explicit TypeInference(CompilationContext& context) : context(context), variables(context.variables) {}
+
+    void run(const ProgramNode* program) {
+        variables.clear();
+        context.integerOps.clear();
+        context.arrays.clear();
+        context.subroutines.clear();
+        collectArrays(program->statements);
+        for (auto subroutine : program->subroutines) {
+            auto [it, added] = context.subroutines.try_emplace(subroutine->symbol);
+            if (!added)
+                throw std::runtime_error(std::string(subroutine->name) + " is defined more than once");
+            it->second.node = subroutine;
+        }
+        for (auto subroutine : program->subroutines) inferSubroutine(subroutine);
+        classifySubroutines();
+
+        for (const auto& hint : program->typeHints) variables.assign(hint.symbol, hint.type);
+        inferBlock(program->statements);
+        for (const auto& [symbol, info] : context.arrays)
+            if (variables.contains(symbol))
+                throw std::runtime_error(std::string(context.symbols.name(symbol)) + " is an array and needs an index");
+    }
+
+private:
+    ValueType typeOf(uint32_t symbol) { return variables.declare(symbol); }
+
+    // Joins the types of a block's variables over every statement until
+    // nothing changes, then settles what is still unknown.
+    void inferBlock(NodeList block) {
+        inputs.clear();
+        while (true) {
+            do {
+                changed = false;
+                visitBlock(block);
+            } while (changed);
+
+            bool defaulted = false;
+            for (uint32_t symbol : inputs) {
+                if (typeOf(symbol) == ValueType::Unknown) {
+                    variables.assign(symbol, ValueType::String);
+                    defaulted = true;
+                }
+            }
+            if (!defaulted) break;
+        }
+        for (uint32_t symbol : variables.declarations())
+            if (typeOf(symbol) == ValueType::Unknown) variables.assign(symbol, ValueType::Int);
+    }
+
+    // A subroutine sees its parameters and the variables its body assigns,
+    // all in a scope of their own; nothing of the main program is visible.
+    void inferSubroutine(const SubroutineNode* subroutine) {
+        current = subroutine;
+        parameters.clear();
+        callees.clear();
+        usesIo = false;
+        variables.pushScope();
+        for (const auto& parameter : subroutine->parameters) {
+            if (!parameters.insert(parameter.symbol).second)
+                throw std::runtime_error(std::string(subroutine->name) + " has two parameters named " +
+                                         std::string(parameter.name));
+            variables.declareLocal(parameter.symbol, parameter.type);
+        }
+        declareAssigned(subroutine->body);
+        for (const auto& hint : subroutine->typeHints)
+            if (variables.isLocal(hint.symbol) && !parameters.count(hint.symbol))
+                variables.declareLocal(hint.symbol, hint.type);
+        inferBlock(subroutine->body);
+
+        SubroutineInfo& info = context.subroutines.at(subroutine->symbol);
+        for (uint32_t symbol : variables.declarations()) info.variables.emplace_back(symbol, variables.typeOf(symbol));
+        calls[subroutine->symbol] = {callees, usesIo};
+        variables.popScope();
+        // The main program has no parameters: a variable named like one
+        // must still be typed by its uses.
+        current = nullptr;
+        parameters.clear();
+        callees.clear();
+    }
+
+    void declareAssigned(NodeList block) {
+        for (auto stmt : block) {
+            uint32_t symbol = 0;
+            if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+                symbol = input->symbol;
+            } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+                symbol = assign->symbol;
+            } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+                declareAssigned(ifNode->thenBranch);
+                declareAssigned(ifNode->elseBranch);
+            } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+                declareAssigned(whileNode->body);
+            } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+                declareAssigned(repeat->body);
+            } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+                symbol = forNode->symbol;
+                declareAssigned(forNode->body);
+            }
+            if (!symbol) continue;
+            if (context.arrays.count(symbol)) notVisible(symbol);
+            variables.declareLocal(symbol);
+        }
+    }
+
+    [[noreturn]] void notVisible(uint32_t symbol) const {
+        throw std::runtime_error(std::string(current->kind()) + " " + std::string(current->name) + " cannot use " +
+                                 std::string(context.symbols.name(symbol)) +
+                                 ": a subroutine only sees its parameters and the variables it assigns");
+    }
+
+    // Purity spreads from callees to callers until nothing changes;
+    // recursion is a path from a subroutine back to itself.
+    void classifySubroutines() {
+        for (auto& [symbol, info] : context.subroutines) info.pure = !calls[symbol].second;
+        for (bool again = true; again;) {
+            again = false;
+            for (auto& [symbol, info] : context.subroutines) {
+                if (!info.pure) continue;
+                for (uint32_t callee : calls[symbol].first) {
+                    if (!context.subroutines.at(callee).pure) {
+                        info.pure = false;
+                        again = true;
+                        break;
+                    }
+                }
+            }
+        }
+        for (auto& [symbol, info] : context.subroutines) {
+            std::unordered_set<uint32_t> seen;
+            std::vector<uint32_t> pending = calls[symbol].first;
+            while (!pending.empty() && !info.recursive) {
+                uint32_t next = pending.back();
+                pending.pop_back();
+                if (next == symbol) info.recursive = true;
+                else if (seen.insert(next).second)
+                    pending.insert(pending.end(), calls[next].first.begin(), calls[next].first.end());
+            }
+        }
+    }
+
+    // Arrays are known before any statement is typed, so an element read
+    // that comes before its DECLARE in the text is still an element read.
+    void collectArrays(NodeList block) {
+        for (auto stmt : block) {
+            if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+                recordArray(context.arrays, declare);
+            } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+                collectArrays(ifNode->thenBranch);
+                collectArrays(ifNode->elseBranch);
+            } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+                collectArrays(whileNode->body);
+            } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+                collectArrays(repeat->body);
+            } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+                collectArrays(forNode->body);
+            }
+        }
+    }
+
+    void widen(uint32_t symbol, ValueType type) {
+        if (parameters.count(symbol)) return;
+        ValueType current = typeOf(symbol);
+        ValueType next = join(current, type);
+        if (next != current) {
+            variables.assign(symbol, next);
+            changed = true;
+        }
+    }
+
+    void expectNumeric(uint32_t symbol) {
+        ValueType current = typeOf(symbol);
+        if (current == ValueType::Unknown || current == ValueType::Bool) widen(symbol, ValueType::Int);
+    }
+
+    void expectNumeric(const ExprNode* expr) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) expectNumeric(var->symbol);
+    }
+
+    // AND, OR and NOT take BOOLEANs, or numbers that count as true when
+    // nonzero; a variable seen nowhere else becomes a BOOLEAN.
+    void expectCondition(const ExprNode* expr, std::string_view op) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr))
+            if (typeOf(var->symbol) == ValueType::Unknown) widen(var->symbol, ValueType::Bool);
+        if (expr->inferType(context) == ValueType::String)
+            throw std::runtime_error(std::string(op) + " needs BOOLEAN operands, not the STRING " + expr->toString());
+    }
+
+    void visitExpr(const ExprNode* expr) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            if (current && !variables.isLocal(var->symbol)) notVisible(var->symbol);
+            typeOf(var->symbol);
+        } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+            const SubroutineNode* callee = visitCall(call);
+            if (!callee->isFunction())
+                throw std::runtime_error("PROCEDURE " + std::string(call->name) + " has no value; use CALL " +
+                                         std::string(call->name));
+        } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            visitExpr(unary->operand);
+            if (unary->op == "NOT") {
+                expectCondition(unary->operand, unary->op);
+            } else {
+                expectNumeric(unary->operand);
+                if (unary->operand->inferType(context) == ValueType::String)
+                    throw std::runtime_error("Cannot negate the STRING " + unary->operand->toString());
+            }
+        } else if (auto bin = dynamic_cast<const BinaryExpr*>(expr)) {
+            visitExpr(bin->left);
+            visitExpr(bin->right);
+            ValueType l = bin->left->inferType(context);
+            ValueType r = bin->right->inferType(context);
+            if (isLogicalOperator(bin->op)) {
+                expectCondition(bin->left, bin->op);
+                expectCondition(bin->right, bin->op);
+            } else if (isComparisonOperator(bin->op)) {
+                if (l != ValueType::String && r != ValueType::String) {
+                    expectNumeric(bin->left);
+                    expectNumeric(bin->right);
+                }
+            } else if (bin->op == "+") {
+                if (isNumeric(l)) expectNumeric(bin->right);
+                if (isNumeric(r)) expectNumeric(bin->left);
+            } else {
+                expectNumeric(bin->left);
+                expectNumeric(bin->right);
+                // No backend has a REAL remainder.
+                if (bin->op == "%" && (l == ValueType::Real || r == ValueType::Real))
+                    throw std::runtime_error("% needs INTEGER operands, not the REAL " +
+                                             (l == ValueType::Real ? bin->left : bin->right)->toString());
+            }
+        } else if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+            visitIndices(idx);
+        }
+    }
+
+    // Checks the arguments against the parameters; numeric parameters make
+    // their arguments numeric, as assignments to numeric variables would.
+    const SubroutineNode* visitCall(const CallExpr* call) {
+        const SubroutineNode* callee = call->callee(context);
+        if (!callee) throw std::runtime_error("Unknown PROCEDURE or FUNCTION " + std::string(call->name));
+        if (call->arguments.size() != callee->parameters.size())
+            throw std::runtime_error(call->toString() + ": " + std::string(callee->name) + " takes " +
+                                     std::to_string(callee->parameters.size()) + " argument(s)");
+        for (size_t i = 0; i < call->arguments.size(); i++) {
+            visitExpr(call->arguments[i]);
+            if (isNumeric(callee->parameters[i].type)) expectNumeric(call->arguments[i]);
+        }
+        if (current) callees.push_back(callee->symbol);
+        return callee;
+    }
+
+    void visitIndices(const IndexExpr* idx) {
+        if (const ArrayInfo* array = idx->array(context)) {
+            if (current) notVisible(static_cast<const VariableExpr*>(idx->base)->symbol);
+            if (idx->indices.size() != array->rank)
+                throw std::runtime_error(idx->toString() + ": " + idx->base->toString() + " has " +
+                                         std::to_string(array->rank) + " dimension(s)");
+        } else {
+            if (idx->indices.size() != 1) throw std::runtime_error(idx->toString() + ": only arrays take several indices");
+            visitExpr(idx->base);
+        }
+        for (auto index : idx->indices) {
+            visitExpr(index);
+            expectNumeric(index);
+        }
+    }
+
+    void visitBlock(NodeList block) {
+        for (auto stmt : block) visitStatement(stmt);
+    }
+
+    void visitStatement(const ASTNode* stmt) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            inputs.push_back(input->symbol);
+            typeOf(input->symbol);
+            usesIo = true;
+        } else if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+            visitExpr(output->expr);
+            usesIo = true;
+        } else if (auto call = dynamic_cast<const CallNode*>(stmt)) {
+            const SubroutineNode* callee = visitCall(call->call);
+            if (callee->isFunction())
+                throw std::runtime_error("CALL needs a PROCEDURE, and " + std::string(callee->name) + " is a FUNCTION");
+        } else if (auto ret = dynamic_cast<const ReturnNode*>(stmt)) {
+            if (ret->value) {
+                visitExpr(ret->value);
+                if (isNumeric(ret->type)) expectNumeric(ret->value);
+            }
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            visitExpr(assign->expr);
+            widen(assign->symbol, assign->expr->inferType(context));
+        } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            if (!assign->target->array(context))
+                throw std::runtime_error("Cannot assign to " + assign->target->toString() + ": not an array element");
+            visitIndices(assign->target);
+            visitExpr(assign->expr);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            if (current)
+                throw std::runtime_error("DECLARE " + std::string(declare->name) + ": arrays can only be declared outside "
+                                         "PROCEDURE and FUNCTION");
+            for (const auto& bound : declare->bounds) {
+                for (auto expr : {bound.lower, bound.upper}) {
+                    visitExpr(expr);
+                    expectNumeric(expr);
+                }
+            }
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            visitExpr(ifNode->condition);
+            visitBlock(ifNode->thenBranch);
+            visitBlock(ifNode->elseBranch);
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            visitExpr(whileNode->condition);
+            visitBlock(whileNode->body);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            visitBlock(repeat->body);
+            visitExpr(repeat->condition);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            // A REAL start, end or step makes a REAL iterator; truncated to
+            // INTEGER, a fractional step would never reach the end.
+            widen(forNode->symbol, ValueType::Int);
+            for (auto bound : {forNode->startExpr, forNode->endExpr, forNode->stepExpr}) {
+                visitExpr(bound);
+                expectNumeric(bound);
+                if (bound->inferType(context) == ValueType::Real) widen(forNode->symbol, ValueType::Real);
+            }
+            visitBlock(forNode->body);
+        }
+    }
+};
+
+}
+
+void inferTypes(const ProgramNode* program, CompilationContext& context) {
+    TypeInference(context).run(program);
+}
+
+void recordArray(ArrayTable& arrays, const DeclareNode* declare) {
+    auto [it, added] = arrays.try_emplace(declare->symbol, ArrayInfo{declare->elementType, declare->bounds.size()});
+    if (!added && (it->second.element != declare->elementType || it->second.rank != declare->bounds.size()))
+        throw std::runtime_error("Array " + std::string(declare->name) + " is declared with different types");
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "ast.hpp"
+
+// Fills context.variables with the type of every variable in the program.
+void inferTypes(const ProgramNode* program, CompilationContext& context);
+
+// Adds one DECLARE to arrays. Every DECLARE of an array must agree on its
+// element type and number of dimensions.
+void recordArray(ArrayTable& arrays, const DeclareNode* declare);
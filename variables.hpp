@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Int is 32 bits and Long 64; a variable is only Long where the range pass
+// cannot show that 32 bits hold every value it takes.
+enum class ValueType {
+    Unknown, Bool, Int, Long, Real, String
+};
+
+// Versions are unique across every table, so a type cached against one
+// table's version is never taken for another's.
+inline uint64_t nextTypesVersion() {
+    static std::atomic<uint64_t> last{0};
+    return ++last;
+}
+
+// Variable types keyed by interned symbol id. Scopes nest and lookups walk
+// outwards from the innermost one; the program body is the outermost scope.
+// Each scope remembers the order its variables were declared in. Every
+// change that can alter what typeOf answers moves the table to a new
+// version, which is what expression types are cached against.
+class VariableTable {
+    struct Scope {
+        std::unordered_map<uint32_t, ValueType> types;
+        std::vector<uint32_t> declared;
+    };
+
+    std::vector<Scope> scopes = std::vector<Scope>(1);
+    uint64_t current = nextTypesVersion();
+
+    void changed() { current = nextTypesVersion(); }
+
+    ValueType* find(uint32_t symbol) {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto it = scope->types.find(symbol);
+            if (it != scope->types.end()) return &it->second;
+        }
+        return nullptr;
+    }
+
+    ValueType& local(uint32_t symbol) {
+        Scope& scope = scopes.back();
+        auto [it, added] = scope.types.try_emplace(symbol, ValueType::Unknown);
+        if (added) {
+            scope.declared.push_back(symbol);
+            changed();
+        }
+        return it->second;
+    }
+
+public:
+    void clear() {
+        scopes.assign(1, Scope());
+        changed();
+    }
+
+    void pushScope() {
+        scopes.emplace_back();
+        changed();
+    }
+    void popScope() {
+        scopes.pop_back();
+        changed();
+    }
+
+    // Declares symbol in the innermost scope unless it is already visible,
+    // and returns its type.
+    ValueType declare(uint32_t symbol) {
+        if (ValueType* type = find(symbol)) return *type;
+        Scope& scope = scopes.back();
+        scope.declared.push_back(symbol);
+        return scope.types[symbol];
+    }
+
+    // Sets the type of symbol where it is visible, declaring it first if
+    // it is not.
+    void assign(uint32_t symbol, ValueType type) {
+        ValueType* visible = find(symbol);
+        if (!visible) {
+            declare(symbol);
+            visible = find(symbol);
+        }
+        if (*visible == type) return;
+        *visible = type;
+        changed();
+    }
+
+    // Declares symbol in the innermost scope, hiding any outer one.
+    void declareLocal(uint32_t symbol) { local(symbol); }
+    void declareLocal(uint32_t symbol, ValueType type) {
+        ValueType& visible = local(symbol);
+        if (visible == type) return;
+        visible = type;
+        changed();
+    }
+
+    bool isLocal(uint32_t symbol) const { return scopes.back().types.count(symbol) != 0; }
+
+    bool contains(uint32_t symbol) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+            if (scope->types.count(symbol)) return true;
+        return false;
+    }
+
+    ValueType typeOf(uint32_t symbol) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto it = scope->types.find(symbol);
+            if (it != scope->types.end()) return it->second;
+        }
+        return ValueType::Unknown;
+    }
+
+    const std::vector<uint32_t>& declarations() const { return scopes.back().declared; }
+
+    uint64_t version() const { return current; }
+};
+
+// What DECLARE says about an array. Arrays are not variables: they never
+// appear in a VariableTable, and only their elements have a ValueType.
+struct ArrayInfo {
+    ValueType element = ValueType::Unknown;
+    size_t rank = 0;
+};
+
+using ArrayTable = std::unordered_map<uint32_t, ArrayInfo>;
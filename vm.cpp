@@ -0,0 +1,563 @@
+#include "vm.hpp"
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+bool isInteger(std::string_view text) {
+    size_t i = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    if (i == text.size()) return false;
+    for (; i < text.size(); i++)
+        if (!isdigit(static_cast<unsigned char>(text[i]))) return false;
+    return true;
+}
+
+// text once isInteger has accepted it; numbers are 64-bit, as in the C++
+// backend, and anything beyond is an error rather than a wrapped value.
+long long parseInteger(const std::string& text) {
+    const char* first = text.data() + (text[0] == '+');
+    long long value = 0;
+    auto [end, ec] = std::from_chars(first, text.data() + text.size(), value);
+    if (ec != std::errc()) throw std::runtime_error("Runtime error: integer overflow reading " + text);
+    return value;
+}
+
+Value makeNumber(long long n) {
+    Value v;
+    v.number = n;
+    return v;
+}
+
+Value makeString(const std::string& s) {
+    Value v;
+    v.isString = true;
+    v.text = s;
+    return v;
+}
+
+long long toNumber(const Value& v) {
+    if (!v.isString) return v.number;
+    if (!isInteger(v.text)) throw std::runtime_error("Runtime error: \"" + v.text + "\" is not a number");
+    return parseInteger(v.text);
+}
+
+std::string toText(const Value& v) {
+    return v.isString ? v.text : std::to_string(v.number);
+}
+
+bool isTruthy(const Value& v) {
+    return v.isString ? !v.text.empty() : v.number != 0;
+}
+
+OpCode binaryOpCode(std::string_view op) {
+    if (op == "+") return OP_ADD;
+    if (op == "-") return OP_SUB;
+    if (op == "*") return OP_MUL;
+    if (op == "/") return OP_DIV;
+    if (op == "%") return OP_MOD;
+    if (op == "<") return OP_LT;
+    if (op == "<=") return OP_LE;
+    if (op == ">") return OP_GT;
+    if (op == ">=") return OP_GE;
+    if (op == "=" || op == "==") return OP_EQ;
+    if (op == "<>" || op == "!=") return OP_NE;
+    throw std::runtime_error("Unsupported operator in bytecode: " + std::string(op));
+}
+
+class BytecodeCompiler {
+    Chunk chunk;
+    // Slots of the frame being compiled: the main program's, or a function's.
+    std::vector<std::string>* frame = &chunk.slotNames;
+    std::unordered_map<std::string, int32_t> slots;
+    std::unordered_map<std::string_view, int32_t> functions;
+    std::vector<const SubroutineNode*> subroutines;
+    std::unordered_map<std::string_view, int32_t> arrays;
+    std::unordered_map<std::string, int32_t> numberConstants;
+    std::unordered_map<std::string, int32_t> stringConstants;
+
+public:
+    Chunk compile(const ProgramNode* program) {
+        for (auto subroutine : program->subroutines) {
+            functions.emplace(subroutine->name, static_cast<int32_t>(subroutines.size()));
+            subroutines.push_back(subroutine);
+            chunk.functions.push_back({std::string(subroutine->name), 0, subroutine->parameters.size(), {}});
+        }
+        collectArrays(program->statements);
+        emitBlock(program->statements);
+        emit(OP_HALT);
+
+        for (size_t i = 0; i < subroutines.size(); i++) {
+            const SubroutineNode* subroutine = subroutines[i];
+            chunk.functions[i].entry = here();
+            frame = &chunk.functions[i].slotNames;
+            slots.clear();
+            for (const auto& parameter : subroutine->parameters) slot(parameter.name);
+            emitBlock(subroutine->body);
+            // A FUNCTION that ends without RETURN gives its type's default value.
+            if (subroutine->isFunction()) {
+                bool isString = subroutine->result == ValueType::String;
+                emit(OP_CONST, constant(isString ? "" : "0", isString));
+            }
+            emit(OP_RETURN);
+        }
+        return std::move(chunk);
+    }
+
+private:
+    int32_t emit(OpCode op, int32_t arg = 0) {
+        chunk.code.push_back({op, arg});
+        return static_cast<int32_t>(chunk.code.size() - 1);
+    }
+
+    int32_t here() const { return static_cast<int32_t>(chunk.code.size()); }
+
+    void patchJump(int32_t at) { chunk.code[at].arg = here(); }
+
+    int32_t slot(std::string_view view) {
+        std::string name(view);
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        int32_t index = static_cast<int32_t>(frame->size());
+        frame->push_back(name);
+        slots.emplace(name, index);
+        return index;
+    }
+
+    // A slot no variable can name.
+    int32_t hiddenSlot() {
+        int32_t index = static_cast<int32_t>(frame->size());
+        frame->push_back(" for " + std::to_string(index));
+        return index;
+    }
+
+    // Pushes the arguments and calls; the callee must be a FUNCTION exactly
+    // when a value is wanted.
+    void emitCall(const CallExpr* call, bool wantsValue) {
+        auto it = functions.find(call->name);
+        if (it == functions.end()) throw std::runtime_error("Unknown PROCEDURE or FUNCTION " + std::string(call->name));
+        const SubroutineNode* callee = subroutines[it->second];
+        if (call->arguments.size() != callee->parameters.size())
+            throw std::runtime_error(call->toString() + ": " + std::string(callee->name) + " takes " +
+                                     std::to_string(callee->parameters.size()) + " argument(s)");
+        if (callee->isFunction() != wantsValue)
+            throw std::runtime_error(wantsValue ? "PROCEDURE " + std::string(callee->name) + " has no value"
+                                                : "CALL needs a PROCEDURE, and " + std::string(callee->name) + " is a FUNCTION");
+        for (auto argument : call->arguments) emitExpr(argument);
+        emit(OP_CALL, it->second);
+    }
+
+    // Every array gets its number up front, so that an element read placed
+    // before the DECLARE in the text still reads the array.
+    void collectArrays(NodeList block) {
+        for (auto stmt : block) {
+            if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+                if (arrays.count(declare->name)) continue;
+                arrays.emplace(declare->name, static_cast<int32_t>(chunk.arrays.size()));
+                chunk.arrays.push_back({std::string(declare->name), declare->bounds.size(),
+                                        declare->elementType == ValueType::String});
+            } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+                collectArrays(ifNode->thenBranch);
+                collectArrays(ifNode->elseBranch);
+            } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+                collectArrays(whileNode->body);
+            } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+                collectArrays(repeat->body);
+            } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+                collectArrays(forNode->body);
+            }
+        }
+    }
+
+    // The array idx reads from, or -1 for a character of a string.
+    int32_t arrayOf(const IndexExpr* idx) const {
+        auto var = dynamic_cast<const VariableExpr*>(idx->base);
+        auto it = var ? arrays.find(var->name) : arrays.end();
+        return it == arrays.end() ? -1 : it->second;
+    }
+
+    int32_t constant(std::string_view view, bool isString) {
+        std::string text(view);
+        auto& pool = isString ? stringConstants : numberConstants;
+        auto it = pool.find(text);
+        if (it != pool.end()) return it->second;
+        int32_t index = static_cast<int32_t>(chunk.constants.size());
+        chunk.constants.push_back(isString ? makeString(text) : makeNumber(std::stoll(text)));
+        pool.emplace(text, index);
+        return index;
+    }
+
+    void emitAtom(std::string_view text) {
+        if (isInteger(text)) emit(OP_CONST, constant(text, false));
+        else emit(OP_LOAD, slot(text));
+    }
+
+    void emitExpr(const ExprNode* expr) {
+        if (auto var = dynamic_cast<const VariableExpr*>(expr)) {
+            emit(OP_LOAD, slot(var->name));
+        } else if (auto lit = dynamic_cast<const LiteralExpr*>(expr)) {
+            if (lit->type == TRUE || lit->type == FALSE) emit(OP_CONST, constant(lit->type == TRUE ? "1" : "0", false));
+            else if (lit->literalType() == ValueType::Real) throw std::runtime_error("Unsupported REAL literal in bytecode: " + lit->toString());
+            else emit(OP_CONST, constant(lit->value, lit->type == STRING));
+        } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+            emitExpr(unary->operand);
+            emit(unary->op == "NOT" ? OP_NOT : OP_NEG);
+        } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+            emitCall(call, true);
+        } else if (auto bin = dynamic_cast<const BinaryExpr*>(expr)) {
+            if (isLogicalOperator(bin->op)) {
+                emitLogical(bin);
+                return;
+            }
+            emitExpr(bin->left);
+            emitExpr(bin->right);
+            emit(binaryOpCode(bin->op));
+        } else if (auto idx = dynamic_cast<const IndexExpr*>(expr)) {
+            int32_t array = arrayOf(idx);
+            if (array < 0) emitExpr(idx->base);
+            for (auto index : idx->indices) emitExpr(index);
+            if (array < 0) emit(OP_INDEX);
+            else emit(OP_ELEMENT, array);
+        } else {
+            throw std::runtime_error("Unsupported expression in bytecode: " + expr->toString());
+        }
+    }
+
+    // AND and OR leave 1 or 0 and skip the right operand once the left one
+    // decides the result.
+    void emitLogical(const BinaryExpr* bin) {
+        bool isAnd = bin->op == "AND";
+        emitExpr(bin->left);
+        int32_t leftFalse = emit(OP_JUMP_IF_FALSE), leftTrue = -1;
+        if (!isAnd) {
+            leftTrue = emit(OP_JUMP);
+            patchJump(leftFalse);
+        }
+        emitExpr(bin->right);
+        int32_t rightFalse = emit(OP_JUMP_IF_FALSE);
+        if (!isAnd) patchJump(leftTrue);
+        emit(OP_CONST, constant("1", false));
+        int32_t toEnd = emit(OP_JUMP);
+        if (isAnd) patchJump(leftFalse);
+        patchJump(rightFalse);
+        emit(OP_CONST, constant("0", false));
+        patchJump(toEnd);
+    }
+
+    void emitBlock(NodeList block) {
+        for (auto stmt : block) emitStatement(stmt);
+    }
+
+    void emitStatement(const ASTNode* stmt) {
+        if (auto input = dynamic_cast<const InputNode*>(stmt)) {
+            emit(OP_INPUT, slot(input->variableName));
+        } else if (auto output = dynamic_cast<const OutputExprNode*>(stmt)) {
+            emitExpr(output->expr);
+            emit(OP_OUTPUT);
+        } else if (auto output = dynamic_cast<const OutputNode*>(stmt)) {
+            if (output->type == STRING) emit(OP_CONST, constant(output->value, true));
+            else emitAtom(output->value);
+            emit(OP_OUTPUT);
+        } else if (auto assign = dynamic_cast<const AssignNode*>(stmt)) {
+            emitExpr(assign->expr);
+            emit(OP_STORE, slot(assign->variableName));
+        } else if (auto call = dynamic_cast<const CallNode*>(stmt)) {
+            emitCall(call->call, false);
+        } else if (auto ret = dynamic_cast<const ReturnNode*>(stmt)) {
+            if (ret->value) emitExpr(ret->value);
+            emit(OP_RETURN);
+        } else if (auto assign = dynamic_cast<const ElementAssignNode*>(stmt)) {
+            int32_t array = arrayOf(assign->target);
+            if (array < 0) throw std::runtime_error("Cannot assign to " + assign->target->toString());
+            for (auto index : assign->target->indices) emitExpr(index);
+            emitExpr(assign->expr);
+            emit(OP_STORE_ELEMENT, array);
+        } else if (auto declare = dynamic_cast<const DeclareNode*>(stmt)) {
+            for (const auto& bound : declare->bounds) {
+                emitExpr(bound.lower);
+                emitExpr(bound.upper);
+            }
+            emit(OP_DECLARE, arrays.at(declare->name));
+        } else if (auto ifNode = dynamic_cast<const IfNode*>(stmt)) {
+            emitExpr(ifNode->condition);
+            int32_t toElse = emit(OP_JUMP_IF_FALSE);
+            emitBlock(ifNode->thenBranch);
+            if (ifNode->elseBranch.empty()) {
+                patchJump(toElse);
+            } else {
+                int32_t toEnd = emit(OP_JUMP);
+                patchJump(toElse);
+                emitBlock(ifNode->elseBranch);
+                patchJump(toEnd);
+            }
+        } else if (auto whileNode = dynamic_cast<const WhileNode*>(stmt)) {
+            int32_t loop = here();
+            emitExpr(whileNode->condition);
+            int32_t toEnd = emit(OP_JUMP_IF_FALSE);
+            emitBlock(whileNode->body);
+            emit(OP_JUMP, loop);
+            patchJump(toEnd);
+        } else if (auto repeat = dynamic_cast<const RepeatUntilNode*>(stmt)) {
+            int32_t loop = here();
+            emitBlock(repeat->body);
+            emitExpr(repeat->condition);
+            emit(OP_JUMP_IF_FALSE, loop);
+        } else if (auto forNode = dynamic_cast<const ForNode*>(stmt)) {
+            // The end and a non-literal step live in hidden slots, filled
+            // once before the iterator is assigned.
+            int32_t iterator = slot(forNode->iterator);
+            auto stepLiteral = dynamic_cast<const LiteralExpr*>(forNode->stepExpr);
+            int sign = stepLiteral ? literalStepSign(stepLiteral->type, stepLiteral->value) : 0;
+            int32_t end = hiddenSlot(), step = sign ? 0 : hiddenSlot();
+            emitExpr(forNode->endExpr);
+            emit(OP_STORE, end);
+            if (!sign) {
+                emitExpr(forNode->stepExpr);
+                emit(OP_STORE, step);
+            }
+            emitExpr(forNode->startExpr);
+            emit(OP_STORE, iterator);
+            int32_t loop = here();
+            if (sign) {
+                emit(OP_LOAD, iterator);
+                emit(OP_LOAD, end);
+                emit(sign > 0 ? OP_LE : OP_GE);
+            } else {
+                emit(OP_LOAD, step);
+                emit(OP_CONST, constant("0", false));
+                emit(OP_LT);
+                int32_t ascending = emit(OP_JUMP_IF_FALSE);
+                emit(OP_LOAD, iterator);
+                emit(OP_LOAD, end);
+                emit(OP_GE);
+                int32_t test = emit(OP_JUMP);
+                patchJump(ascending);
+                emit(OP_LOAD, iterator);
+                emit(OP_LOAD, end);
+                emit(OP_LE);
+                patchJump(test);
+            }
+            int32_t toEnd = emit(OP_JUMP_IF_FALSE);
+            emitBlock(forNode->body);
+            emit(OP_LOAD, iterator);
+            if (sign) emitExpr(forNode->stepExpr);
+            else emit(OP_LOAD, step);
+            emit(OP_ADD);
+            emit(OP_STORE, iterator);
+            emit(OP_JUMP, loop);
+            patchJump(toEnd);
+        } else {
+            throw std::runtime_error("Unsupported statement in bytecode");
+        }
+    }
+};
+
+bool compareValues(OpCode op, const Value& l, const Value& r) {
+    int cmp;
+    if (l.isString && r.isString) {
+        cmp = l.text.compare(r.text);
+    } else {
+        long long a = toNumber(l), b = toNumber(r);
+        cmp = (a < b) ? -1 : (a > b) ? 1 : 0;
+    }
+    switch (op) {
+        case OP_LT: return cmp < 0;
+        case OP_LE: return cmp <= 0;
+        case OP_GT: return cmp > 0;
+        case OP_GE: return cmp >= 0;
+        case OP_EQ: return cmp == 0;
+        default: return cmp != 0;
+    }
+}
+
+struct ArrayValue {
+    std::vector<long long> lower, extent;
+    std::vector<Value> elements;
+};
+
+// Pops the indices of an element and returns its position. Checked even
+// where the optimizer dropped the check, since an interpreter gains little
+// from skipping it.
+size_t elementOffset(const ArrayDescriptor& descriptor, const ArrayValue& array, std::vector<Value>& stack) {
+    size_t first = stack.size() - descriptor.rank;
+    size_t offset = 0;
+    bool inRange = array.lower.size() == descriptor.rank;
+    for (size_t d = 0; d < descriptor.rank && inRange; d++) {
+        long long index = toNumber(stack[first + d]) - array.lower[d];
+        inRange = index >= 0 && index < array.extent[d];
+        offset = offset * array.extent[d] + index;
+    }
+    if (!inRange) throw std::runtime_error("Runtime error: index out of range for array " + descriptor.name);
+    stack.resize(first);
+    return offset;
+}
+
+}
+
+Chunk compileBytecode(const ProgramNode* program) {
+    return BytecodeCompiler().compile(program);
+}
+
+void runBytecode(const Chunk& chunk, std::istream& in, std::ostream& out) {
+    // The frames of active calls are stacked in slots above the main
+    // program's; base is where the innermost one starts.
+    struct Return {
+        size_t pc;
+        size_t base;
+    };
+    std::vector<Value> slots(chunk.slotNames.size());
+    std::vector<Return> returns;
+    size_t base = 0;
+    std::vector<ArrayValue> arrays(chunk.arrays.size());
+    std::vector<Value> stack;
+    stack.reserve(64);
+
+    const Instruction* code = chunk.code.data();
+    size_t pc = 0;
+    while (true) {
+        const Instruction& ins = code[pc++];
+        switch (ins.op) {
+            case OP_CONST:
+                stack.push_back(chunk.constants[ins.arg]);
+                break;
+            case OP_LOAD:
+                stack.push_back(slots[base + ins.arg]);
+                break;
+            case OP_STORE:
+                slots[base + ins.arg] = std::move(stack.back());
+                stack.pop_back();
+                break;
+            case OP_ADD: {
+                Value r = std::move(stack.back());
+                stack.pop_back();
+                Value& l = stack.back();
+                if (l.isString || r.isString) {
+                    l.text = toText(l) + toText(r);
+                    l.isString = true;
+                } else {
+                    l.number += r.number;
+                }
+                break;
+            }
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD: {
+                long long b = toNumber(stack.back());
+                stack.pop_back();
+                long long a = toNumber(stack.back());
+                if ((ins.op == OP_DIV || ins.op == OP_MOD) && b == 0)
+                    throw std::runtime_error("Runtime error: division by zero");
+                long long result = ins.op == OP_SUB ? a - b
+                                 : ins.op == OP_MUL ? a * b
+                                 : ins.op == OP_DIV ? a / b
+                                 : a % b;
+                stack.back() = makeNumber(result);
+                break;
+            }
+            case OP_LT:
+            case OP_LE:
+            case OP_GT:
+            case OP_GE:
+            case OP_EQ:
+            case OP_NE: {
+                Value r = std::move(stack.back());
+                stack.pop_back();
+                bool result = compareValues(ins.op, stack.back(), r);
+                stack.back() = makeNumber(result ? 1 : 0);
+                break;
+            }
+            case OP_NEG:
+                stack.back() = makeNumber(-toNumber(stack.back()));
+                break;
+            case OP_NOT:
+                stack.back() = makeNumber(isTruthy(stack.back()) ? 0 : 1);
+                break;
+            case OP_INDEX: {
+                long long i = toNumber(stack.back());
+                stack.pop_back();
+                Value& base = stack.back();
+                if (!base.isString) throw std::runtime_error("Runtime error: cannot index a number");
+                if (i < 0 || i >= static_cast<long long>(base.text.size()))
+                    throw std::runtime_error("Runtime error: index " + std::to_string(i) + " out of range");
+                base.text = std::string(1, base.text[i]);
+                break;
+            }
+            case OP_DECLARE: {
+                const ArrayDescriptor& descriptor = chunk.arrays[ins.arg];
+                ArrayValue& array = arrays[ins.arg];
+                size_t first = stack.size() - 2 * descriptor.rank;
+                size_t count = 1;
+                array.lower.clear();
+                array.extent.clear();
+                for (size_t d = 0; d < descriptor.rank; d++) {
+                    long long lower = toNumber(stack[first + 2 * d]), upper = toNumber(stack[first + 2 * d + 1]);
+                    if (upper < lower - 1)
+                        throw std::runtime_error("Runtime error: invalid bounds for array " + descriptor.name);
+                    array.lower.push_back(lower);
+                    array.extent.push_back(upper - lower + 1);
+                    count *= static_cast<size_t>(upper - lower + 1);
+                }
+                stack.resize(first);
+                array.elements.assign(count, descriptor.isString ? makeString("") : makeNumber(0));
+                break;
+            }
+            case OP_ELEMENT: {
+                ArrayValue& array = arrays[ins.arg];
+                size_t offset = elementOffset(chunk.arrays[ins.arg], array, stack);
+                stack.push_back(array.elements[offset]);
+                break;
+            }
+            case OP_STORE_ELEMENT: {
+                Value value = std::move(stack.back());
+                stack.pop_back();
+                ArrayValue& array = arrays[ins.arg];
+                array.elements[elementOffset(chunk.arrays[ins.arg], array, stack)] = std::move(value);
+                break;
+            }
+            case OP_JUMP:
+                pc = ins.arg;
+                break;
+            case OP_JUMP_IF_FALSE: {
+                bool condition = isTruthy(stack.back());
+                stack.pop_back();
+                if (!condition) pc = ins.arg;
+                break;
+            }
+            case OP_CALL: {
+                const FunctionDescriptor& function = chunk.functions[ins.arg];
+                returns.push_back({pc, base});
+                base = slots.size();
+                slots.resize(base + function.slotNames.size());
+                size_t first = stack.size() - function.parameters;
+                for (size_t i = 0; i < function.parameters; i++) slots[base + i] = std::move(stack[first + i]);
+                stack.resize(first);
+                pc = function.entry;
+                break;
+            }
+            case OP_RETURN:
+                slots.resize(base);
+                pc = returns.back().pc;
+                base = returns.back().base;
+                returns.pop_back();
+                break;
+            case OP_INPUT: {
+                std::string word;
+                in >> word;
+                slots[base + ins.arg] = isInteger(word) ? makeNumber(parseInteger(word)) : makeString(word);
+                break;
+            }
+            case OP_OUTPUT: {
+                const Value& v = stack.back();
+                if (v.isString) out << v.text << '\n';
+                else out << v.number << '\n';
+                stack.pop_back();
+                break;
+            }
+            case OP_HALT:
+                out.flush();
+                return;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+
+enum OpCode : uint8_t {
+    OP_CONST, OP_LOAD, OP_STORE,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_NEG, OP_NOT,
+    OP_INDEX,
+    OP_DECLARE, OP_ELEMENT, OP_STORE_ELEMENT,
+    OP_JUMP, OP_JUMP_IF_FALSE,
+    OP_CALL, OP_RETURN,
+    OP_INPUT, OP_OUTPUT,
+    OP_HALT
+};
+
+struct Instruction {
+    OpCode op;
+    int32_t arg;
+};
+
+struct Value {
+    bool isString = false;
+    long long number = 0;
+    std::string text;
+};
+
+// The array instructions take an index into Chunk::arrays. OP_DECLARE pops
+// the lower and upper bound of each dimension, OP_ELEMENT the indices, and
+// OP_STORE_ELEMENT the indices and then the value.
+struct ArrayDescriptor {
+    std::string name;
+    size_t rank = 0;
+    bool isString = false;
+};
+
+// A PROCEDURE or FUNCTION, called with OP_CALL and an index into
+// Chunk::functions. Each call gets a frame of its own slots, the parameters
+// first, which OP_CALL fills from the arguments on the stack. OP_RETURN
+// drops the frame; a FUNCTION leaves its result on the stack.
+struct FunctionDescriptor {
+    std::string name;
+    int32_t entry = 0;
+    size_t parameters = 0;
+    std::vector<std::string> slotNames;
+};
+
+struct Chunk {
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<std::string> slotNames;
+    std::vector<ArrayDescriptor> arrays;
+    std::vector<FunctionDescriptor> functions;
+};
+
+Chunk compileBytecode(const ProgramNode* program);
+void runBytecode(const Chunk& chunk, std::istream& in, std::ostream& out);